@@ -24,6 +24,12 @@ BLECharacteristic* remoteSendCharacteristic = NULL;
 BLECharacteristic* remoteRecordCharacteristic = NULL;
 // remote record enable characteristic, used to enable/disable record mode
 BLECharacteristic* remoteRecordEnableCharacteristic = NULL;
+// remote metrics characteristic, write to it to receive the latency metrics over the remoteRecordCharacteristic, as {"type":"metrics",...}
+BLECharacteristic* remoteMetricsCharacteristic = NULL;
+// remote captures characteristic, write to it to receive the next capture log records over the remoteRecordCharacteristic, as {"type":"captures",...}
+BLECharacteristic* remoteCapturesCharacteristic = NULL;
+// remote status characteristic, write to it to receive the status document over the remoteRecordCharacteristic, as {"type":"status",...}
+BLECharacteristic* remoteStatusCharacteristic = NULL;
 
 // Change to your preffered advertising name.
 // Suggestions include "Living Room", "Basement", etc.
@@ -64,6 +70,33 @@ class remoteRecordEnableCharacteristicCallbacks: public BLECharacteristicCallbac
 	}
 };
 
+/******************************************************************************************************************
+* remoteMetricsCharacteristic callbacks
+******************************************************************************************************************/
+class remoteMetricsCharacteristicCallbacks: public BLECharacteristicCallbacks {
+	void onWrite(BLECharacteristic *pCharacteristic) {
+		dynamote.onRemoteMetricsCharacteristic();
+	}
+};
+
+/******************************************************************************************************************
+* remoteCapturesCharacteristic callbacks
+******************************************************************************************************************/
+class remoteCapturesCharacteristicCallbacks: public BLECharacteristicCallbacks {
+	void onWrite(BLECharacteristic *pCharacteristic) {
+		dynamote.onRemoteCapturesCharacteristic();
+	}
+};
+
+/******************************************************************************************************************
+* remoteStatusCharacteristic callbacks
+******************************************************************************************************************/
+class remoteStatusCharacteristicCallbacks: public BLECharacteristicCallbacks {
+	void onWrite(BLECharacteristic *pCharacteristic) {
+		dynamote.onRemoteStatusCharacteristic();
+	}
+};
+
 /******************************************************************************************************************
 * setup
 ******************************************************************************************************************/
@@ -98,15 +131,33 @@ void setup() {
                               BLECharacteristic::PROPERTY_READ      |
                               BLECharacteristic::PROPERTY_WRITE
                             );
+  remoteMetricsCharacteristic = remoteService->createCharacteristic(
+                              DYNAMOTE_REMOTE_METRICS_CHARACTERISTIC_UUID,
+                              BLECharacteristic::PROPERTY_WRITE
+                            );
+  remoteCapturesCharacteristic = remoteService->createCharacteristic(
+                              DYNAMOTE_REMOTE_CAPTURES_CHARACTERISTIC_UUID,
+                              BLECharacteristic::PROPERTY_WRITE
+                            );
+  remoteStatusCharacteristic = remoteService->createCharacteristic(
+                              DYNAMOTE_REMOTE_STATUS_CHARACTERISTIC_UUID,
+                              BLECharacteristic::PROPERTY_WRITE
+                            );
 
   // Create BLE Descriptors
   remoteSendCharacteristic->addDescriptor(new BLE2902());
   remoteRecordCharacteristic->addDescriptor(new BLE2902());
   remoteRecordEnableCharacteristic->addDescriptor(new BLE2902());
+  remoteMetricsCharacteristic->addDescriptor(new BLE2902());
+  remoteCapturesCharacteristic->addDescriptor(new BLE2902());
+  remoteStatusCharacteristic->addDescriptor(new BLE2902());
 
   // set characteristic callbacks
   remoteSendCharacteristic->setCallbacks(new remoteSendCharacteristicCallbacks());
   remoteRecordEnableCharacteristic->setCallbacks(new remoteRecordEnableCharacteristicCallbacks());
+  remoteMetricsCharacteristic->setCallbacks(new remoteMetricsCharacteristicCallbacks());
+  remoteCapturesCharacteristic->setCallbacks(new remoteCapturesCharacteristicCallbacks());
+  remoteStatusCharacteristic->setCallbacks(new remoteStatusCharacteristicCallbacks());
 
   // Start the service
   remoteService->start();
@@ -133,7 +184,8 @@ void setup() {
 ******************************************************************************************************************/
 void loop() {
   dynamote.loop();
-  delay(1);
+  // sleep until the next timeout is due, or the transport needs polling again
+  dynamote.idle();
 }
 
 /******************************************************************************************************************
@@ -158,6 +210,14 @@ void customCommandHandler(RemoteCommand command) {
   *  - toggle a relay
   *  - control an RGB light strip. Turn on/off, change brightness, change color, change pattern, etc.  
   */
+  Serial.print("Unhandled custom command: ");
+  Serial.println(command.customCode);
+}
+
+/******************************************************************************************************************
+* sendIrCodeTwice
+******************************************************************************************************************/
+void sendIrCodeTwice(RemoteCommand command) {
 
   /*
   *  Example:
@@ -167,13 +227,22 @@ void customCommandHandler(RemoteCommand command) {
   *  it just sets the useCustomCode flag to true. Therefore, you can still send an IR command within a custom code handler.
   *  We can use this to create a custom command that sends the IR command multiple times to solve the described issue, see below.
   */
-  if (command.customCode == "send_IR_code_twice") {
-    // verify that an IR command is present
-    if (command.codeLength == 0) {
-      return;
-    }
-    dynamote.sendRemoteCommand(command);
-    delay(2000);
-    dynamote.sendRemoteCommand(command);
+  // verify that an IR command is present
+  if (command.codeLength == 0) {
+    return;
   }
+  dynamote.sendRemoteCommand(command);
+  delay(2000);
+  dynamote.sendRemoteCommand(command);
 }
+
+/******************************************************************************************************************
+* custom command handlers
+*
+* Also optional, a custom command can have a handler of its own. The names are hashed at compile time and picked
+* with a switch, so they stay quick with many custom commands. Any other custom command still goes to
+* customCommandHandler.
+******************************************************************************************************************/
+DYNAMOTE_CUSTOM_COMMANDS(
+  CUSTOM_COMMAND("send_IR_code_twice", &sendIrCodeTwice)
+)
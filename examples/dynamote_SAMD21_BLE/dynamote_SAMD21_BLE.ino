@@ -22,6 +22,12 @@ BLECharacteristic remoteSendCharacteristic(DYNAMOTE_REMOTE_SEND_CHARACTERISTIC_U
 BLECharacteristic remoteRecordCharacteristic(DYNAMOTE_REMOTE_RECORD_CHARACTERISTIC_UUID, BLERead | BLENotify, CHARACTERISTIC_LENGTH);
 // remote record enable characteristic, used to enable/disable record mode
 BLEBoolCharacteristic remoteRecordEnableCharacteristic(DYNAMOTE_REMOTE_RECORD_ENABLE_CHARACTERISTIC_UUID, BLERead | BLEWrite);
+// remote metrics characteristic, write to it to receive the latency metrics over the remoteRecordCharacteristic, as {"type":"metrics",...}
+BLEBoolCharacteristic remoteMetricsCharacteristic(DYNAMOTE_REMOTE_METRICS_CHARACTERISTIC_UUID, BLEWrite);
+// remote captures characteristic, write to it to receive the next capture log records over the remoteRecordCharacteristic, as {"type":"captures",...}
+BLEBoolCharacteristic remoteCapturesCharacteristic(DYNAMOTE_REMOTE_CAPTURES_CHARACTERISTIC_UUID, BLEWrite);
+// remote status characteristic, write to it to receive the status document over the remoteRecordCharacteristic, as {"type":"status",...}
+BLEBoolCharacteristic remoteStatusCharacteristic(DYNAMOTE_REMOTE_STATUS_CHARACTERISTIC_UUID, BLEWrite);
 
 char bleAdvertisingName[] = BLE_ADVERTISING_NAME;
 
@@ -49,6 +55,9 @@ void setup() {
   remoteService.addCharacteristic(remoteSendCharacteristic);
   remoteService.addCharacteristic(remoteRecordCharacteristic);
   remoteService.addCharacteristic(remoteRecordEnableCharacteristic);
+  remoteService.addCharacteristic(remoteMetricsCharacteristic);
+  remoteService.addCharacteristic(remoteCapturesCharacteristic);
+  remoteService.addCharacteristic(remoteStatusCharacteristic);
 
   // add service
   BLE.addService(remoteService);
@@ -60,6 +69,9 @@ void setup() {
   // assign event handlers for characteristic
   remoteSendCharacteristic.setEventHandler(BLEWritten, remoteSendCharacteristicWritten);
   remoteRecordEnableCharacteristic.setEventHandler(BLEWritten, remoteRecordEnableCharacteristicWritten);
+  remoteMetricsCharacteristic.setEventHandler(BLEWritten, remoteMetricsCharacteristicWritten);
+  remoteCapturesCharacteristic.setEventHandler(BLEWritten, remoteCapturesCharacteristicWritten);
+  remoteStatusCharacteristic.setEventHandler(BLEWritten, remoteStatusCharacteristicWritten);
 
   // set an initial value for the characteristics
   remoteSendCharacteristic.setValue(0);
@@ -86,7 +98,8 @@ void loop() {
   // poll for BLE events
   BLE.poll();
   dynamote.loop();
-  delay(1);
+  // sleep until the next timeout is due, or the transport needs polling again
+  dynamote.idle();
 }
 
 /******************************************************************************************************************
@@ -127,6 +140,27 @@ void remoteRecordEnableCharacteristicWritten(BLEDevice central, BLECharacteristi
   dynamote.onRemoteRecordEnableCharacteristic(remoteRecordEnableCharacteristic.value());
 }
 
+/******************************************************************************************************************
+* remoteMetricsCharacteristicWritten
+******************************************************************************************************************/
+void remoteMetricsCharacteristicWritten(BLEDevice central, BLECharacteristic characteristic) {
+  dynamote.onRemoteMetricsCharacteristic();
+}
+
+/******************************************************************************************************************
+* remoteCapturesCharacteristicWritten
+******************************************************************************************************************/
+void remoteCapturesCharacteristicWritten(BLEDevice central, BLECharacteristic characteristic) {
+  dynamote.onRemoteCapturesCharacteristic();
+}
+
+/******************************************************************************************************************
+* remoteStatusCharacteristicWritten
+******************************************************************************************************************/
+void remoteStatusCharacteristicWritten(BLEDevice central, BLECharacteristic characteristic) {
+  dynamote.onRemoteStatusCharacteristic();
+}
+
 /******************************************************************************************************************
 * sendDataToRemoteRecordCharacteristic
 ******************************************************************************************************************/
@@ -148,6 +182,14 @@ void customCommandHandler(RemoteCommand command) {
   *  - toggle a relay
   *  - control an RGB light strip. Turn on/off, change brightness, change color, change pattern, etc.  
   */
+  Serial.print("Unhandled custom command: ");
+  Serial.println(command.customCode);
+}
+
+/******************************************************************************************************************
+* sendIrCodeTwice
+******************************************************************************************************************/
+void sendIrCodeTwice(RemoteCommand command) {
 
   /*
   *  Example:
@@ -157,13 +199,22 @@ void customCommandHandler(RemoteCommand command) {
   *  it just sets the useCustomCode flag to true. Therefore, you can still send an IR command within a custom code handler.
   *  We can use this to create a custom command that sends the IR command multiple times to solve the described issue, see below.
   */
-  if (command.customCode == "send_IR_code_twice") {
-    // verify that an IR command is present
-    if (command.codeLength == 0) {
-      return;
-    }
-    dynamote.sendRemoteCommand(command);
-    delay(2000);
-    dynamote.sendRemoteCommand(command);
+  // verify that an IR command is present
+  if (command.codeLength == 0) {
+    return;
   }
+  dynamote.sendRemoteCommand(command);
+  delay(2000);
+  dynamote.sendRemoteCommand(command);
 }
+
+/******************************************************************************************************************
+* custom command handlers
+*
+* Also optional, a custom command can have a handler of its own. The names are hashed at compile time and picked
+* with a switch, so they stay quick with many custom commands. Any other custom command still goes to
+* customCommandHandler.
+******************************************************************************************************************/
+DYNAMOTE_CUSTOM_COMMANDS(
+  CUSTOM_COMMAND("send_IR_code_twice", &sendIrCodeTwice)
+)
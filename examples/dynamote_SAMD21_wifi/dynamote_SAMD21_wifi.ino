@@ -67,6 +67,10 @@ void setup() {
   // This is optional.
   // You may provide your own function for responding to custom commands from Dynamote.
   dynamote.setCustomCommandHandlerFxn(&customCommandHandler);
+
+  // Also optional, join named groups so one UDP multicast datagram can reach this device and others at once.
+  // Every device is in the "all" group.
+  dynamote.joinGroup("livingRoom");
 }
 
 /******************************************************************************************************************
@@ -92,7 +96,8 @@ void loop() {
   }
     
   dynamote.loop();
-  delay(1);
+  // sleep until the next timeout is due, or the transport needs polling again
+  dynamote.idle();
 }
 
 /******************************************************************************************************************
@@ -134,6 +139,14 @@ void customCommandHandler(RemoteCommand command) {
   *  - toggle a relay
   *  - control an RGB light strip. Turn on/off, change brightness, change color, change pattern, etc.  
   */
+  Serial.print("Unhandled custom command: ");
+  Serial.println(command.customCode);
+}
+
+/******************************************************************************************************************
+* sendIrCodeTwice
+******************************************************************************************************************/
+void sendIrCodeTwice(RemoteCommand command) {
 
   /*
   *  Example:
@@ -143,13 +156,22 @@ void customCommandHandler(RemoteCommand command) {
   *  it just sets the useCustomCode flag to true. Therefore, you can still send an IR command within a custom code handler.
   *  We can use this to create a custom command that sends the IR command multiple times to solve the described issue, see below.
   */
-  if (command.customCode == "send_IR_code_twice") {
-    // verify that an IR command is present
-    if (command.codeLength == 0) {
-      return;
-    }
-    dynamote.sendRemoteCommand(command);
-    delay(2000);
-    dynamote.sendRemoteCommand(command);
+  // verify that an IR command is present
+  if (command.codeLength == 0) {
+    return;
   }
+  dynamote.sendRemoteCommand(command);
+  delay(2000);
+  dynamote.sendRemoteCommand(command);
 }
+
+/******************************************************************************************************************
+* custom command handlers
+*
+* Also optional, a custom command can have a handler of its own. The names are hashed at compile time and picked
+* with a switch, so they stay quick with many custom commands. Any other custom command still goes to
+* customCommandHandler.
+******************************************************************************************************************/
+DYNAMOTE_CUSTOM_COMMANDS(
+  CUSTOM_COMMAND("send_IR_code_twice", &sendIrCodeTwice)
+)
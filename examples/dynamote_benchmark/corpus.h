@@ -0,0 +1,86 @@
+/******************************************************************************************************************
+* Benchmark corpus
+*
+* Protocol frames are generated with DynamoteEncoder, so they have the timings IRLib2 itself would send.
+* Raw frames are listed as timings, the same way they appear in recvGlobal.decodeBuffer (without the leading gap).
+* Add your own recordings (for example from the debug log of a recording session) to the end of the list.
+*
+* DirecTV and Samsung36 cannot be generated yet, their frames are written out from the IRLib2 send timings with
+* the jitter of a receiver added (marks a little long, spaces a little short). CYKM has no frame yet, the timings
+* it needs could not be checked against IRLib2 here: add a recording of it, the benchmark warns about every
+* protocol that is built in but missing from the corpus.
+******************************************************************************************************************/
+#ifndef CORPUS_H
+#define CORPUS_H
+
+typedef struct
+{
+  const char *name;
+  uint8_t codeProtocol;           // the protocol the decoder should find, UNKNOWN for raw frames
+  uint32_t codeValue;
+  uint8_t codeLength;
+  const uint16_t *raw;            // raw timings, or NULL to generate the frame from the protocol value
+  uint8_t rawLength;
+} CorpusFrame;
+
+// synthetic air conditioner style frame, long enough to fill most of the receive buffer
+const uint16_t rawAirConditioner[] = {
+  3400, 1700, 430, 1290, 430, 1290, 430, 430, 430, 430, 430, 430, 430, 1290, 430, 1290, 430, 430,
+  430, 1290, 430, 430, 430, 430, 430, 1290, 430, 1290, 430, 430, 430, 430, 430, 1290, 430, 430,
+  430, 1290, 430, 1290, 430, 430, 430, 430, 430, 1290, 430, 430, 430, 430, 430, 430, 430, 1290,
+  430, 430, 430, 1290, 430, 1290, 430, 430, 430, 430, 430, 1290, 430, 430, 430, 430, 430, 1290,
+  430, 1290, 430, 430, 430, 1290, 430, 430, 430, 430, 430, 1290, 430, 1290, 430, 430, 430, 430,
+  430, 1290, 430, 430, 430, 430, 430
+};
+
+// synthetic short frame with uneven jitter
+const uint16_t rawShort[] = {
+  2650, 880, 470, 420, 460, 430, 470, 880, 910, 430, 460, 450, 450, 440, 470, 880, 470, 420, 900
+};
+
+// recorded air conditioner frame as saved by older firmware, unquantized: 71 timings with 56 distinct durations
+const uint16_t rawJittered[] = {
+  3461, 1679, 460, 463, 416, 1249, 478, 392, 456, 454, 417, 444, 437, 384, 421, 435, 463, 388,
+  440, 391, 480, 434, 417, 452, 425, 408, 490, 460, 484, 1247, 483, 454, 460, 386, 438, 385,
+  481, 397, 447, 433, 428, 449, 425, 453, 449, 451, 497, 403, 423, 1314, 483, 461, 434, 427,
+  422, 1310, 418, 452, 417, 459, 436, 443, 497, 448, 464, 479, 450, 1299, 484, 438, 456
+};
+
+// Samsung36, address 0x0400 and data 0x8E0F1: 16 bits, a 500/4500 divider, 20 bits
+const uint16_t rawSamsung36[] = {
+  4541, 4477, 521, 430, 538, 475, 520, 448, 560, 469, 535, 463, 566, 1439, 547, 457, 555, 463,
+  554, 476, 556, 454, 551, 456, 542, 432, 545, 465, 545, 470, 527, 448, 551, 436, 568, 4467,
+  553, 1462, 531, 449, 565, 443, 540, 435, 555, 1470, 520, 1442, 544, 1449, 528, 432, 533, 454,
+  543, 467, 551, 434, 568, 464, 559, 1478, 535, 1440, 552, 1451, 561, 1448, 538, 452, 566, 475,
+  535, 461, 533, 1444, 530
+};
+
+// DirecTV 0x1B2C with the long leader: two bits in each mark and space pair, 1200 for a one, 600 for a zero
+const uint16_t rawDirecTV[] = {
+  6031, 1176, 666, 565, 643, 1153, 1265, 546, 1221, 1141, 644, 558, 1251, 570, 1254, 1144, 666, 564,
+  625
+};
+
+const CorpusFrame corpus[] = {
+  { "nec",            NEC,            0x20DF10EF,  32, NULL, 0 },
+  { "necRepeat",      NEC,            REPEAT_CODE, 0,  NULL, 0 },
+  { "sony12",         SONY,           0xA90,       12, NULL, 0 },
+  { "sony15",         SONY,           0x240C,      15, NULL, 0 },
+  { "sony20",         SONY,           0x7421B,     20, NULL, 0 },
+  { "rc5",            RC5,            0x1180,      13, NULL, 0 },
+  { "rc6",            RC6,            0x1000C,     20, NULL, 0 },
+  { "panasonicOld",   PANASONIC_OLD,  0x37A08B,    22, NULL, 0 },
+  { "jvc",            JVC,            0xC5E8,      16, NULL, 0 },
+  { "necx",           NECX,           0xE0E040BF,  32, NULL, 0 },
+  { "giCable",        GICABLE,        0x8B04,      16, NULL, 0 },
+  { "rcmm",           RCMM,           0x24E83D,    24, NULL, 0 },
+  { "samsung36",      SAMSUNG36,      0x8E0F1,     36, rawSamsung36, sizeof(rawSamsung36) / sizeof(uint16_t) },
+  { "directv",        DIRECTV,        0x1B2C,      16, rawDirecTV, sizeof(rawDirecTV) / sizeof(uint16_t) },
+  { "rawAirCon",      UNKNOWN,        0,           0,  rawAirConditioner, sizeof(rawAirConditioner) / sizeof(uint16_t) },
+  { "rawShort",       UNKNOWN,        0,           0,  rawShort, sizeof(rawShort) / sizeof(uint16_t) },
+  { "rawJittered",    UNKNOWN,        0,           0,  rawJittered, sizeof(rawJittered) / sizeof(uint16_t) }
+};
+
+#define CORPUS_LENGTH   (sizeof(corpus) / sizeof(CorpusFrame))
+
+#endif
@@ -0,0 +1,343 @@
+/******************************************************************************************************************
+* Dynamote benchmark
+*
+* Runs the decode, JSON and send preparation paths of the library over a corpus of IR frames (see corpus.h) and
+* prints one JSON object per benchmark over Serial, for example:
+*   {"benchmark":"decode","frames":17,"ops":8500,"nsPerOp":41250,"stackBytes":1320,"heapBytes":0,"matched":17}
+*
+* nsPerOp     average time per frame
+* stackBytes  peak stack used by the benchmark, ESP32 only (each benchmark runs in a fresh task)
+* heapBytes   heap still held after the benchmark, anything other than 0 is a leak or a cache
+* matched     frames decoded to the protocol and value they were generated from, decode only
+*
+* Before the benchmarks, every raw frame is sent through the JSON parser as a plain codeValueRaw array and checked:
+*   {"check":"plainRaw","frame":"rawJittered","timings":71,"worstPercent":17,"result":"pass"}
+* and every built in protocol without a frame in the corpus is listed:
+*   {"warning":"no corpus frame","protocol":"CYKM"}
+*
+* Nothing is received or transmitted, the frames are fed straight into the decode buffer.
+******************************************************************************************************************/
+
+/******************************************************************************************************************
+* includes
+******************************************************************************************************************/
+#include <Dynamote.h>
+#include "corpus.h"
+
+// number of passes over the corpus for each benchmark
+#define BENCHMARK_PASSES        500
+
+#if defined(ESP32)
+#define BENCHMARK_STACK_SIZE    16384
+#endif
+
+// the gap before each frame, as the receiver would have measured it
+#define FRAME_GAP_US            20000
+
+/******************************************************************************************************************
+* global
+******************************************************************************************************************/
+// gives the benchmark access to the JSON conversions of the library
+class BenchmarkDynamote : public Dynamote {
+  public:
+    using Dynamote::serializeRemoteCommandToJsonString;
+    using Dynamote::deserializeJsonObjectToRemoteCommand;
+};
+
+BenchmarkDynamote dynamote;
+IRdecode decoder;
+DynamoteCapture capture;
+DynamoteEncoder encoder;
+
+// the corpus as timings, filled in once by prepareCorpus()
+uint16_t frameTimings[CORPUS_LENGTH][RECV_BUF_LENGTH];
+uint8_t frameLengths[CORPUS_LENGTH];
+RemoteCommand decodedCommands[CORPUS_LENGTH];
+String serializedCommands[CORPUS_LENGTH];
+
+uint32_t matchedFrames = 0;
+volatile bool benchmarkDone = false;
+volatile uint32_t benchmarkStackBytes = 0;
+
+/******************************************************************************************************************
+* setup
+******************************************************************************************************************/
+void setup() {
+
+  Serial.begin(115200);
+  while (!Serial);
+
+  prepareCorpus();
+  checkCoverage();
+  checkPlainRaw();
+
+  runBenchmark("decode", &benchmarkDecode);
+  runBenchmark("serialize", &benchmarkSerialize);
+  runBenchmark("deserialize", &benchmarkDeserialize);
+  runBenchmark("rawSendPrepare", &benchmarkRawSendPrepare);
+  runBenchmark("encode", &benchmarkEncode);
+}
+
+/******************************************************************************************************************
+* loop
+******************************************************************************************************************/
+void loop() {
+  delay(1000);
+}
+
+/******************************************************************************************************************
+* prepareCorpus
+******************************************************************************************************************/
+void prepareCorpus() {
+
+  for (uint8_t x = 0; x < CORPUS_LENGTH; x++) {
+    const CorpusFrame *frame = &corpus[x];
+    if (frame->raw != NULL) {
+      frameLengths[x] = min((int)frame->rawLength, RECV_BUF_LENGTH - 1);
+      memcpy(frameTimings[x], frame->raw, frameLengths[x] * sizeof(uint16_t));
+    }
+    else {
+      uint16_t durations[ENCODER_MAX_DURATIONS];
+      uint8_t khz;
+      uint16_t length = encoder.encode(frame->codeProtocol, frame->codeValue, frame->codeLength, durations, &khz);
+      // only the first frame, the receiver stops at the first long gap
+      uint16_t end = 0;
+      while (end < length && end < RECV_BUF_LENGTH - 1 && !((end & 1) && durations[end] > FRAME_GAP_US / 2))
+        end++;
+      frameLengths[x] = end;
+      memcpy(frameTimings[x], durations, end * sizeof(uint16_t));
+    }
+
+    // decode it once for the JSON benchmarks
+    decodeFrame(x);
+    decodedCommands[x].codeProtocol = decoder.protocolNum;
+    decodedCommands[x].codeValue = decoder.value;
+    decodedCommands[x].codeLength = decoder.bits;
+    if (decoder.protocolNum == UNKNOWN) {
+      decodedCommands[x].codeLength = frameLengths[x];
+      for (uint8_t y = 0; y < frameLengths[x]; y++)
+        decodedCommands[x].codeValueRaw.add(frameTimings[x][y]);
+    }
+    dynamote.serializeRemoteCommandToJsonString(decodedCommands[x], serializedCommands[x]);
+
+    bool matched = decoder.protocolNum == frame->codeProtocol && (frame->raw != NULL || decoder.value == frame->codeValue);
+    if (matched)
+      matchedFrames++;
+    else {
+      Serial.print("{\"warning\":\"corpus frame did not decode as expected\",\"frame\":\"");
+      Serial.print(frame->name);
+      Serial.println("\"}");
+    }
+  }
+}
+
+/******************************************************************************************************************
+* checkCoverage
+******************************************************************************************************************/
+void checkCoverage() {
+
+  // every protocol that is built in should have at least one frame in the corpus
+  for (uint8_t protocol = 1; protocol < PROTOCOL_DESCRIPTOR_COUNT; protocol++) {
+    if (!DYNAMOTE_HAS_PROTOCOL(protocol))
+      continue;
+    bool found = false;
+    for (uint8_t x = 0; x < CORPUS_LENGTH && !found; x++)
+      found = (corpus[x].codeProtocol == protocol);
+    if (!found) {
+      Serial.print("{\"warning\":\"no corpus frame\",\"protocol\":\"");
+      Serial.print(Pnames(protocol));
+      Serial.println("\"}");
+    }
+  }
+}
+
+/******************************************************************************************************************
+* checkPlainRaw
+******************************************************************************************************************/
+void checkPlainRaw() {
+
+  // the raw frames sent as a plain codeValueRaw array, the way apps saved them from older firmware, have to be
+  // accepted and come back close to the timings they were sent with
+  for (uint8_t x = 0; x < CORPUS_LENGTH; x++) {
+    if (corpus[x].raw == NULL)
+      continue;
+    StaticJsonDocument<RECV_BUF_LENGTH*10> jsonDoc;
+    jsonDoc["protocol"] = UNKNOWN;
+    jsonDoc["codeLength"] = frameLengths[x];
+    JsonArray codeValueRaw = jsonDoc.createNestedArray("codeValueRaw");
+    for (uint8_t y = 0; y < frameLengths[x]; y++)
+      codeValueRaw.add(frameTimings[x][y]);
+    QueuedCommand queuedCommand;
+    bool accepted = !dynamote.deserializeJsonObjectToRemoteCommand(jsonDoc.as<JsonObject>(), &queuedCommand);
+    RemoteCommand *command = &queuedCommand.command;
+
+    // the decoders accept 25%, stay well inside that
+    uint8_t worstPercent = 0;
+    for (uint8_t y = 0; accepted && y < frameLengths[x]; y++) {
+      uint16_t difference = abs((int)command->codeValueRaw.get(y) - (int)frameTimings[x][y]);
+      worstPercent = max(worstPercent, (uint8_t)((uint32_t)difference * 100 / frameTimings[x][y]));
+    }
+    bool passed = accepted && command->codeValueRaw.size() == frameLengths[x] && worstPercent <= 20;
+
+    char line[160];
+    snprintf(line, sizeof(line), "{\"check\":\"plainRaw\",\"frame\":\"%s\",\"timings\":%u,\"worstPercent\":%u,\"result\":\"%s\"}",
+             corpus[x].name, frameLengths[x], worstPercent, passed ? "pass" : "fail");
+    Serial.println(line);
+  }
+}
+
+/******************************************************************************************************************
+* decodeFrame
+******************************************************************************************************************/
+void decodeFrame(uint8_t index) {
+
+  // fill the decode buffer the same way the receiver would, then decode it
+  recvGlobal.decodeBuffer[0] = FRAME_GAP_US;
+  for (uint8_t x = 0; x < frameLengths[index]; x++)
+    recvGlobal.decodeBuffer[x + 1] = frameTimings[index][x];
+  recvGlobal.decodeLength = frameLengths[index] + 1;
+  decoder.decode();
+}
+
+/******************************************************************************************************************
+* benchmarkDecode
+******************************************************************************************************************/
+void benchmarkDecode() {
+
+  // same work as getReceiverInput(), decode and group the frame with the rest of the button press
+  for (uint8_t x = 0; x < CORPUS_LENGTH; x++) {
+    decodeFrame(x);
+    if (decoder.protocolNum == UNKNOWN)
+      capture.addFrame(UNKNOWN, 0, recvGlobal.decodeLength - 1, &recvGlobal.decodeBuffer[1], millis());
+    else
+      capture.addFrame(decoder.protocolNum, decoder.value, decoder.bits, NULL, millis());
+    capture.reset();
+  }
+}
+
+/******************************************************************************************************************
+* benchmarkSerialize
+******************************************************************************************************************/
+void benchmarkSerialize() {
+
+  for (uint8_t x = 0; x < CORPUS_LENGTH; x++) {
+    String jsonString;
+    dynamote.serializeRemoteCommandToJsonString(decodedCommands[x], jsonString);
+  }
+}
+
+/******************************************************************************************************************
+* benchmarkDeserialize
+******************************************************************************************************************/
+void benchmarkDeserialize() {
+
+  for (uint8_t x = 0; x < CORPUS_LENGTH; x++) {
+    StaticJsonDocument<RECV_BUF_LENGTH*10> jsonDoc;
+    deserializeJson(jsonDoc, serializedCommands[x]);
+    QueuedCommand queuedCommand;
+    dynamote.deserializeJsonObjectToRemoteCommand(jsonDoc.as<JsonObject>(), &queuedCommand);
+  }
+}
+
+/******************************************************************************************************************
+* benchmarkRawSendPrepare
+******************************************************************************************************************/
+void benchmarkRawSendPrepare() {
+
+  // build the compressed raw code, then expand it back into the timings the sender walks through
+  for (uint8_t x = 0; x < CORPUS_LENGTH; x++) {
+    if (decodedCommands[x].codeProtocol != UNKNOWN)
+      continue;
+    DynamoteLinkedList raw;
+    for (uint8_t y = 0; y < frameLengths[x]; y++)
+      raw.add(frameTimings[x][y]);
+    uint16_t timings[RECV_BUF_LENGTH];
+    raw.toArray(timings);
+  }
+}
+
+/******************************************************************************************************************
+* benchmarkEncode
+******************************************************************************************************************/
+void benchmarkEncode() {
+
+  for (uint8_t x = 0; x < CORPUS_LENGTH; x++) {
+    uint16_t durations[ENCODER_MAX_DURATIONS];
+    uint8_t khz;
+    encoder.encode(decodedCommands[x].codeProtocol, decodedCommands[x].codeValue, decodedCommands[x].codeLength, durations, &khz);
+  }
+}
+
+/******************************************************************************************************************
+* benchmarkTask
+******************************************************************************************************************/
+void benchmarkTask(void *parameter) {
+
+  void (*benchmarkFxn)(void) = (void (*)(void))parameter;
+  for (uint16_t pass = 0; pass < BENCHMARK_PASSES; pass++)
+    benchmarkFxn();
+
+#if defined(ESP32)
+  // the high water mark is in bytes on the ESP32
+  benchmarkStackBytes = BENCHMARK_STACK_SIZE - uxTaskGetStackHighWaterMark(NULL);
+  benchmarkDone = true;
+  vTaskDelete(NULL);
+#endif
+}
+
+/******************************************************************************************************************
+* runBenchmark
+******************************************************************************************************************/
+void runBenchmark(const char *name, void (*benchmarkFxn)(void)) {
+
+  uint32_t heapBefore = freeHeap();
+  uint32_t startMicros = micros();
+
+#if defined(ESP32)
+  // a fresh task per benchmark, so its stack high water mark only covers this benchmark
+  benchmarkDone = false;
+  xTaskCreatePinnedToCore(benchmarkTask, "benchmark", BENCHMARK_STACK_SIZE, (void*)benchmarkFxn, 1, NULL, xPortGetCoreID());
+  while (!benchmarkDone)
+    delay(1);
+  // the idle task frees the stack of the deleted task, give it a moment before looking at the heap
+  delay(10);
+#else
+  benchmarkTask((void*)benchmarkFxn);
+#endif
+
+  uint32_t elapsedMicros = micros() - startMicros;
+  uint32_t ops = (uint32_t)BENCHMARK_PASSES * CORPUS_LENGTH;
+
+  char line[200];
+  snprintf(line, sizeof(line), "{\"benchmark\":\"%s\",\"frames\":%u,\"ops\":%lu,\"nsPerOp\":%lu,\"stackBytes\":%ld,\"heapBytes\":%ld",
+           name, (unsigned int)CORPUS_LENGTH, (unsigned long)ops, (unsigned long)((uint64_t)elapsedMicros * 1000 / ops),
+#if defined(ESP32)
+           (long)benchmarkStackBytes,
+#else
+           -1L,
+#endif
+           (long)heapBefore - (long)freeHeap());
+  Serial.print(line);
+  if (benchmarkFxn == &benchmarkDecode) {
+    Serial.print(",\"matched\":");
+    Serial.print(matchedFrames);
+  }
+  Serial.println("}");
+}
+
+/******************************************************************************************************************
+* freeHeap
+******************************************************************************************************************/
+#if !defined(ESP32)
+extern "C" char *sbrk(int i);
+#endif
+
+uint32_t freeHeap() {
+#if defined(ESP32)
+  return ESP.getFreeHeap();
+#else
+  // the gap between the top of the heap and the stack
+  char top;
+  return &top - reinterpret_cast<char*>(sbrk(0));
+#endif
+}
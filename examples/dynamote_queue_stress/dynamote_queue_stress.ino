@@ -0,0 +1,132 @@
+/******************************************************************************************************************
+* Dynamote queue stress test
+*
+* Needs an ESP32 with DYNAMOTE_DUAL_CORE defined in Dynamote.h. The loop task and the IR task send commands at the
+* same time: the loop sends "count" and "fanout" custom commands, and the "fanout" handler, which runs on the IR
+* task, sends FANOUT_COMMANDS more "count" commands from there. Every "count" that was accepted has to be handled
+* exactly once. Prints one JSON object per round over Serial, for example:
+*   {"test":"twoTaskQueue","round":1,"sent":2400,"refused":37,"handled":2363,"result":"pass"}
+*
+* sent      "count" commands sent from both tasks
+* refused   sends that were answered with a full queue, they are not expected to be handled
+* handled   "count" commands that reached their handler
+*
+* Nothing is transmitted, custom commands never reach the emitter.
+******************************************************************************************************************/
+
+/******************************************************************************************************************
+* includes
+******************************************************************************************************************/
+#include <Dynamote.h>
+
+#if !defined(ESP32) || !defined(DYNAMOTE_DUAL_CORE)
+#error "the queue stress test needs an ESP32 and DYNAMOTE_DUAL_CORE"
+#endif
+
+// commands sent from the loop task in each round, every tenth one is a "fanout"
+#define LOOP_COMMANDS           2000
+// "count" commands sent from the IR task by each "fanout"
+#define FANOUT_COMMANDS         4
+// how long a round waits for the queue to run empty
+#define DRAIN_TIMEOUT_MS        5000
+
+/******************************************************************************************************************
+* global
+******************************************************************************************************************/
+// starts the IR task without a transport
+class StressDynamote : public Dynamote {
+  public:
+    void begin() {
+      beginIrTask();
+    }
+};
+
+StressDynamote dynamote;
+
+// written by the handlers on the IR task, read by the loop once the round is over
+volatile uint32_t handledCount = 0;
+volatile uint32_t fanoutSent = 0;
+volatile uint32_t fanoutRefused = 0;
+uint16_t roundNumber = 0;
+
+const char countCommand[] = "{\"useCustomCode\":true,\"customCode\":\"count\"}";
+const char fanoutCommand[] = "{\"useCustomCode\":true,\"customCode\":\"fanout\"}";
+
+/******************************************************************************************************************
+* setup
+******************************************************************************************************************/
+void setup() {
+
+  Serial.begin(115200);
+  while (!Serial);
+
+  dynamote.begin();
+}
+
+/******************************************************************************************************************
+* loop
+******************************************************************************************************************/
+void loop() {
+
+  handledCount = 0;
+  fanoutSent = 0;
+  fanoutRefused = 0;
+  uint32_t loopSent = 0;
+  uint32_t loopRefused = 0;
+
+  for (uint16_t x = 0; x < LOOP_COMMANDS; x++) {
+    bool fanout = (x % 10 == 0);
+    uint8_t result = fanout ? dynamote.sendJsonRemoteCommand(fanoutCommand, sizeof(fanoutCommand) - 1) :
+                              dynamote.sendJsonRemoteCommand(countCommand, sizeof(countCommand) - 1);
+    if (!fanout) {
+      loopSent++;
+      if (result != SEND_RESULT_OK)
+        loopRefused++;
+    }
+    // moves the commands sent from the IR task into the queue
+    dynamote.dynamoteLoop();
+  }
+
+  // let the queue and the hand-off from the IR task run empty
+  uint32_t startMillis = millis();
+  while (millis() - startMillis < DRAIN_TIMEOUT_MS) {
+    dynamote.dynamoteLoop();
+    delay(1);
+  }
+
+  uint32_t sent = loopSent + fanoutSent;
+  uint32_t refused = loopRefused + fanoutRefused;
+  char line[160];
+  snprintf(line, sizeof(line), "{\"test\":\"twoTaskQueue\",\"round\":%u,\"sent\":%lu,\"refused\":%lu,\"handled\":%lu,\"result\":\"%s\"}",
+           ++roundNumber, (unsigned long)sent, (unsigned long)refused, (unsigned long)handledCount,
+           (handledCount == sent - refused) ? "pass" : "fail");
+  Serial.println(line);
+}
+
+/******************************************************************************************************************
+* countHandler
+******************************************************************************************************************/
+void countHandler(RemoteCommand command) {
+  handledCount++;
+}
+
+/******************************************************************************************************************
+* fanoutHandler
+******************************************************************************************************************/
+void fanoutHandler(RemoteCommand command) {
+
+  // runs on the IR task, a second producer next to the loop
+  for (uint8_t x = 0; x < FANOUT_COMMANDS; x++) {
+    fanoutSent++;
+    if (dynamote.sendJsonRemoteCommand(countCommand, sizeof(countCommand) - 1) != SEND_RESULT_OK)
+      fanoutRefused++;
+  }
+}
+
+/******************************************************************************************************************
+* custom command handlers
+******************************************************************************************************************/
+DYNAMOTE_CUSTOM_COMMANDS(
+  CUSTOM_COMMAND("count", &countHandler)
+  CUSTOM_COMMAND("fanout", &fanoutHandler)
+)
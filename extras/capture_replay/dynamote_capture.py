@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+"""
+Dynamote capture tool
+
+Works with the capture log of a device built with DYNAMOTE_CAPTURE_LOG. The device keeps a record of every frame
+its receiver hands to the decoders: the mark and space durations, when it arrived, which decoders were tried, how
+long each one took and what came out. This tool pulls those records off the device, prints them, and plays them
+back through the device's decoders to compare the results.
+
+  fetch    reads records from GET /captures until the log is empty and appends them to a capture file:
+             python3 dynamote_capture.py fetch --host dynamote.local --output living_room.dcap --follow
+  dump     prints the records of a capture file as JSON lines, plus a summary of the decoder timings:
+             python3 dynamote_capture.py dump living_room.dcap --summary
+  replay   sends every frame of a capture file back to the device as a replay command, and reports whether the
+           decoders still agree with the original capture and how their timings changed:
+             python3 dynamote_capture.py replay living_room.dcap --host dynamote.local
+
+A capture file is the records exactly as the device wrote them, one after the other, see DynamoteCaptureLog.h for
+the layout. Replays are paced below the device's rate limit, and are recorded in the log with the replay flag, so
+they can be told apart from frames that came in over the air while the replay ran.
+"""
+
+import argparse
+import http.client
+import json
+import struct
+import sys
+import time
+
+RECORD_MAGIC = 0xCA
+FLAG_REPLAY = 0x01
+HEADER = struct.Struct("<BBIBBIHBB")
+PROBE = struct.Struct("<BH")
+
+# IRLib2 protocol numbers
+PROTOCOLS = ["UNKNOWN", "NEC", "SONY", "RC5", "RC6", "PANASONIC_OLD", "JVC", "NECX", "SAMSUNG36", "GICABLE",
+             "DIRECTV", "RCMM", "CYKM"]
+
+
+def protocol_name(number):
+    return PROTOCOLS[number] if number < len(PROTOCOLS) else str(number)
+
+
+def parse_records(data):
+    """Splits a byte string into records, stops at the first byte that is not the start of a record."""
+    records = []
+    offset = 0
+    while offset + HEADER.size <= len(data):
+        magic, flags, timestamp, protocol, bits, value, decode_micros, probe_count, edge_count = \
+            HEADER.unpack_from(data, offset)
+        length = HEADER.size + probe_count * PROBE.size + edge_count * 2
+        if magic != RECORD_MAGIC or offset + length > len(data):
+            print("warning, %d bytes at offset %d are not a record" % (len(data) - offset, offset), file=sys.stderr)
+            break
+        position = offset + HEADER.size
+        probes = []
+        for _ in range(probe_count):
+            probe_protocol, micros = PROBE.unpack_from(data, position)
+            probes.append({"protocol": protocol_name(probe_protocol), "micros": micros})
+            position += PROBE.size
+        edges = list(struct.unpack_from("<%dH" % edge_count, data, position))
+        records.append({
+            "timestamp": timestamp,
+            "replay": bool(flags & FLAG_REPLAY),
+            "protocol": protocol_name(protocol),
+            "protocolNumber": protocol,
+            "bits": bits,
+            "value": value,
+            "decodeMicros": decode_micros,
+            "probes": probes,
+            "edges": edges,
+        })
+        offset += length
+    return records
+
+
+def request(host, port, method, path, body=None):
+    """One request per connection, like the Dynamote app. Returns (status, body)."""
+    connection = http.client.HTTPConnection(host, port, timeout=5)
+    try:
+        data = json.dumps(body, separators=(",", ":")) if body is not None else None
+        connection.request(method, path, body=data, headers={"Connection": "close"})
+        response = connection.getresponse()
+        return response.status, response.read()
+    finally:
+        connection.close()
+
+
+def fetch_once(host, port):
+    """The next batch of records and the device's view of the log, {"captures":"..","dropped":n,"more":bool}."""
+    status, body = request(host, port, "GET", "/captures")
+    if status != 200:
+        raise RuntimeError("GET /captures answered %d" % status)
+    # the body can carry other lines before the captures document, a recorded command for example
+    for line in body.decode(errors="replace").splitlines():
+        if line.startswith('{"captures"'):
+            return json.loads(line)
+    raise RuntimeError("no captures in the response, is the device built with DYNAMOTE_CAPTURE_LOG?")
+
+
+def drain(host, port):
+    """Reads the log until the device says there is nothing more. Returns (bytes, dropped count)."""
+    data = b""
+    while True:
+        batch = fetch_once(host, port)
+        data += bytes.fromhex(batch["captures"])
+        if not batch["more"]:
+            return data, batch["dropped"]
+
+
+def fetch(args):
+    total = 0
+    dropped = 0
+    with open(args.output, "ab") as output:
+        while True:
+            data, dropped = drain(args.host, args.port)
+            output.write(data)
+            output.flush()
+            count = len(parse_records(data))
+            total += count
+            if count:
+                print("%d records, %d in total, %d dropped by the device" % (count, total, dropped), file=sys.stderr)
+            if not args.follow:
+                break
+            time.sleep(args.interval)
+    return 0
+
+
+def percentile(samples, p):
+    if not samples:
+        return None
+    samples = sorted(samples)
+    return samples[min(len(samples) - 1, int(round(p / 100 * (len(samples) - 1))))]
+
+
+def timing_summary(records):
+    """Decode time per decoded protocol, and the time each decoder spends on frames, matched or not."""
+    decoded = {}
+    probes = {}
+    for record in records:
+        decoded.setdefault(record["protocol"], []).append(record["decodeMicros"])
+        for probe in record["probes"]:
+            probes.setdefault(probe["protocol"], []).append(probe["micros"])
+
+    def stats(samples):
+        return {"count": len(samples), "p50": percentile(samples, 50), "p90": percentile(samples, 90),
+                "max": max(samples)}
+    return {
+        "decodeMicrosByResult": {name: stats(samples) for name, samples in sorted(decoded.items())},
+        "probeMicrosByDecoder": {name: stats(samples) for name, samples in sorted(probes.items())},
+    }
+
+
+def read_capture_file(path):
+    with open(path, "rb") if path != "-" else sys.stdin.buffer as capture:
+        data = capture.read()
+    # a capture pasted from a WebSocket or MQTT message is hex
+    try:
+        data = bytes.fromhex(data.decode().strip())
+    except ValueError:
+        pass
+    return parse_records(data)
+
+
+def dump(args):
+    records = read_capture_file(args.file)
+    # micros() wraps after about 71 minutes, times are given relative to the first record
+    first = records[0]["timestamp"] if records else 0
+    elapsed = 0
+    previous = first
+    for record in records:
+        elapsed += (record["timestamp"] - previous) & 0xFFFFFFFF
+        previous = record["timestamp"]
+        line = dict(record, ms=round(elapsed / 1000, 3))
+        if not args.edges:
+            line["edges"] = len(record["edges"])
+        print(json.dumps(line, separators=(",", ":")))
+    if args.summary:
+        print(json.dumps(dict(timing_summary(records), records=len(records)), indent=2))
+    return 0
+
+
+def replay(args):
+    originals = [record for record in read_capture_file(args.file) if not record["replay"] and record["edges"]]
+    # anything already in the log belongs to someone else, read it out of the way first
+    drain(args.host, args.port)
+
+    frames = []
+    replayed = []
+    for index, original in enumerate(originals):
+        command = {"protocol": 0, "codeLength": len(original["edges"]), "codeValueRaw": original["edges"],
+                   "replay": True}
+        started = time.monotonic()
+        while True:
+            status, _ = request(args.host, args.port, "POST", "/sendRemoteCommand", command)
+            if status not in (429, 503):
+                break
+            # over the rate limit or our share of the queue, or the previous replay has not been sent yet, back off
+            # and try again
+            time.sleep(1 / args.rate)
+        if status != 200:
+            raise RuntimeError("POST /sendRemoteCommand answered %d" % status)
+
+        result = None
+        deadline = time.monotonic() + args.timeout
+        while result is None and time.monotonic() < deadline:
+            data, _ = drain(args.host, args.port)
+            for record in parse_records(data):
+                if record["replay"] and result is None:
+                    result = record
+        frame = {
+            "index": index,
+            "original": {key: original[key] for key in ("protocol", "bits", "value", "decodeMicros")},
+            "replayed": {key: result[key] for key in ("protocol", "bits", "value", "decodeMicros")} if result else None,
+        }
+        frame["match"] = frame["replayed"] is not None and all(
+            frame["original"][key] == frame["replayed"][key] for key in ("protocol", "bits", "value"))
+        frames.append(frame)
+        if result:
+            replayed.append(result)
+        if not frame["match"] or args.verbose:
+            print(json.dumps(frame, separators=(",", ":")), file=sys.stderr)
+        time.sleep(max(0, 1 / args.rate - (time.monotonic() - started)))
+
+    report = {
+        "frames": len(frames),
+        "matched": sum(1 for frame in frames if frame["match"]),
+        "mismatched": [frame["index"] for frame in frames if frame["replayed"] and not frame["match"]],
+        "missing": [frame["index"] for frame in frames if not frame["replayed"]],
+        "original": timing_summary(originals),
+        "replayed": timing_summary(replayed),
+    }
+    print(json.dumps(report, indent=2))
+    return 0 if report["matched"] == len(frames) else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    modes = parser.add_subparsers(dest="mode", required=True)
+
+    fetcher = modes.add_parser("fetch")
+    fetcher.add_argument("--host", required=True)
+    fetcher.add_argument("--port", type=int, default=80)
+    fetcher.add_argument("--output", required=True, help="capture file, records are appended")
+    fetcher.add_argument("--follow", action="store_true", help="keep reading until interrupted")
+    fetcher.add_argument("--interval", type=float, default=1.0, help="seconds between reads with --follow")
+
+    dumper = modes.add_parser("dump")
+    dumper.add_argument("file", help="capture file, raw or hex, - for stdin")
+    dumper.add_argument("--edges", action="store_true", help="print the durations instead of their count")
+    dumper.add_argument("--summary", action="store_true", help="print decoder timing percentiles at the end")
+
+    replayer = modes.add_parser("replay")
+    replayer.add_argument("file", help="capture file, raw or hex, - for stdin")
+    replayer.add_argument("--host", required=True)
+    replayer.add_argument("--port", type=int, default=80)
+    replayer.add_argument("--rate", type=float, default=5, help="frames per second, below the device's rate limit")
+    replayer.add_argument("--timeout", type=float, default=2.0, help="seconds to wait for each replayed record")
+    replayer.add_argument("--verbose", action="store_true", help="print every frame, not only mismatches")
+
+    args = parser.parse_args()
+    try:
+        sys.exit({"fetch": fetch, "dump": dump, "replay": replay}[args.mode](args))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""
+Dynamote group send
+
+Sends one command to every Dynamote device in a group with a single UDP multicast datagram, and collects the
+acknowledgment of each member into one result. Devices join groups in their sketch with dynamote.joinGroup().
+
+  send     one command to a group, retransmitted with the same sequence number to members that have not answered:
+             python3 dynamote_group.py send --group downstairs --expect 3 --command '{"protocol":1,...}'
+  device   a stand-in for a device on this computer, it joins the given groups and acknowledges like the firmware:
+             python3 dynamote_group.py device --group downstairs --interface 127.0.0.1
+
+The two can be tried together on one Linux host over loopback multicast, start a few devices with
+--interface 127.0.0.1 and then send with --interface 127.0.0.1. Without --command the NEC power code is sent. The
+result is printed as JSON, with the result of every member that answered (0 queued, 1 parse error, 2 queue full,
+3 rate limited).
+"""
+
+import argparse
+import json
+import random
+import socket
+import struct
+import sys
+import time
+
+MULTICAST_ADDRESS = "239.255.68.77"
+MULTICAST_PORT = 5690
+GROUP_ALL = "all"
+DEDUP_ENTRIES = 8
+
+NEC_COMMAND = {"protocol": 1, "codeValue": 551489775, "codeLength": 32}
+
+
+def multicast_socket(interface, ttl):
+    """A socket for sending to the group and receiving the unicast acknowledgments."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, ttl)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+    if interface:
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(interface))
+    sock.bind(("", 0))
+    return sock
+
+
+def send(args):
+    command = json.loads(args.command) if args.command else NEC_COMMAND
+    if isinstance(command, list):
+        command = {"commands": command}
+    sequence = args.seq if args.seq is not None else random.randrange(65536)
+    datagram = dict(command, seq=sequence, ack=True)
+    if args.group != GROUP_ALL:
+        datagram["group"] = args.group
+    data = json.dumps(datagram, separators=(",", ":")).encode()
+
+    sock = multicast_socket(args.interface, args.ttl)
+    acks = {}
+    started = time.monotonic()
+    attempts = 0
+    while attempts <= args.retries:
+        # the same sequence number every time, members that already queued it only acknowledge again
+        sock.sendto(data, (args.address, args.port))
+        attempts += 1
+        deadline = time.monotonic() + args.timeout
+        while time.monotonic() < deadline and (args.expect == 0 or len(acks) < args.expect):
+            sock.settimeout(max(0.001, deadline - time.monotonic()))
+            try:
+                reply, address = sock.recvfrom(1024)
+            except socket.timeout:
+                break
+            try:
+                ack = json.loads(reply)
+            except ValueError:
+                continue
+            if ack.get("seq") != sequence:
+                continue
+            member = "%s:%d" % address
+            if member not in acks:
+                acks[member] = {"result": ack.get("result"), "ms": round((time.monotonic() - started) * 1000, 1)}
+        if args.expect and len(acks) >= args.expect:
+            break
+        if not args.expect:
+            # nothing to wait for, a single round tells who is there
+            break
+
+    queued = sum(1 for ack in acks.values() if ack["result"] == 0)
+    report = {
+        "group": args.group,
+        "seq": sequence,
+        "attempts": attempts,
+        "members": len(acks),
+        "queued": queued,
+        "failed": len(acks) - queued,
+        "missing": max(0, args.expect - len(acks)) if args.expect else None,
+        "acks": acks,
+    }
+    print(json.dumps(report, indent=2))
+    complete = (not args.expect or len(acks) >= args.expect) and queued == len(acks)
+    return 0 if complete else 1
+
+
+def fnv1a(name):
+    """The group hash used in binary datagrams, dynamoteHash() on the device."""
+    hash_value = 2166136261
+    for byte in name.encode():
+        hash_value = ((hash_value ^ byte) * 16777619) & 0xFFFFFFFF
+    return hash_value
+
+
+def device(args):
+    groups = set(args.group) | {GROUP_ALL}
+    group_hashes = {fnv1a(name) for name in groups}
+
+    listener = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if hasattr(socket, "SO_REUSEPORT"):
+        listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+    listener.bind(("", args.port))
+    membership = struct.pack("4s4s", socket.inet_aton(args.address), socket.inet_aton(args.interface or "0.0.0.0"))
+    listener.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+
+    # acknowledgments leave from a socket of their own, like the device's unicast port
+    replier = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    replier.bind((args.interface or "", 0))
+    print("device %s:%d in groups %s" % (replier.getsockname() + (", ".join(sorted(groups)),)), file=sys.stderr)
+
+    recent = []
+    while True:
+        data, address = listener.recvfrom(2048)
+        if data[:1] == b"\xd7":
+            if len(data) < 5:
+                continue
+            flags, sequence = data[1], data[2] | (data[3] << 8)
+            if flags & 0x10:
+                if len(data) < 9:
+                    continue
+                group = struct.unpack("<I", data[5:9])[0]
+            else:
+                group = fnv1a(GROUP_ALL)
+            if group not in group_hashes:
+                continue
+            ack_requested = bool(flags & 0x01)
+            command = data.hex()
+        else:
+            try:
+                command = json.loads(data)
+            except ValueError:
+                continue
+            group = fnv1a(command.get("group", GROUP_ALL)) if isinstance(command, dict) else fnv1a(GROUP_ALL)
+            if group not in group_hashes or not isinstance(command, dict) or "seq" not in command:
+                continue
+            sequence = command["seq"]
+            ack_requested = command.get("ack", False)
+
+        # the same as the firmware, a retransmission is recognized by sender, group and sequence number
+        if (address, group, sequence) in recent:
+            print("duplicate %d from %s:%d" % ((sequence,) + address), file=sys.stderr)
+        else:
+            recent = (recent + [(address, group, sequence)])[-DEDUP_ENTRIES:]
+            print("queued %d from %s:%d %s" % ((sequence,) + address + (command,)), file=sys.stderr)
+        if ack_requested:
+            if data[:1] == b"\xd7":
+                reply = bytes([0xD7, 0x02, sequence & 0xFF, sequence >> 8, args.result])
+            else:
+                reply = json.dumps({"seq": sequence, "result": args.result}, separators=(",", ":")).encode()
+            replier.sendto(reply, address)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--address", default=MULTICAST_ADDRESS, help="multicast group address")
+    parser.add_argument("--port", type=int, default=MULTICAST_PORT)
+    parser.add_argument("--interface", help="address of the interface to use, 127.0.0.1 for loopback")
+    modes = parser.add_subparsers(dest="mode", required=True)
+
+    sender = modes.add_parser("send")
+    sender.add_argument("--group", default=GROUP_ALL, help="group name, every device is in '%s'" % GROUP_ALL)
+    sender.add_argument("--command", help="JSON command or list of commands")
+    sender.add_argument("--seq", type=int, help="sequence number, random by default")
+    sender.add_argument("--expect", type=int, default=0, help="number of members, retransmit until all answered")
+    sender.add_argument("--retries", type=int, default=2, help="retransmissions to members that did not answer")
+    sender.add_argument("--timeout", type=float, default=0.3, help="seconds to wait for acknowledgments per try")
+    sender.add_argument("--ttl", type=int, default=1, help="multicast TTL, 1 stays on the local network")
+
+    member = modes.add_parser("device")
+    member.add_argument("--group", action="append", default=[], help="group to join, may be repeated")
+    member.add_argument("--result", type=int, default=0, help="result to acknowledge with")
+
+    args = parser.parse_args()
+    if args.mode == "send":
+        sys.exit(send(args))
+    try:
+        device(args)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+"""
+Dynamote load generator
+
+Drives a Dynamote device with a mix of requests from several concurrent clients and reports throughput, latency
+percentiles and error rates as JSON. Run it from a computer on the same network as the device.
+
+  HTTP   many apps hitting the DynamoteWiFi server:
+           python3 dynamote_load.py http --host dynamote.local --clients 8 --duration 30
+  UDP    a hub sending JSON datagrams to the UDP endpoint, waiting for each acknowledgment:
+           python3 dynamote_load.py udp --host dynamote.local --clients 8
+  BLE    an app writing chunked commands to DynamoteBLE (needs bleak):
+           python3 dynamote_load.py ble --address AA:BB:CC:DD:EE:FF --chunk-size 20
+
+There is no MQTT mode. The firmware only takes MQTT commands from Cloud IoT Core, over TLS with a JWT signed by the
+device key, so a plain broker never reaches it. Load the device over HTTP, UDP or BLE instead.
+
+Every mode drives a real device, BLE through a real adapter. The library has no host build, so there is no
+simulated BLE characteristic channel to run against.
+
+The payload mix is given as name=weight pairs, for example --mix send=8,batch=1,record=1. When --metrics-host is
+given, the device's own /metrics document is fetched at the end and added to the report, so client side and device
+side latencies can be compared.
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import sys
+import time
+
+SEND_CHARACTERISTIC_UUID = "5e4d2bf6-29ec-4a1b-8649-259568488e7b"
+RECORD_ENABLE_CHARACTERISTIC_UUID = "37141628-d6d9-45bd-af90-e297a92b6953"
+
+NEC_COMMAND = {"protocol": 1, "codeValue": 551489775, "codeLength": 32}
+SONY_COMMAND = {"protocol": 2, "codeValue": 2704, "codeLength": 12}
+RAW_COMMAND = {"protocol": 0, "codeValue": 0, "codeLength": 19,
+               "codeValueRaw": [2650, 880, 470, 420, 460, 430, 470, 880, 910, 430, 460, 450, 450, 440, 470, 880,
+                                470, 420, 900]}
+
+# payloads by name, each one is (http path, json body or None)
+PAYLOADS = {
+    "send": ("sendRemoteCommand", NEC_COMMAND),
+    "sony": ("sendRemoteCommand", SONY_COMMAND),
+    "raw": ("sendRemoteCommand", RAW_COMMAND),
+    "batch": ("sendRemoteCommand", [NEC_COMMAND, dict(SONY_COMMAND, delay=50), dict(NEC_COMMAND, delay=50)]),
+    "record": ("getRecordedCommand", None),
+    "metrics": ("metrics", None),
+}
+
+
+class Results:
+    """Latencies and errors per payload name."""
+
+    def __init__(self):
+        self.latencies = {}
+        self.errors = {}
+
+    def add(self, name, seconds):
+        self.latencies.setdefault(name, []).append(seconds)
+
+    def error(self, name, reason):
+        self.errors.setdefault(name, {})
+        self.errors[name][reason] = self.errors[name].get(reason, 0) + 1
+
+    def report(self, elapsed):
+        report = {"elapsedSeconds": round(elapsed, 3), "payloads": {}}
+        total = 0
+        for name in sorted(set(self.latencies) | set(self.errors)):
+            samples = sorted(self.latencies.get(name, []))
+            errors = sum(self.errors.get(name, {}).values())
+            attempts = len(samples) + errors
+            total += len(samples)
+            report["payloads"][name] = {
+                "ok": len(samples),
+                "errors": errors,
+                "errorRate": round(errors / attempts, 4) if attempts else 0,
+                "errorReasons": self.errors.get(name, {}),
+                "throughputPerSecond": round(len(samples) / elapsed, 2) if elapsed else 0,
+                "latencyMs": {
+                    "p50": percentile(samples, 50),
+                    "p90": percentile(samples, 90),
+                    "p99": percentile(samples, 99),
+                    "max": round(samples[-1] * 1000, 2) if samples else None,
+                },
+            }
+        report["throughputPerSecond"] = round(total / elapsed, 2) if elapsed else 0
+        return report
+
+
+def percentile(sorted_samples, percent):
+    if not sorted_samples:
+        return None
+    # nearest rank, the same definition the device uses for its own metrics
+    rank = max(1, -(-len(sorted_samples) * percent // 100))
+    return round(sorted_samples[int(rank) - 1] * 1000, 2)
+
+
+def parse_mix(mix):
+    names, weights = [], []
+    for entry in mix.split(","):
+        name, _, weight = entry.partition("=")
+        if name not in PAYLOADS:
+            sys.exit("unknown payload '%s', choose from %s" % (name, ", ".join(PAYLOADS)))
+        names.append(name)
+        weights.append(float(weight or 1))
+    return names, weights
+
+
+async def run_clients(args, request):
+    """Runs args.clients concurrent clients, each sending requests back to back (or at --rate per client)."""
+    names, weights = parse_mix(args.mix)
+    results = Results()
+    deadline = time.monotonic() + args.duration
+
+    async def client():
+        while time.monotonic() < deadline:
+            name = random.choices(names, weights)[0]
+            started = time.monotonic()
+            try:
+                await asyncio.wait_for(request(name), args.timeout)
+                results.add(name, time.monotonic() - started)
+            except asyncio.TimeoutError:
+                results.error(name, "timeout")
+            except Exception as error:                      # report it, keep the load going
+                results.error(name, type(error).__name__ + ": " + str(error)[:60])
+            if args.rate:
+                await asyncio.sleep(max(0, 1 / args.rate - (time.monotonic() - started)))
+
+    started = time.monotonic()
+    await asyncio.gather(*(client() for _ in range(args.clients)))
+    return results.report(time.monotonic() - started)
+
+
+async def http_request(host, port, path, body):
+    """One request per connection, like the Dynamote app."""
+    reader, writer = await asyncio.open_connection(host, port)
+    try:
+        data = json.dumps(body, separators=(",", ":")) if body is not None else ""
+        method = "POST" if body is not None else "GET"
+        request = "%s /%s HTTP/1.1\r\nHost: %s\r\nContent-Length: %d\r\nConnection: close\r\n\r\n%s" % (
+            method, path, host, len(data), data)
+        # a single write, the device reads the body as soon as it sees the blank line
+        writer.write(request.encode())
+        await writer.drain()
+        response = await reader.read()
+    finally:
+        writer.close()
+    status = response.split(b"\r\n", 1)[0]
+    if b" 200" not in status:
+        raise RuntimeError(status.decode(errors="replace") or "no response")
+    return response.split(b"\r\n\r\n", 1)[-1]
+
+
+async def run_http(args):
+    async def request(name):
+        path, body = PAYLOADS[name]
+        await http_request(args.host, args.port, path, body)
+    return await run_clients(args, request)
+
+
+async def run_udp(args):
+    loop = asyncio.get_running_loop()
+
+    class Endpoint(asyncio.DatagramProtocol):
+        def __init__(self):
+            self.pending = None
+
+        def datagram_received(self, data, address):
+            if self.pending is not None and not self.pending.done():
+                self.pending.set_result(json.loads(data))
+
+    async def request(name):
+        path, body = PAYLOADS[name]
+        if path != "sendRemoteCommand":
+            raise RuntimeError("not available over UDP")
+        if isinstance(body, list):
+            body = {"commands": body}
+        # one socket per request, so concurrent clients never see each other's acknowledgments
+        transport, endpoint = await loop.create_datagram_endpoint(Endpoint, remote_addr=(args.host, args.port))
+        try:
+            endpoint.pending = loop.create_future()
+            sequence = random.randrange(65536)
+            transport.sendto(json.dumps(dict(body, seq=sequence, ack=True), separators=(",", ":")).encode())
+            ack = await endpoint.pending
+        finally:
+            transport.close()
+        if ack.get("seq") != sequence or ack.get("result") != 0:
+            raise RuntimeError("result %s" % ack.get("result"))
+
+    return await run_clients(args, request)
+
+
+async def run_ble(args):
+    try:
+        from bleak import BleakClient
+    except ImportError:
+        sys.exit("the ble transport needs bleak: pip install bleak")
+
+    # one connection can only carry one command at a time, the chunks of two commands would mix
+    args.clients = 1
+    async with BleakClient(args.address) as client:
+        async def request(name):
+            path, body = PAYLOADS[name]
+            if path == "getRecordedCommand":
+                await client.write_gatt_char(RECORD_ENABLE_CHARACTERISTIC_UUID, bytes([1]), response=True)
+                return
+            if path != "sendRemoteCommand":
+                raise RuntimeError("not available over BLE")
+            data = json.dumps(body, separators=(",", ":")).encode()
+            for index in range(0, len(data), args.chunk_size):
+                await client.write_gatt_char(SEND_CHARACTERISTIC_UUID, data[index:index + args.chunk_size],
+                                             response=True)
+        return await run_clients(args, request)
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--clients", type=int, default=4, help="concurrent clients")
+    parser.add_argument("--duration", type=float, default=10, help="seconds to run for")
+    parser.add_argument("--rate", type=float, default=0, help="requests per second per client, 0 for back to back")
+    parser.add_argument("--timeout", type=float, default=5, help="seconds before a request counts as failed")
+    parser.add_argument("--mix", default="send=1", help="payload weights, from: " + ", ".join(PAYLOADS))
+    parser.add_argument("--metrics-host", help="fetch the device metrics over HTTP from this host at the end")
+    parser.add_argument("--output", help="write the report to this file instead of stdout")
+    transports = parser.add_subparsers(dest="transport", required=True)
+
+    http = transports.add_parser("http")
+    http.add_argument("--host", required=True)
+    http.add_argument("--port", type=int, default=80)
+
+    udp = transports.add_parser("udp")
+    udp.add_argument("--host", required=True)
+    udp.add_argument("--port", type=int, default=5683)
+
+    ble = transports.add_parser("ble")
+    ble.add_argument("--address", required=True)
+    ble.add_argument("--chunk-size", type=int, default=20, help="bytes per characteristic write (MTU - 3)")
+
+    args = parser.parse_args()
+    runner = {"http": run_http, "udp": run_udp, "ble": run_ble}[args.transport]
+    report = await runner(args)
+    report["transport"] = args.transport
+    report["clients"] = args.clients
+    report["mix"] = args.mix
+
+    if args.metrics_host:
+        try:
+            body = await asyncio.wait_for(http_request(args.metrics_host, 80, "metrics", None), args.timeout)
+            report["deviceMetrics"] = json.loads(body.strip().splitlines()[-1])
+        except Exception as error:
+            report["deviceMetrics"] = {"error": str(error)}
+
+    text = json.dumps(report, indent=2)
+    if args.output:
+        with open(args.output, "w") as output:
+            output.write(text + "\n")
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
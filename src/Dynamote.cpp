@@ -16,38 +16,303 @@
 
 #include "Dynamote.h"
 
+// a full batch has to fit in one burst, or it could never be queued
+static_assert(ADMISSION_BURST >= COMMAND_QUEUE_LENGTH, "ADMISSION_BURST must be at least COMMAND_QUEUE_LENGTH");
+static_assert(ADMISSION_RESERVED_SLOTS < COMMAND_QUEUE_LENGTH, "ADMISSION_RESERVED_SLOTS must leave room for a client");
+// processCommandQueue() keeps a bit per client number
+static_assert(ADMISSION_MAX_CLIENTS < 16, "ADMISSION_MAX_CLIENTS must be less than 16");
+
+// used when the sketch has no DYNAMOTE_CUSTOM_COMMANDS()
+__attribute__((weak)) bool dynamoteCustomCommandTable = false;
+
+__attribute__((weak)) CustomCommandHandler dynamoteCustomCommandHandler(const char *customCode, uint8_t length, uint32_t hash)
+{
+	return NULL;
+}
+
 /******************************************************************************************************************
 * Dynamote constructor
 ******************************************************************************************************************/
-Dynamote::Dynamote(void) : remoteReceiver(RECEIVER_PIN) {}
+Dynamote::Dynamote(void) : recordTimeoutTimer(&Dynamote::onRecordTimeout, this), remoteReceiver(RECEIVER_PIN) {}
 
 /******************************************************************************************************************
 * dynamoteLoop
 ******************************************************************************************************************/
 RemoteCommand Dynamote::dynamoteLoop(void)
 {
-	RemoteCommand recordedCommand = RemoteCommand();
-	if (remoteState == RECORD){
-			recordedCommand = getReceiverInput();
+	// write out any pending log messages, without blocking
+	dynamoteLog.drain();
+
+	// run the protocol timeouts that have come due
+	dynamoteTimerWheel.advance(millis());
+
+#if defined(DYNAMOTE_DUAL_CORE)
+	// queue what the custom command handlers sent from the IR task
+	takeHandedOffCommands();
+#else
+	// with DYNAMOTE_DUAL_CORE this runs in the IR task instead
+	{
+		DynamoteMemoryProbe memoryProbe(MEMORY_IR);
+		irLoop();
 	}
+#endif
 
-	// If we do not receive the next command within several seconds, we will go back to SEND state
-	if (remoteRecordRequestTime != 0 && remoteRecordRequestTime + 5000 < millis()) {
-		remoteRecordRequestTime = 0;
-		if (remoteState != SEND)
-			setRemoteState(SEND);
+	// pick up the next recorded command, if there is one, and keep it for the record sessions
+	RemoteCommand recordedCommand = RemoteCommand();
+	RemoteCommand *capturedCommand = captureQueue.peek();
+	if (capturedCommand != NULL) {
+		recordedCommand = *capturedCommand;
+		captureQueue.pop();
+		recordHistory[recordSessions.publish() % RECORD_HISTORY_LENGTH] = recordedCommand;
 	}
 
 	return recordedCommand;
 }
 
+/******************************************************************************************************************
+* irLoop
+******************************************************************************************************************/
+void Dynamote::irLoop(void)
+{
+	// apply record enable/disable requests. A press that is being captured is finished first, so a session that
+	// times out (and is opened again) in the middle of it does not throw it away
+	RemoteState requestedState = requestedRemoteState;
+	if (requestedState != remoteState && !(requestedState == SEND && remoteCapture.isCapturing()))
+		applyRemoteState(requestedState);
+
+	// send any queued commands whose delay has passed
+	processCommandQueue();
+
+	// then the repeat frames of a held button
+	processHold();
+
+	if (remoteState != RECORD)
+		return;
+
+	getReceiverInput();
+
+	// only pass up one cleaned command per button press, once the press is over
+	uint16_t raw[RECV_BUF_LENGTH];
+	RemoteCommand recordedCommand = RemoteCommand();
+	if (remoteCapture.getCommand(&recordedCommand.codeProtocol, &recordedCommand.codeValue, &recordedCommand.codeLength, raw, &recordedCommand.confidence, millis())) {
+		if (recordedCommand.codeProtocol == UNKNOWN) {
+			// recorded timings jitter anyway, so close ones share a dictionary entry
+			recordedCommand.codeValueRaw.clear();
+			bool exact = true;
+			for (uint8_t x = 0; x < recordedCommand.codeLength; x++)
+				exact &= recordedCommand.codeValueRaw.add(raw[x], true);
+			if (!exact)
+				DYNAMOTE_LOG_WARNING("Warning, recorded raw code has more than %u distinct durations, some were rounded", DICTIONARY_SIZE);
+		}
+		dynamoteMetrics.count(COUNTER_COMMANDS_RECORDED);
+		DYNAMOTE_LOG_INFO("Recorded %s Value:0x%lX confidence:%u%%", (const char*)Pnames(recordedCommand.codeProtocol), (unsigned long)recordedCommand.codeValue, recordedCommand.confidence);
+		if (!captureQueue.push(recordedCommand))
+			dynamoteMetrics.drop(DROP_CAPTURE_QUEUE_FULL);
+		wakeLoop();
+	}
+}
+
+/******************************************************************************************************************
+* beginZones
+******************************************************************************************************************/
+void Dynamote::beginZones(void)
+{
+#if defined(IR_ZONE_PINS)
+	static_assert(IR_ZONE_COUNT <= 8, "IR_ZONE_PINS supports at most 7 extra zones");
+	// zone 1 uses RMT channel 0 and so on
+	for (uint8_t zone = 1; zone < IR_ZONE_COUNT; zone++)
+		zoneEmitters[zone - 1].begin(irZonePins[zone - 1], zone - 1);
+#endif
+}
+
+/******************************************************************************************************************
+* idle
+******************************************************************************************************************/
+void Dynamote::idle(void)
+{
+	// sleep until the next timer is due, but never longer than the transport allows
+	uint32_t sleepMs = min(dynamoteTimerWheel.millisUntilNextTimer(millis()), idleMaxSleepMs);
+#if !defined(DYNAMOTE_DUAL_CORE)
+	// the receiver and the command queue delays are polled from the loop
+	if (remoteState == RECORD || !commandQueue.isEmpty())
+		sleepMs = min(sleepMs, (uint32_t)IDLE_POLL_MS);
+	// and so are the repeat frames of a held button, wake up in time for the next one
+	if (holding) {
+		uint32_t sinceLastFrame = millis() - holdLastFrameTime;
+		sleepMs = min(sleepMs, (sinceLastFrame < holdPeriodMs) ? holdPeriodMs - sinceLastFrame : (uint32_t)0);
+	}
+#endif
+
+#if defined(ESP32)
+	// wakeLoop() ends the sleep early
+	loopTaskHandle = xTaskGetCurrentTaskHandle();
+	ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleepMs));
+#else
+	delay(sleepMs);
+#endif
+}
+
+/******************************************************************************************************************
+* wakeLoop
+******************************************************************************************************************/
+void Dynamote::wakeLoop(void)
+{
+#if defined(ESP32)
+	// safe to call from callbacks and the IR task
+	if (loopTaskHandle != NULL)
+		xTaskNotifyGive(loopTaskHandle);
+#endif
+}
+
+/******************************************************************************************************************
+* onRecordTimeout
+******************************************************************************************************************/
+void Dynamote::onRecordTimeout(void *argument)
+{
+	// the polled sessions without a new record request within RECORD_TIMEOUT_MS are closed
+	((Dynamote*)argument)->updateRecordSessions();
+}
+
+/******************************************************************************************************************
+* openRecordSession
+******************************************************************************************************************/
+uint8_t Dynamote::openRecordSession(uint32_t owner, uint32_t timeoutMs)
+{
+	uint8_t id = recordSessions.open(owner, timeoutMs, millis());
+	updateRecordSessions();
+	return id;
+}
+
+/******************************************************************************************************************
+* closeRecordSession
+******************************************************************************************************************/
+void Dynamote::closeRecordSession(uint32_t owner)
+{
+	if (recordSessions.close(owner))
+		updateRecordSessions();
+}
+
+/******************************************************************************************************************
+* takeRecordedCommand
+******************************************************************************************************************/
+bool Dynamote::takeRecordedCommand(uint32_t owner, RemoteCommand &command)
+{
+	uint16_t sequence;
+	if (!recordSessions.next(owner, &sequence))
+		return false;
+	command = recordHistory[sequence % RECORD_HISTORY_LENGTH];
+	return true;
+}
+
+/******************************************************************************************************************
+* updateRecordSessions
+******************************************************************************************************************/
+void Dynamote::updateRecordSessions(void)
+{
+	// one timer for all sessions, due when the first deadline is
+	uint32_t untilNextDeadline = recordSessions.expire(millis());
+	if (untilNextDeadline == TIMER_NONE)
+		dynamoteTimerWheel.cancel(&recordTimeoutTimer);
+	else
+		dynamoteTimerWheel.schedule(&recordTimeoutTimer, untilNextDeadline);
+
+	setRemoteState(recordSessions.isEmpty() ? SEND : RECORD);
+	dynamoteStatus.invalidate();
+}
+
+/******************************************************************************************************************
+* addStatusToJson
+******************************************************************************************************************/
+void Dynamote::addStatusToJson(JsonObject status)
+{
+	status["firmware"] = DYNAMOTE_VERSION;
+#if defined(ESP32)
+	status["board"] = "esp32";
+#else
+	status["board"] = "samd21";
+#endif
+
+	// the protocols built in with DYNAMOTE_PROTOCOLS, raw codes always work
+	JsonArray protocols = status.createNestedArray("protocols");
+	for (uint8_t protocol = 1; protocol < PROTOCOL_DESCRIPTOR_COUNT; protocol++) {
+		if (DYNAMOTE_HAS_PROTOCOL(protocol))
+			protocols.add((const char*)Pnames(protocol));
+	}
+
+	JsonArray features = status.createNestedArray("features");
+#if defined(DYNAMOTE_DUAL_CORE)
+	features.add("dualCore");
+#endif
+#if defined(DYNAMOTE_COMPRESSED_RAW_JSON)
+	features.add("compressedRaw");
+#endif
+#if defined(DYNAMOTE_CAPTURE_LOG)
+	features.add("captureLog");
+#endif
+#if defined(DYNAMOTE_MEMORY_PROBES)
+	features.add("memoryProbes");
+#endif
+
+	status["zones"] = IR_ZONE_COUNT;
+	status["queueLength"] = COMMAND_QUEUE_LENGTH;
+	status["customCommands"] = dynamoteCustomCommandTable;
+	JsonObject record = status.createNestedObject("record");
+	record["sessions"] = recordSessions.count();
+	record["maxSessions"] = RECORD_MAX_SESSIONS;
+}
+
+/******************************************************************************************************************
+* beginIrTask
+******************************************************************************************************************/
+void Dynamote::beginIrTask(void)
+{
+#if defined(DYNAMOTE_DUAL_CORE)
+#if defined(IR_TASK_CORE)
+	BaseType_t irTaskCore = IR_TASK_CORE;
+#else
+	// begin() is called from the Arduino loop task, so use the other core
+	BaseType_t irTaskCore = (xPortGetCoreID() == 0) ? 1 : 0;
+#endif
+	xTaskCreatePinnedToCore(irTask, "dynamoteIR", IR_TASK_STACK_SIZE, this, IR_TASK_PRIORITY, &irTaskHandle, irTaskCore);
+#endif
+}
+
+#if defined(DYNAMOTE_DUAL_CORE)
+/******************************************************************************************************************
+* irTask
+******************************************************************************************************************/
+void Dynamote::irTask(void *parameter)
+{
+	Dynamote *dynamote = (Dynamote*)parameter;
+	// custom command handlers run here and may parse JSON while the loop task is using dynamoteArena
+	dynamote->irArena.useForTask(xTaskGetCurrentTaskHandle());
+	for (;;) {
+		{
+			DynamoteMemoryProbe memoryProbe(MEMORY_IR);
+			dynamote->irLoop();
+		}
+		// sleep until the next tick, or until the transport queues a command
+		ulTaskNotifyTake(pdTRUE, 1);
+	}
+}
+#endif
+
 /******************************************************************************************************************
 * setRemoteState
 ******************************************************************************************************************/
 void Dynamote::setRemoteState(RemoteState state) {
-	Serial.print("setting remote state: ");
-	Serial.println(state);
+	// The receiver belongs to irLoop(), which picks the new state up from here.
+	// This only stores the request, so it is safe to call from BLE callbacks and other tasks.
+	requestedRemoteState = state;
+}
+
+/******************************************************************************************************************
+* applyRemoteState
+******************************************************************************************************************/
+void Dynamote::applyRemoteState(RemoteState state) {
+	DYNAMOTE_LOG_INFO("setting remote state: %d", state);
 	remoteState = state;
+	remoteCapture.reset();
 
 	if (state == RECORD) {
 	// Start the receiver
@@ -62,28 +327,302 @@ void Dynamote::setRemoteState(RemoteState state) {
 /******************************************************************************************************************
 * sendJsonRemoteCommand
 ******************************************************************************************************************/
-uint8_t Dynamote::sendJsonRemoteCommand(String command) 
+uint8_t Dynamote::sendJsonRemoteCommand(const String &command, uint32_t clientKey) 
+{
+	return sendJsonRemoteCommand(command.c_str(), command.length(), clientKey);
+}
+
+uint8_t Dynamote::sendJsonRemoteCommand(const char *command, size_t length, uint32_t clientKey) 
+{
+	// the command has been sent as a json string, either a single command object or an array of them
+	// this will parse it and queue the commands before sending them
+	uint8_t result = enqueueJsonRemoteCommand(command, length, clientKey);
+	if (result != SEND_RESULT_OK)
+		return result;
+
+	kickCommandQueue();
+	return SEND_RESULT_OK;
+}
+
+/******************************************************************************************************************
+* enqueueJsonRemoteCommand
+******************************************************************************************************************/
+uint8_t Dynamote::enqueueJsonRemoteCommand(const char *command, size_t length, uint32_t clientKey)
+{
+	DynamoteMemoryProbe memoryProbe(MEMORY_JSON_PARSE);
+	uint8_t result = queueJsonRemoteCommand(command, length, clientKey);
+	if (result != SEND_RESULT_OK)
+		dynamoteMetrics.endRequest();
+	return result;
+}
+
+/******************************************************************************************************************
+* sendRemoteCommands
+******************************************************************************************************************/
+uint8_t Dynamote::sendRemoteCommands(QueuedCommand *commands, uint8_t count, uint32_t clientKey)
+{
+	// commands that are already parsed, for example from a binary datagram. The whole batch is queued, or none of it
+	DynamoteQueue<QueuedCommand, COMMAND_QUEUE_LENGTH> &queue = producerQueue();
+	if (&queue != &commandQueue)
+		clientKey = ADMISSION_LOCAL;
+	uint8_t client;
+	uint8_t result = admission.admit(clientKey, count, queue.freeSlots(), &client);
+	if (result != SEND_RESULT_OK) {
+		dynamoteMetrics.endRequest();
+		return result;
+	}
+	for (uint8_t x = 0; x < count; x++) {
+		*queue.reserve(x) = commands[x];
+		queue.reserve(x)->client = client;
+		queue.reserve(x)->done = false;
+	}
+	admission.queued(client, count);
+	queue.commit(count);
+	if (count > 1)
+		dynamoteMetrics.count(COUNTER_BATCHES_RECEIVED);
+
+	if (&queue == &commandQueue)
+		kickCommandQueue();
+	else
+		wakeLoop();
+	return SEND_RESULT_OK;
+}
+
+/******************************************************************************************************************
+* producerQueue
+******************************************************************************************************************/
+DynamoteQueue<QueuedCommand, COMMAND_QUEUE_LENGTH> &Dynamote::producerQueue(void)
+{
+#if defined(DYNAMOTE_DUAL_CORE)
+	// a custom command handler sending from the IR task, the loop task queues it from there
+	if (irTaskHandle != NULL && xTaskGetCurrentTaskHandle() == irTaskHandle)
+		return handoffQueue;
+#endif
+	return commandQueue;
+}
+
+#if defined(DYNAMOTE_DUAL_CORE)
+/******************************************************************************************************************
+* takeHandedOffCommands
+******************************************************************************************************************/
+void Dynamote::takeHandedOffCommands(void)
+{
+	// commands from the sketch, so they are not rate limited. Whatever does not fit waits for the next round.
+	bool moved = false;
+	QueuedCommand *handedOff;
+	while ((handedOff = handoffQueue.peek()) != NULL && commandQueue.freeSlots() != 0) {
+		*commandQueue.reserve(0) = *handedOff;
+		commandQueue.commit(1);
+		handoffQueue.pop();
+		moved = true;
+	}
+	if (moved)
+		kickCommandQueue();
+}
+#endif
+
+/******************************************************************************************************************
+* releaseHold
+******************************************************************************************************************/
+void Dynamote::releaseHold(void)
+{
+	// the hold belongs to the IR task, so only ask for it to end there
+	__atomic_store_n(&holdReleaseRequested, true, __ATOMIC_RELEASE);
+	kickCommandQueue();
+}
+
+/******************************************************************************************************************
+* kickCommandQueue
+******************************************************************************************************************/
+void Dynamote::kickCommandQueue(void)
 {
-	// the command has been sent as a json string
-	// this will parse it before sending the command
-	RemoteCommand remoteCommand = RemoteCommand();
-	DeserializationError error = deserializeJsonStringToRemoteCommand(command, &remoteCommand);
+	// send whatever does not have to wait right away
+#if defined(DYNAMOTE_DUAL_CORE)
+	if (irTaskHandle != NULL)
+		xTaskNotifyGive(irTaskHandle);
+#else
+	processCommandQueue();
+#endif
+}
 
-	if (!error) {
-		if (remoteCommand.useCustomCode && customCommandHandlerFxn != NULL) {
-			Serial.print("Received custom command: ");
-			Serial.println(remoteCommand.customCode);
-			(*customCommandHandlerFxn)(remoteCommand);
+/******************************************************************************************************************
+* queueJsonRemoteCommand
+******************************************************************************************************************/
+uint8_t Dynamote::queueJsonRemoteCommand(const char *command, size_t length, uint32_t clientKey)
+{
+	// the document and a copy of the command only live in the arena until this returns. The copy is parsed in
+	// place, so the strings in the document point into it instead of being copied again.
+	DynamoteArenaScope arenaScope;
+	char *jsonStringCharArray = (char*)DynamoteArena::current().allocate(length + 1);
+	DynamoteJsonDocument jsonDoc(RECV_BUF_LENGTH*10);                // <- an estimate for the maximum byte size of a command string, plus some extra
+	if (jsonStringCharArray == NULL || jsonDoc.capacity() == 0) {
+		dynamoteMetrics.drop(DROP_ARENA_FULL);
+		return SEND_RESULT_NO_MEMORY;
+	}
+	memcpy(jsonStringCharArray, command, length);
+	jsonStringCharArray[length] = 0;
+
+	DynamoteQueue<QueuedCommand, COMMAND_QUEUE_LENGTH> &queue = producerQueue();
+	DeserializationError error;
+	uint8_t commandCount;
+	uint8_t client = 0;
+#if defined(DYNAMOTE_CAPTURE_LOG)
+	replayParsed = false;
+#endif
+	{
+		DynamoteStageTimer parseTimer(METRIC_JSON_PARSE);
+		error = deserializeJson(jsonDoc, jsonStringCharArray);
+
+		//
+		// batch of commands, either [{...}, {...}] or {"commands": [{...}, {...}]}
+		//
+		JsonArray batch = jsonDoc.is<JsonArray>() ? jsonDoc.as<JsonArray>() : jsonDoc["commands"].as<JsonArray>();
+		size_t batchSize = batch.isNull() ? 1 : batch.size();
+
+		// a release on its own does not wait behind queued commands, and is never refused
+		if (!error && batch.isNull() && !jsonDoc["hold"].isNull() && !jsonDoc["hold"].as<bool>()) {
+			releaseHold();
+			dynamoteMetrics.endRequest();
+			return SEND_RESULT_OK;
+		}
+
+		// the whole batch is queued, or none of it. It is parsed straight into the free slots, so they have to be
+		// there, but it is only admitted once it parsed, a batch that is refused does not use up any tokens.
+		if (!error && batchSize > queue.freeSlots()) {
+			DYNAMOTE_LOG_WARNING("Warning, command queue is full, dropping %u commands", (unsigned int)batchSize);
+			dynamoteMetrics.drop(DROP_QUEUE_FULL);
+			return SEND_RESULT_QUEUE_FULL;
+		}
+		commandCount = batchSize;
+
+		if (!error && batch.isNull()) {
+			QueuedCommand *queuedCommand = queue.reserve(0);
+			error = deserializeJsonObjectToRemoteCommand(jsonDoc.as<JsonObject>(), queuedCommand);
 		}
-		else if (remoteCommand.useCustomCode && customCommandHandlerFxn == NULL) {
-			Serial.println("Warning, a custom command was sent but a custom command handler function was not provided");
+		else if (!error) {
+			for (uint8_t x = 0; x < commandCount && !error; x++)
+				error = deserializeJsonObjectToRemoteCommand(batch[x].as<JsonObject>(), queue.reserve(x));
+			dynamoteMetrics.count(COUNTER_BATCHES_RECEIVED);
 		}
+	}
+
+	if (error == DeserializationError::NoMemory) {
+		dynamoteMetrics.drop(DROP_ARENA_FULL);
+		return SEND_RESULT_NO_MEMORY;
+	}
+	if (error) {
+		dynamoteMetrics.drop(DROP_JSON_PARSE_ERROR);
+		return SEND_RESULT_PARSE_ERROR;
+	}
+
+	if (&queue != &commandQueue)
+		clientKey = ADMISSION_LOCAL;
+	uint8_t result = admission.admit(clientKey, commandCount, queue.freeSlots(), &client);
+	if (result != SEND_RESULT_OK)
+		return result;
+
+#if defined(DYNAMOTE_CAPTURE_LOG)
+	if (replayParsed)
+		__atomic_store_n(&replayPending, true, __ATOMIC_RELEASE);
+#endif
+	for (uint8_t x = 0; x < commandCount; x++) {
+		queue.reserve(x)->client = client;
+		queue.reserve(x)->done = false;
+	}
+	admission.queued(client, commandCount);
+	queue.commit(commandCount);
+	if (&queue != &commandQueue)
+		wakeLoop();
+	return SEND_RESULT_OK;
+}
+
+/******************************************************************************************************************
+* processCommandQueue
+******************************************************************************************************************/
+void Dynamote::processCommandQueue(void)
+{
+	// a custom command handler that sends a command ends up back here without DYNAMOTE_DUAL_CORE, what it
+	// queued is picked up by the loop below once the handler returns
+	if (processingCommandQueue)
+		return;
+	processingCommandQueue = true;
+
+	if (dynamoteAtomicExchange(&holdReleaseRequested, false))
+		stopHold();
+
+	while (true) {
+
+		// only the oldest command of each client may go next, the others keep their order behind it. Of those whose
+		// delay is over, the first client after the one served last goes, so a client that is waiting out a delay
+		// does not hold up the others.
+		QueuedCommand *queuedCommand = NULL;
+		QueuedCommand *candidate;
+		uint8_t bestDistance = 0xFF;
+		uint16_t clientsSeen = 0;
+		unsigned long now = millis();
+		for (uint8_t offset = 0; (candidate = commandQueue.peek(offset)) != NULL; offset++) {
+			if (candidate->done || (clientsSeen & (1 << candidate->client)))
+				continue;
+			clientsSeen |= 1 << candidate->client;
+			if (now - lastCommandTime[candidate->client] < candidate->delayMs)
+				continue;
+			uint8_t distance = (candidate->client + ADMISSION_MAX_CLIENTS - lastServedClient) % (ADMISSION_MAX_CLIENTS + 1);
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				queuedCommand = candidate;
+			}
+		}
+		if (queuedCommand == NULL)
+			break;
+
+		// take the command out of the queue before it runs, so the slot is free for whatever a handler queues. A
+		// command that went ahead of older ones keeps its slot until those are gone too.
+		RemoteCommand command = queuedCommand->command;
+		RemoteCommand *remoteCommand = &command;
+		uint8_t client = queuedCommand->client;
+		admission.dequeued(client);
+		queuedCommand->done = true;
+		while ((candidate = commandQueue.peek()) != NULL && candidate->done)
+			commandQueue.pop();
+		lastServedClient = client;
+
+		// a new command always ends the button that is being held
+		stopHold();
+		if (remoteCommand->hold == HOLD_RELEASE) {
+			dynamoteMetrics.endRequest();
+			continue;
+		}
+
+		// a handler registered for this name comes first, everything else goes to the catch all handler
+		CustomCommandHandler handler = NULL;
+		if (remoteCommand->useCustomCode) {
+			handler = dynamoteCustomCommandHandler(remoteCommand->customCode, remoteCommand->customCodeLength,
+			                                       remoteCommand->customCodeHash);
+			if (handler == NULL)
+				handler = customCommandHandlerFxn;
+		}
+		if (remoteCommand->useCustomCode && handler != NULL) {
+			DYNAMOTE_LOG_INFO("Received custom command: %s", remoteCommand->customCode);
+			dynamoteMetrics.count(COUNTER_CUSTOM_COMMANDS);
+			(*handler)(*remoteCommand);
+		}
+		else if (remoteCommand->useCustomCode && handler == NULL) {
+			DYNAMOTE_LOG_WARNING("Warning, a custom command was sent but a custom command handler function was not provided");
+			dynamoteMetrics.drop(DROP_NO_CUSTOM_HANDLER);
+		}
+		else if (remoteCommand->replay)
+			replayFrame(*remoteCommand);
+		else if (remoteCommand->hold == HOLD_START)
+			startHold(*remoteCommand);
 		else
-			sendRemoteCommand(remoteCommand);
-		return 0;
+			sendRemoteCommand(*remoteCommand);
+
+		// a frame that was sent has already been timed, anything else must not leave the request open
+		lastCommandTime[client] = millis();
+		dynamoteMetrics.endRequest();
 	}
-	else
-		return 1;
+
+	processingCommandQueue = false;
 }
 
 /******************************************************************************************************************
@@ -91,100 +630,416 @@ uint8_t Dynamote::sendJsonRemoteCommand(String command)
 ******************************************************************************************************************/
 void Dynamote::sendRemoteCommand(RemoteCommand command) 
 {
-	Serial.print("Sending: ");
+	dynamoteMetrics.firstMark();
+	dynamoteMetrics.count(COUNTER_COMMANDS_SENT);
+	DynamoteStageTimer sendTimer(METRIC_IR_SEND);
+	uint8_t zones = (command.zones != 0) ? command.zones : 1;
+
+#if defined(IR_ZONE_PINS)
+	// start the other zones first, they keep transmitting in the background while zone 0 is sent below
+	if (zones & ~1)
+		sendToZoneEmitters(command, zones);
+#endif
+
+	if (!(zones & 1))
+		return;
 	if (command.codeProtocol == UNKNOWN) {
-		remoteRawSender.send(command.codeValueRaw.toArray(), command.codeLength, 36);
-		Serial.println(F("Sent raw"));
+		remoteRawSender.send(command.codeValueRaw, command.codeLength, 36);
+		DYNAMOTE_LOG_INFO("Sent raw");
+		return;
 	}
-	else {
-		Serial.print(F("Sent "));
-		Serial.print(Pnames(command.codeProtocol));
-		Serial.print(F(" Value:0x"));
-		Serial.println(command.codeValue, HEX);
+	if (command.codeProtocol >= PROTOCOL_DESCRIPTOR_COUNT || !DYNAMOTE_HAS_PROTOCOL(command.codeProtocol)) {
+		DYNAMOTE_LOG_WARNING("Warning, protocol %u is not in DYNAMOTE_PROTOCOLS", command.codeProtocol);
+		return;
+	}
+
+	// the same encoder as the zones, IRLib2 is only needed for the protocols it does not describe
+	uint16_t durations[ENCODER_MAX_DURATIONS];
+	uint8_t khz;
+	uint16_t length = remoteEncoder.encode(command.codeProtocol, command.codeValue, command.codeLength, durations, &khz);
+	if (length != 0)
+		remoteRawSender.send(durations, length, khz);
+	else
 		remoteSender.send(command.codeProtocol, command.codeValue, command.codeLength);
+	DYNAMOTE_LOG_INFO("Sent %s Value:0x%lX", (const char*)Pnames(command.codeProtocol), (unsigned long)command.codeValue);
+}
+
+/******************************************************************************************************************
+* startHold
+******************************************************************************************************************/
+void Dynamote::startHold(RemoteCommand &command)
+{
+	holdCommand = command;
+	holdCommand.hold = HOLD_NONE;
+
+	// Sony is sent three frames at a time, so sending it again as soon as that is done keeps its frame cadence going
+	const DynamoteProtocolDescriptor &descriptor = protocolDescriptor(command.codeProtocol);
+	uint8_t bits = (descriptor.fixedBits || command.codeLength == 0) ? descriptor.defaultBits : command.codeLength;
+	holdPeriodMs = descriptor.holdPeriodMs;
+	if (descriptor.frameExtentUs != 0)
+		holdPeriodMs = descriptor.frames * protocolFrameExtentUs(command.codeProtocol, bits) / 1000;
+
+	// the toggle bit changes on every new press, and stays the same while the button is held
+	if (descriptor.repeat == PROTOCOL_REPEAT_TOGGLE) {
+		holdToggle = !holdToggle;
+		if (holdToggle)
+			holdCommand.codeValue ^= (uint32_t)1 << (bits - descriptor.toggleBit);
 	}
+
+	sendRemoteCommand(holdCommand);
+	holding = true;
+	holdStartTime = millis();
+	holdLastFrameTime = holdStartTime;
+
+	// the frames after the first one
+	if (descriptor.repeat == PROTOCOL_REPEAT_CODE)
+		holdCommand.codeValue = REPEAT_CODE;
+	else if (descriptor.repeat == PROTOCOL_REPEAT_NO_HEADER)
+		holdCommand.codeLength = 0;
 }
 
 /******************************************************************************************************************
-* getReceiverInput
+* stopHold
+******************************************************************************************************************/
+void Dynamote::stopHold(void)
+{
+	if (!holding)
+		return;
+	holding = false;
+	DYNAMOTE_LOG_DEBUG("Released after %lums", millis() - holdStartTime);
+}
+
+/******************************************************************************************************************
+* processHold
+******************************************************************************************************************/
+void Dynamote::processHold(void)
+{
+	if (!holding)
+		return;
+
+	unsigned long now = millis();
+	if (now - holdStartTime >= HOLD_TIMEOUT_MS) {
+		DYNAMOTE_LOG_WARNING("Warning, held button was never released");
+		dynamoteMetrics.drop(DROP_HOLD_TIMEOUT);
+		stopHold();
+		return;
+	}
+	if (now - holdLastFrameTime < holdPeriodMs)
+		return;
+
+	// keep the cadence, unless something held us up for longer than a whole period
+	holdLastFrameTime += holdPeriodMs;
+	if (now - holdLastFrameTime >= holdPeriodMs)
+		holdLastFrameTime = now;
+	sendRemoteCommand(holdCommand);
+}
+
+#if defined(IR_ZONE_PINS)
+/******************************************************************************************************************
+* sendToZoneEmitters
 ******************************************************************************************************************/
-RemoteCommand Dynamote::getReceiverInput(void) 
+void Dynamote::sendToZoneEmitters(RemoteCommand &command, uint8_t zones)
 {
-	RemoteCommand recordedRemoteCommand = RemoteCommand();
+	uint16_t durations[ENCODER_MAX_DURATIONS];
+	uint16_t length;
+	uint8_t khz = 36;
+	if (command.codeProtocol == UNKNOWN) {
+		length = min(command.codeLength, (uint8_t)command.codeValueRaw.size());
+		command.codeValueRaw.toArray(durations);
+	}
+	else
+		length = remoteEncoder.encode(command.codeProtocol, command.codeValue, command.codeLength, durations, &khz);
 
+	if (length == 0) {
+		DYNAMOTE_LOG_WARNING("Warning, %s can only be sent on zone 0", (const char*)Pnames(command.codeProtocol));
+		return;
+	}
+
+	for (uint8_t zone = 1; zone < IR_ZONE_COUNT; zone++) {
+		if (zones & (1 << zone))
+			zoneEmitters[zone - 1].send(durations, length, khz);
+	}
+	DYNAMOTE_LOG_INFO("Sent %s to zones 0x%02X", (const char*)Pnames(command.codeProtocol), zones & ~1);
+}
+#endif
+
+/******************************************************************************************************************
+* getReceiverInput
+******************************************************************************************************************/
+void Dynamote::getReceiverInput(void) 
+{
 	if (remoteReceiver.getResults()) {
 		
-		remoteDecoder.decode();
+		decodeFrame(0);
+		dynamoteMetrics.count(COUNTER_FRAMES_CAPTURED);
 
-		recordedRemoteCommand.codeProtocol = remoteDecoder.protocolNum;
-		Serial.print(F("Received "));
-		Serial.print(Pnames(recordedRemoteCommand.codeProtocol));
+		uint8_t codeProtocol = remoteDecoder.protocolNum;
+		bool newFrame;
 
 		//
 		// unknown protocol, save raw data
 		//
-		if (recordedRemoteCommand.codeProtocol == UNKNOWN) {
-			Serial.println(F(", saving raw data."));
-
-			recordedRemoteCommand.codeLength = recvGlobal.decodeLength-1;
-		
-			// copy the contents of the decode buffer into the recordedRemoteCommand raw field
+		if (codeProtocol == UNKNOWN) {
+			uint8_t codeLength = recvGlobal.decodeLength-1;
 			volatile uint16_t* decodeBuffer = &(recvGlobal.decodeBuffer[1]);
-			recordedRemoteCommand.codeValueRaw.clear();
-			for (uint8_t x = 0; x < recordedRemoteCommand.codeLength; x++) {
-				recordedRemoteCommand.codeValueRaw.add(decodeBuffer[x]);
-				Serial.print(decodeBuffer[x]);
-				Serial.print(',');
+			DYNAMOTE_LOG_DEBUG("Received %s, %u raw timings", (const char*)Pnames(codeProtocol), codeLength);
+#if DYNAMOTE_LOG_LEVEL >= DYNAMOTE_LOG_LEVEL_DEBUG
+			// dump the raw timings, eight values per message
+			for (uint8_t x = 0; x < codeLength; x += 8) {
+				char timings[DYNAMOTE_LOG_LINE_LENGTH] = "";
+				uint8_t length = 0;
+				for (uint8_t y = x; y < x + 8 && y < codeLength; y++)
+					length += snprintf(&timings[length], sizeof(timings) - length, "%u,", decodeBuffer[y]);
+				DYNAMOTE_LOG_DEBUG("%s", timings);
 			}
-			Serial.println(' ');
+#endif
+			// group it with the other frames of this button press
+			newFrame = remoteCapture.addFrame(codeProtocol, 0, codeLength, decodeBuffer, millis());
 		}
 		//
 		// known protocol
 		//
+		else if (remoteDecoder.value == REPEAT_CODE) {
+			// Don't record a NEC repeat value as that's useless, but it does mean the button is still held.
+			DYNAMOTE_LOG_DEBUG("Received %s repeat; ignoring.", (const char*)Pnames(codeProtocol));
+			dynamoteMetrics.drop(DROP_NEC_REPEAT);
+			remoteCapture.addRepeatFrame(millis());
+			newFrame = true;
+		}
 		else {
-			if (remoteDecoder.value == REPEAT_CODE) {
-				// Don't record a NEC repeat value as that's useless.
-				Serial.println(F("repeat; ignoring."));
-			} else {
-				recordedRemoteCommand.codeValue = remoteDecoder.value;
-				recordedRemoteCommand.codeLength = remoteDecoder.bits;
-			}
-			Serial.print(F(" Value:0x"));
-			Serial.println(recordedRemoteCommand.codeValue, HEX);
+			DYNAMOTE_LOG_DEBUG("Received %s Value:0x%lX", (const char*)Pnames(codeProtocol), (unsigned long)remoteDecoder.value);
+			newFrame = remoteCapture.addFrame(codeProtocol, remoteDecoder.value, remoteDecoder.bits, NULL, millis());
 		}
+
+		if (!newFrame)
+			dynamoteMetrics.drop(DROP_DUPLICATE_FRAME);
 		remoteReceiver.enableIRIn();
 	}
-	return recordedRemoteCommand;
 }
 
 /******************************************************************************************************************
-* deserializeJsonStringToRemoteCommand
+* decodeFrame
 ******************************************************************************************************************/
-DeserializationError Dynamote::deserializeJsonStringToRemoteCommand(String jsonString, RemoteCommand *command)
+void Dynamote::decodeFrame(uint8_t captureFlags)
 {
-	char jsonStringCharArray[jsonString.length()+1];
-	jsonString.toCharArray(jsonStringCharArray, jsonString.length()+1);
+#if defined(DYNAMOTE_CAPTURE_LOG)
+	// the same decoders in the same order as IRdecode::decode() in IRLibCombo.h, but each one timed on its own
+	CaptureFrame frame;
+	CaptureProbe probes[CAPTURE_MAX_PROBES];
+	uint8_t probeCount = 0;
+	bool decoded = false;
+	frame.timestamp = micros();
+
+#define PROBE_DECODER(protocol, decoder) \
+	if (!decoded) { \
+		uint32_t probeStartMicros = micros(); \
+		decoded = remoteDecoder.decoder::decode(); \
+		probes[probeCount].protocol = protocol; \
+		probes[probeCount++].micros = micros() - probeStartMicros; \
+	}
 
-	StaticJsonDocument<RECV_BUF_LENGTH*10> jsonDoc;                  // <- an estimate for the maximum byte size of a command string, plus some extra
-	DeserializationError deserializeStatus = deserializeJson(jsonDoc, jsonStringCharArray);
+#if DYNAMOTE_HAS_PROTOCOL(NEC)
+	PROBE_DECODER(NEC, IRdecodeNEC)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(SONY)
+	PROBE_DECODER(SONY, IRdecodeSony)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(RC5)
+	PROBE_DECODER(RC5, IRdecodeRC5)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(RC6)
+	PROBE_DECODER(RC6, IRdecodeRC6)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(PANASONIC_OLD)
+	PROBE_DECODER(PANASONIC_OLD, IRdecodePanasonic_Old)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(JVC)
+	PROBE_DECODER(JVC, IRdecodeJVC)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(NECX)
+	PROBE_DECODER(NECX, IRdecodeNECx)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(SAMSUNG36)
+	PROBE_DECODER(SAMSUNG36, IRdecodeSamsung36)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(GICABLE)
+	PROBE_DECODER(GICABLE, IRdecodeGICable)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(DIRECTV)
+	PROBE_DECODER(DIRECTV, IRdecodeDirecTV)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(RCMM)
+	PROBE_DECODER(RCMM, IRdecodeRCMM)
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(CYKM)
+	PROBE_DECODER(CYKM, IRdecodeCYKM)
+#endif
+	PROBE_DECODER(UNKNOWN, IRdecodeHash)
+#undef PROBE_DECODER
 
-	if (deserializeStatus)
-		return deserializeStatus;
+	frame.flags = captureFlags;
+	frame.protocol = remoteDecoder.protocolNum;
+	frame.bits = remoteDecoder.bits;
+	frame.value = remoteDecoder.value;
+	frame.decodeMicros = 0;
+	for (uint8_t x = 0; x < probeCount; x++)
+		frame.decodeMicros += probes[x].micros;
+	dynamoteCaptureLog.write(frame, probes, probeCount, &recvGlobal.decodeBuffer[1], recvGlobal.decodeLength - 1);
+#else
+	remoteDecoder.decode();
+#endif
+}
+
+/******************************************************************************************************************
+* replayFrame
+******************************************************************************************************************/
+void Dynamote::replayFrame(RemoteCommand &command)
+{
+#if defined(DYNAMOTE_CAPTURE_LOG)
+	// the receiver records into the buffer the decoders read, so keep it quiet while the frame is in there
+	remoteReceiver.disableIRIn();
+	uint8_t length;
+	recvGlobal.decodeBuffer[0] = 0;
+	if (__atomic_load_n(&replayPending, __ATOMIC_ACQUIRE)) {
+		// a replay that came in as JSON, with the timings exactly as they were captured
+		length = replayLength;
+		for (uint8_t x = 0; x < length; x++)
+			recvGlobal.decodeBuffer[x + 1] = replayTimings[x];
+		__atomic_store_n(&replayPending, false, __ATOMIC_RELEASE);
+	}
+	else {
+		// built by the sketch
+		length = min(command.codeValueRaw.size(), RECV_BUF_LENGTH - 1);
+		for (uint8_t x = 0; x < length; x++)
+			recvGlobal.decodeBuffer[x + 1] = command.codeValueRaw.get(x);
+	}
+	recvGlobal.decodeLength = length + 1;
+	decodeFrame(CAPTURE_FLAG_REPLAY);
+	if (remoteState == RECORD)
+		remoteReceiver.enableIRIn();
+#else
+	DYNAMOTE_LOG_WARNING("Warning, replay needs DYNAMOTE_CAPTURE_LOG");
+#endif
+}
+
+/******************************************************************************************************************
+* deserializeJsonObjectToRemoteCommand
+******************************************************************************************************************/
+DeserializationError Dynamote::deserializeJsonObjectToRemoteCommand(JsonObject jsonDoc, QueuedCommand *queuedCommand)
+{
+	if (jsonDoc.isNull())
+		return DeserializationError::InvalidInput;
+
+	RemoteCommand *command = &queuedCommand->command;
+	*command = RemoteCommand();
+	queuedCommand->delayMs = jsonDoc["delay"] | 0;
 
 	command->codeProtocol = jsonDoc["protocol"];
 	command->codeValue = jsonDoc["codeValue"];
 	command->codeLength = jsonDoc["codeLength"];
-	command->customCode = jsonDoc["customCode"].as<String>();
+	// the name is hashed and copied straight from the parsed document, a handler is picked by the hash later
+	const char *customCode = jsonDoc["customCode"] | "";
+	size_t customCodeLength = strlen(customCode);
+	if (customCodeLength > CUSTOM_COMMAND_MAX_LENGTH) {
+		DYNAMOTE_LOG_WARNING("Warning, custom code is longer than %u characters", CUSTOM_COMMAND_MAX_LENGTH);
+		return DeserializationError::InvalidInput;
+	}
+	memcpy(command->customCode, customCode, customCodeLength + 1);
+	command->customCodeLength = customCodeLength;
+	command->customCodeHash = dynamoteHashBytes(customCode, customCodeLength);
 	command->useCustomCode = jsonDoc["useCustomCode"];
+	command->replay = jsonDoc["replay"] | false;
+
+	// "hold": true keeps sending the command until a "hold": false arrives
+	if (!jsonDoc["hold"].isNull())
+		command->hold = jsonDoc["hold"].as<bool>() ? HOLD_START : HOLD_RELEASE;
+
+	// the emitter zones to send to, either a single "zone" or a "zones" array
+	command->zones = 0;
+	if (!jsonDoc["zone"].isNull()) {
+		unsigned int zone = jsonDoc["zone"];
+		if (zone >= IR_ZONE_COUNT) {
+			DYNAMOTE_LOG_WARNING("Warning, unknown zone %u", zone);
+			return DeserializationError::InvalidInput;
+		}
+		command->zones |= 1 << zone;
+	}
+	for (JsonVariant zoneValue : jsonDoc["zones"].as<JsonArray>()) {
+		unsigned int zone = zoneValue;
+		if (zone >= IR_ZONE_COUNT) {
+			DYNAMOTE_LOG_WARNING("Warning, unknown zone %u", zone);
+			return DeserializationError::InvalidInput;
+		}
+		command->zones |= 1 << zone;
+	}
+
+#if defined(DYNAMOTE_CAPTURE_LOG)
+	// the timings of a replay skip codeValueRaw and are kept as they are, one replay at a time
+	if (command->replay) {
+		JsonArray replayArray = jsonDoc["codeValueRaw"].as<JsonArray>();
+		if (replayParsed || __atomic_load_n(&replayPending, __ATOMIC_ACQUIRE))
+			return DeserializationError::NoMemory;
+		if (replayArray.size() > RECV_BUF_LENGTH - 1)
+			return DeserializationError::InvalidInput;
+		replayLength = 0;
+		for (JsonVariant value : replayArray)
+			replayTimings[replayLength++] = value.as<unsigned int>();
+		replayParsed = true;
+		return DeserializationError::Ok;
+	}
+#endif
 
 	// get the raw code values, if there are any
 	command->codeValueRaw.clear();
-	JsonArray codeValueRawArray = jsonDoc["codeValueRaw"].as<JsonArray>();
-	for (JsonVariant value : codeValueRawArray) {
-		command->codeValueRaw.add(value.as<int>());
+	JsonArray codeValueRawDictionary = jsonDoc["codeValueRawDictionary"].as<JsonArray>();
+	if (!codeValueRawDictionary.isNull()) {
+		// compressed form, a dictionary of durations and a hex string of packed indices into it
+		uint16_t dictionary[DICTIONARY_SIZE];
+		uint8_t dictionarySize = 0;
+		for (JsonVariant value : codeValueRawDictionary) {
+			if (dictionarySize == DICTIONARY_SIZE)
+				return DeserializationError::InvalidInput;
+			dictionary[dictionarySize++] = value.as<int>();
+		}
+		const char *symbolsHex = jsonDoc["codeValueRawSymbols"] | "";
+		size_t symbolsHexLength = strlen(symbolsHex);
+		if (symbolsHexLength % 2 != 0 || symbolsHexLength > SYMBOL_BYTES*2)
+			return DeserializationError::InvalidInput;
+		uint8_t packedSymbols[SYMBOL_BYTES] = { 0 };
+		for (unsigned int x = 0; x < symbolsHexLength; x++) {
+			if (!isxdigit(symbolsHex[x]))
+				return DeserializationError::InvalidInput;
+			uint8_t nibble = (symbolsHex[x] <= '9') ? symbolsHex[x] - '0' : (symbolsHex[x] | 0x20) - 'a' + 10;
+			packedSymbols[x / 2] |= (x % 2 == 0) ? nibble << 4 : nibble;
+		}
+		if (!command->codeValueRaw.setCompressed(dictionary, dictionarySize, packedSymbols, symbolsHexLength / 2, command->codeLength))
+			return DeserializationError::InvalidInput;
+	}
+	else {
+		// sent as plain timings, these are kept exactly as they are if they fit in the dictionary. Raw codes saved
+		// from unquantized recordings jitter and have more distinct durations, they are quantized like a capture.
+		JsonArray codeValueRawArray = jsonDoc["codeValueRaw"].as<JsonArray>();
+		if (codeValueRawArray.size() > ARRAY_SIZE) {
+			DYNAMOTE_LOG_WARNING("Warning, raw code is longer than %u timings", ARRAY_SIZE);
+			return DeserializationError::InvalidInput;
+		}
+		uint16_t raw[ARRAY_SIZE];
+		uint8_t rawLength = 0;
+		bool exact = true;
+		for (JsonVariant value : codeValueRawArray) {
+			raw[rawLength] = value.as<unsigned int>();
+			exact &= command->codeValueRaw.add(raw[rawLength++]);
+		}
+		if (!exact) {
+			DynamoteCapture::quantizeRawFrame(raw, rawLength);
+			command->codeValueRaw.clear();
+			for (uint8_t x = 0; x < rawLength; x++)
+				command->codeValueRaw.add(raw[x], true);
+			DYNAMOTE_LOG_INFO("Raw code has more than %u distinct durations, quantized it", DICTIONARY_SIZE);
+		}
 	}
 
-	return deserializeStatus;
+	return DeserializationError::Ok;
 }
 
 /******************************************************************************************************************
@@ -192,21 +1047,54 @@ DeserializationError Dynamote::deserializeJsonStringToRemoteCommand(String jsonS
 ******************************************************************************************************************/
 void Dynamote::serializeRemoteCommandToJsonString(RemoteCommand command, String &destinationBuffer)
 {
-	StaticJsonDocument<RECV_BUF_LENGTH*10> jsonDoc;                  // <- an estimate for the maximum byte size of a command string, plus some extra
+	DynamoteMemoryProbe memoryProbe(MEMORY_JSON_SERIALIZE);
+	writeRemoteCommandJson(command, destinationBuffer);
+}
+
+/******************************************************************************************************************
+* serializeRemoteCommandToJson
+******************************************************************************************************************/
+void Dynamote::serializeRemoteCommandToJson(RemoteCommand command, Print &output)
+{
+	DynamoteMemoryProbe memoryProbe(MEMORY_JSON_SERIALIZE);
+	writeRemoteCommandJson(command, output);
+}
+
+/******************************************************************************************************************
+* writeRemoteCommandJson
+******************************************************************************************************************/
+template <typename Destination> void Dynamote::writeRemoteCommandJson(RemoteCommand &command, Destination &destination)
+{
+	DynamoteArenaScope arenaScope;
+	DynamoteJsonDocument jsonDoc(RECV_BUF_LENGTH*10);                // <- an estimate for the maximum byte size of a command string, plus some extra
 	jsonDoc["protocol"] = command.codeProtocol;
 	jsonDoc["codeValue"] = command.codeValue;
 	jsonDoc["codeLength"] = command.codeLength;
 	jsonDoc["customCode"] = command.customCode;
 	jsonDoc["useCustomCode"] = command.useCustomCode;
+	if (command.confidence != 0)
+		jsonDoc["confidence"] = command.confidence;
 	if (command.codeProtocol == UNKNOWN) {
+#if defined(DYNAMOTE_COMPRESSED_RAW_JSON)
+		JsonArray codeValueRawDictionary = jsonDoc.createNestedArray("codeValueRawDictionary");
+		for (uint8_t x = 0; x < command.codeValueRaw.getDictionarySize(); x++)
+			codeValueRawDictionary.add(command.codeValueRaw.getDictionaryValue(x));
+		char symbolsHex[SYMBOL_BYTES*2 + 1];
+		const uint8_t *packedSymbols = command.codeValueRaw.getPackedSymbols();
+		for (unsigned int x = 0; x < command.codeValueRaw.getPackedSymbolsLength(); x++)
+			sprintf(&symbolsHex[x*2], "%02x", packedSymbols[x]);
+		symbolsHex[command.codeValueRaw.getPackedSymbolsLength()*2] = 0;
+		jsonDoc["codeValueRawSymbols"] = symbolsHex;
+#else
 		for (uint8_t x = 0; x < command.codeLength; x++)
 			jsonDoc["codeValueRaw"][x] = command.codeValueRaw.get(x);
+#endif
 	}
 	else
 		// create empty array entry
 		jsonDoc.createNestedArray("codeValueRaw"); 
 
-	serializeJson(jsonDoc, destinationBuffer);
+	serializeJson(jsonDoc, destination);
 }
 
 /******************************************************************************************************************
@@ -33,10 +33,44 @@
 #define RECEIVER_PIN				2
 #endif
 
+// Library log level, anything above it is removed at compile time. Set to DYNAMOTE_LOG_LEVEL_NONE for release builds.
+// Messages are kept in a RAM ring buffer and written to Serial from the loop, only as fast as it can take them.
+//   DYNAMOTE_LOG_LEVEL_NONE, DYNAMOTE_LOG_LEVEL_ERROR, DYNAMOTE_LOG_LEVEL_WARNING, DYNAMOTE_LOG_LEVEL_INFO, DYNAMOTE_LOG_LEVEL_DEBUG
+#define DYNAMOTE_LOG_LEVEL			DYNAMOTE_LOG_LEVEL_INFO
+
+// Uncomment to send recorded raw codes in their compressed form (a dictionary of durations plus packed indices)
+// instead of a full array of timings. Both forms are always accepted.
+//#define DYNAMOTE_COMPRESSED_RAW_JSON
+
+// Uncomment to measure the peak stack use and heap growth of each subsystem, reported with the metrics. Every
+// measured call paints up to MEMORY_PROBE_DEPTH bytes of free stack, so leave it off unless you are sizing buffers.
+// Heap usage and fragmentation are always reported.
+//#define DYNAMOTE_MEMORY_PROBES
+
+// Uncomment to log every received frame with its timestamp, timings, decode result and the time each protocol decoder
+// took, into a RAM ring of CAPTURE_LOG_BUFFER_SIZE bytes. The log is read with GET /captures and the other
+// transports, and raw commands sent with "replay": true are run through the decoders instead of being sent.
+//#define DYNAMOTE_CAPTURE_LOG
+
+// ESP32 only. Uncomment to run IR receive and transmit in their own FreeRTOS task, pinned to the core that is not
+// running the Arduino loop, so network traffic and JSON parsing no longer disturb IR timing. Custom command handlers
+// are then called from the IR task, not from the loop, so keep them short and guard state they share with the sketch.
+//#define DYNAMOTE_DUAL_CORE
+
+// Protocols built in, as a bitmask of IRLib2 protocol numbers. Leave out the ones your remotes never use to save flash,
+// their IRLib2 decoders and senders are then not included at all. Raw codes always work.
+//   For example: #define DYNAMOTE_PROTOCOLS			((1 << NEC) | (1 << SONY) | (1 << RC5))
+#define DYNAMOTE_PROTOCOLS			DYNAMOTE_ALL_PROTOCOLS
+
 // The SEND pin is hardcoded in the IRLib2 library for each board. Listed below are the pins for our supported boards.
 //   Adafruit HUZZAH32 = digital pin 26 (same as analog pin A0)
 //   Nano 33 IoT = digital pin 9
 
+// ESP32 only. Uncomment to add more IR emitter outputs ("zones"), each one driven by its own RMT channel so they can
+// all transmit at the same time. Zone 0 is always the SEND pin above, the pins listed here become zones 1, 2, ...
+// A command picks its zone with "zone", or several with "zones", and goes to zone 0 if it has neither.
+//#define IR_ZONE_PINS				25, 33
+
 /********************************************************************************
 *    End user options
 ********************************************************************************/
@@ -51,37 +85,178 @@
 #ifndef RECEIVER_PIN
 #error "Error, RECEIVER_PIN is not defined"
 #endif
+#if defined(DYNAMOTE_DUAL_CORE) && !defined(ESP32)
+#error "Error, DYNAMOTE_DUAL_CORE is only supported on the ESP32"
+#endif
+#if defined(IR_ZONE_PINS) && !defined(ESP32)
+#error "Error, IR_ZONE_PINS is only supported on the ESP32"
+#endif
 
 #include <IRLibDecodeBase.h>                  // IRLib2 https://github.com/cyborg5/IRLib2
 #include <IRLibSendBase.h>                    // with the following pull request for ESP32 support: https://github.com/cyborg5/IRLib2/pull/77
+#include <DynamoteProtocols.h>
+#if DYNAMOTE_HAS_PROTOCOL(NEC)
 #include <IRLib_P01_NEC.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(SONY)
 #include <IRLib_P02_Sony.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(RC5)
 #include <IRLib_P03_RC5.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(RC6)
 #include <IRLib_P04_RC6.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(PANASONIC_OLD)
 #include <IRLib_P05_Panasonic_Old.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(JVC)
 #include <IRLib_P06_JVC.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(NECX)
 #include <IRLib_P07_NECx.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(SAMSUNG36)
 #include <IRLib_P08_Samsung36.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(GICABLE)
 #include <IRLib_P09_GICable.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(DIRECTV)
 #include <IRLib_P10_DirecTV.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(RCMM)
 #include <IRLib_P11_RCMM.h>
+#endif
+#if DYNAMOTE_HAS_PROTOCOL(CYKM)
 #include <IRLib_P12_CYKM.h>
+#endif
 #include <IRLib_HashRaw.h>
 #include <IRLibCombo.h>
 #include <IRLibRecvPCI.h>
 #include <DynamoteLinkedList.h>
+#include <DynamoteRawSender.h>
+#include <DynamoteMetrics.h>
+#include <DynamoteMemory.h>
+#include <DynamoteLog.h>
+#include <DynamoteCapture.h>
+#include <DynamoteCaptureLog.h>
+#include <DynamoteQueue.h>
+#include <DynamoteLock.h>
+#include <DynamoteTimer.h>
+#include <DynamoteRecordSession.h>
+#include <DynamoteStatus.h>
+#include <DynamoteEncoder.h>
+#include <DynamoteEmitter.h>
+#include <DynamoteRouter.h>
+#include <DynamoteAdmission.h>
+#include <DynamoteArena.h>
 #include <ArduinoJson.h>              // https://arduinojson.org/
 
+// Longest custom code name, a longer one is refused as a parse error
+#define CUSTOM_COMMAND_MAX_LENGTH       31
+
 typedef struct
 {
 	uint8_t codeProtocol;         			// The type of IR code
 	uint32_t codeValue;           			// The data bits if IR type is not raw
 	DynamoteLinkedList codeValueRaw;    // The data bits if IR type is raw
 	uint8_t codeLength;           			// The length of the IR code in bits
-	String customCode;        					// custom code specified by the user
+	char customCode[CUSTOM_COMMAND_MAX_LENGTH + 1];  // custom code specified by the user, zero terminated
+	uint8_t customCodeLength;
+	uint32_t customCodeHash;            // dynamoteHash() of customCode, taken while parsing
 	bool useCustomCode;      						// whether to use the received custom code over the IR code
+	uint8_t confidence;      						// recorded commands only, percentage of the frames in the button press that matched
+	uint8_t zones;                      // bit per emitter zone to send to, 0 means zone 0
+	uint8_t hold;                       // HOLD_START to keep repeating until HOLD_RELEASE, see processHold()
+	bool replay;                        // run the raw timings through the decoders instead of sending them, see replayFrame()
 } RemoteCommand;
 
+// RemoteCommand.hold
+#define HOLD_NONE               0
+#define HOLD_START              1
+#define HOLD_RELEASE            2
+
+// Zone 0 is the IRLib2 SEND pin, every pin in IR_ZONE_PINS adds one more
+#if defined(IR_ZONE_PINS)
+static const uint8_t irZonePins[] = { IR_ZONE_PINS };
+#define IR_ZONE_COUNT           (1 + sizeof(irZonePins))
+#else
+#define IR_ZONE_COUNT           1
+#endif
+
+typedef struct
+{
+	RemoteCommand command;
+	uint16_t delayMs;                   // time to wait after the previous command before sending this one
+	uint8_t client;                     // from DynamoteAdmission::admit(), 0 for commands from the sketch
+	bool done;                          // sent ahead of older commands of other clients, see processCommandQueue()
+} QueuedCommand;
+
+// Called from the task that sends the commands: the IR task with DYNAMOTE_DUAL_CORE, otherwise the Arduino loop
+typedef void (*CustomCommandHandler)(RemoteCommand);
+
+// The sketch lists its custom command handlers once, at global scope:
+//   DYNAMOTE_CUSTOM_COMMANDS(
+//     CUSTOM_COMMAND("send_IR_code_twice", &sendIrCodeTwice)
+//   )
+// That becomes a switch on the hash of the name, taken at compile time like the HTTP routes. Two names with the
+// same hash would be duplicate case labels, so the hashing is checked to be perfect at compile time, and a name
+// whose hash matches is compared in full.
+#define CUSTOM_COMMAND(name, handler) \
+	case dynamoteHash(name): \
+		return (length == sizeof(name) - 1 && memcmp(customCode, name, length) == 0) ? (handler) : NULL;
+
+#define DYNAMOTE_CUSTOM_COMMANDS(...) \
+	bool dynamoteCustomCommandTable = true; \
+	CustomCommandHandler dynamoteCustomCommandHandler(const char *customCode, uint8_t length, uint32_t hash) \
+	{ \
+		switch (hash) { \
+			__VA_ARGS__ \
+			default: \
+				return NULL; \
+		} \
+	}
+
+// Without DYNAMOTE_CUSTOM_COMMANDS() in the sketch, every custom command goes to setCustomCommandHandlerFxn()
+CustomCommandHandler dynamoteCustomCommandHandler(const char *customCode, uint8_t length, uint32_t hash);
+extern bool dynamoteCustomCommandTable;
+
+// Library version, the same as in library.properties
+#define DYNAMOTE_VERSION        "1.0.0"
+
+
+// Most commands that can be waiting to be sent, a batch larger than the free space is rejected as a whole
+#define COMMAND_QUEUE_LENGTH    8
+
+// Most recorded commands that can be waiting for the transport to pick them up
+#define CAPTURE_QUEUE_LENGTH    4
+
+// IR task settings for DYNAMOTE_DUAL_CORE. By default the IR task runs on the core that is not running the Arduino loop.
+#define IR_TASK_STACK_SIZE      8192
+#define IR_TASK_PRIORITY        2
+// Arena of the IR task, used when a custom command handler sends JSON commands with sendJsonRemoteCommand().
+// Those commands are handed to the loop task, which queues them the next time dynamoteLoop() runs.
+#define IR_TASK_ARENA_SIZE      (RECV_BUF_LENGTH*10 + 1024)
+//#define IR_TASK_CORE            0
+
+// A polled record session (HTTP) is closed if no new record request arrives from its client within this time
+#define RECORD_TIMEOUT_MS       5000
+
+// A held button is released by itself after this long, in case the release never arrives
+#define HOLD_TIMEOUT_MS         10000
+
+// Longest idle() sleeps when the transport has to be polled from the loop
+#define IDLE_POLL_MS            1
+
+// sendJsonRemoteCommand results
+#define SEND_RESULT_OK          0
+#define SEND_RESULT_PARSE_ERROR 1
+#define SEND_RESULT_QUEUE_FULL  2
+#define SEND_RESULT_RATE_LIMITED 3
+#define SEND_RESULT_RECORD_BUSY 4         // every record session is taken
+#define SEND_RESULT_NO_MEMORY   5         // the request did not fit in the arena
+
 enum RemoteState {
 	SEND,
 	RECORD
@@ -94,22 +269,102 @@ class Dynamote
 		RemoteCommand dynamoteLoop(void);
 		void sendRemoteCommand(RemoteCommand command);
 		void setCustomCommandHandlerFxn(void (*fxn)(RemoteCommand));
-		uint8_t sendJsonRemoteCommand(String command);
+		// clientKey is from DynamoteAdmission::clientKey(), it rate limits each client and keeps its share of the queue fair
+		uint8_t sendJsonRemoteCommand(const String &command, uint32_t clientKey = ADMISSION_LOCAL);
+		uint8_t sendJsonRemoteCommand(const char *command, size_t length, uint32_t clientKey = ADMISSION_LOCAL);
+		uint8_t sendRemoteCommands(QueuedCommand *commands, uint8_t count, uint32_t clientKey = ADMISSION_LOCAL);
+		// ends a held button at once, ahead of any queued commands and without counting against the rate limit
+		void releaseHold(void);
+		void idle(void);
 
 	protected:
 		void setRemoteState(RemoteState state);
-		RemoteState remoteState = SEND;
-		unsigned long remoteRecordRequestTime = 0;
+		// record sessions, owner is a DynamoteAdmission::clientKey(). The receiver is on while any session is open.
+		uint8_t openRecordSession(uint32_t owner, uint32_t timeoutMs);
+		void closeRecordSession(uint32_t owner);
+		// the next command recorded for the owner's session, false if there is none
+		bool takeRecordedCommand(uint32_t owner, RemoteCommand &command);
+		// the part of the status document every transport shares, see DynamoteStatus.h
+		void addStatusToJson(JsonObject status);
+		// sendJsonRemoteCommand() without sending right away, so the transport can answer first
+		uint8_t enqueueJsonRemoteCommand(const char *command, size_t length, uint32_t clientKey);
+		void kickCommandQueue(void);
+		void beginIrTask(void);
+		void beginZones(void);
+		void wakeLoop(void);
+		volatile RemoteState remoteState = SEND;
+		DynamoteTimer recordTimeoutTimer;
+		uint32_t idleMaxSleepMs = IDLE_POLL_MS;
 		void serializeRemoteCommandToJsonString(RemoteCommand command, String &destinationBuffer);
+		void serializeRemoteCommandToJson(RemoteCommand command, Print &output);
+		DeserializationError deserializeJsonObjectToRemoteCommand(JsonObject jsonDoc, QueuedCommand *queuedCommand);
 
 	private:
 		IRsend remoteSender;
-		IRsendRaw remoteRawSender;
+		DynamoteRawSender remoteRawSender;
+		DynamoteEncoder remoteEncoder;
+#if defined(IR_ZONE_PINS)
+		DynamoteEmitter zoneEmitters[IR_ZONE_COUNT - 1];
+		void sendToZoneEmitters(RemoteCommand &command, uint8_t zones);
+#endif
 		IRdecode remoteDecoder;
-		RemoteCommand getReceiverInput(void);
+		void irLoop(void);
+		void applyRemoteState(RemoteState state);
+		volatile RemoteState requestedRemoteState = SEND;
+		void getReceiverInput(void);
+		void decodeFrame(uint8_t captureFlags);
+		void replayFrame(RemoteCommand &command);
 		IRrecvPCI remoteReceiver;
-		DeserializationError deserializeJsonStringToRemoteCommand(String jsonString, RemoteCommand *command);
+		DynamoteCapture remoteCapture;
 		void (*customCommandHandlerFxn)(RemoteCommand);
+		// only the loop task queues commands and uses admission, the IR task (or the loop) sends them
+		DynamoteQueue<QueuedCommand, COMMAND_QUEUE_LENGTH> commandQueue;
+		DynamoteAdmission admission;
+		DynamoteQueue<QueuedCommand, COMMAND_QUEUE_LENGTH> &producerQueue(void);
+		// per client number, the delay of a command counts from the previous command of the same client
+		unsigned long lastCommandTime[ADMISSION_MAX_CLIENTS + 1] = {};
+		uint8_t lastServedClient = 0;
+		void processCommandQueue(void);
+		bool processingCommandQueue = false;
+		RemoteCommand holdCommand;
+		bool holding = false;
+		bool holdReleaseRequested = false;  // set by releaseHold() from any task, handled by processCommandQueue()
+		bool holdToggle = false;            // RC5/RC6 toggle bit, flipped for every new press
+#if defined(DYNAMOTE_CAPTURE_LOG)
+		// the timings of a queued replay command, exactly as captured. Going through codeValueRaw would round them
+		// into its dictionary, so there is room for one replay in the queue at a time.
+		uint16_t replayTimings[RECV_BUF_LENGTH];
+		uint8_t replayLength = 0;
+		bool replayPending = false;         // set once the replay is queued, cleared by replayFrame()
+		bool replayParsed = false;          // the command being queued holds the replay timings
+#endif
+		unsigned long holdStartTime = 0;
+		unsigned long holdLastFrameTime = 0;
+		uint16_t holdPeriodMs = 0;
+		void startHold(RemoteCommand &command);
+		void stopHold(void);
+		void processHold(void);
+		// kept out of line, so their stack frames are measured by the memory probes of their callers
+		uint8_t queueJsonRemoteCommand(const char *command, size_t length, uint32_t clientKey) __attribute__((noinline));
+		template <typename Destination> void writeRemoteCommandJson(RemoteCommand &command, Destination &destination) __attribute__((noinline));
+		DynamoteQueue<RemoteCommand, CAPTURE_QUEUE_LENGTH> captureQueue;
+		DynamoteRecordSessions recordSessions;
+		RemoteCommand recordHistory[RECORD_HISTORY_LENGTH];
+		void updateRecordSessions(void);
+		static void onRecordTimeout(void *argument);
+#if defined(ESP32)
+		TaskHandle_t loopTaskHandle = NULL;
+#endif
+#if defined(DYNAMOTE_DUAL_CORE)
+		TaskHandle_t irTaskHandle = NULL;
+		static void irTask(void *parameter);
+		// commands sent by custom command handlers, which run on the IR task. The loop task moves them into
+		// commandQueue, so each queue keeps a single producer.
+		DynamoteQueue<QueuedCommand, COMMAND_QUEUE_LENGTH> handoffQueue;
+		void takeHandedOffCommands(void);
+		alignas(DYNAMOTE_ARENA_ALIGNMENT) uint8_t irArenaBuffer[IR_TASK_ARENA_SIZE];
+		DynamoteArena irArena = DynamoteArena(irArenaBuffer, IR_TASK_ARENA_SIZE);
+#endif
 };
 
 #endif
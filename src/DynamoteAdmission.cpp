@@ -0,0 +1,130 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <Dynamote.h>
+#include "DynamoteAdmission.h"
+
+/******************************************************************************************************************
+* DynamoteAdmission constructor
+******************************************************************************************************************/
+DynamoteAdmission::DynamoteAdmission(void)
+{
+	memset(clients, 0, sizeof(clients));
+}
+
+/******************************************************************************************************************
+* clientKey
+******************************************************************************************************************/
+uint32_t DynamoteAdmission::clientKey(DynamoteTransport transport, uint32_t address, uint16_t port)
+{
+	uint8_t identity[7] = { (uint8_t)transport, (uint8_t)address, (uint8_t)(address >> 8), (uint8_t)(address >> 16),
+	                        (uint8_t)(address >> 24), (uint8_t)port, (uint8_t)(port >> 8) };
+	uint32_t key = dynamoteHashBytes((const char*)identity, sizeof(identity));
+	return (key == ADMISSION_LOCAL) ? 1 : key;
+}
+
+/******************************************************************************************************************
+* admit
+******************************************************************************************************************/
+uint8_t DynamoteAdmission::admit(uint32_t key, uint8_t count, uint8_t freeSlots, uint8_t *client)
+{
+	*client = 0;
+	if (key == ADMISSION_LOCAL) {
+		if (count <= freeSlots)
+			return SEND_RESULT_OK;
+		DYNAMOTE_LOG_WARNING("Warning, command queue is full, dropping %u commands", count);
+		dynamoteMetrics.drop(DROP_QUEUE_FULL);
+		return SEND_RESULT_QUEUE_FULL;
+	}
+
+	unsigned long now = millis();
+	int8_t index = findClient(key, now);
+	if (index < 0) {
+		// every tracked client still has commands queued, so the queue has no room anyway
+		dynamoteMetrics.drop(DROP_QUEUE_FULL);
+		return SEND_RESULT_QUEUE_FULL;
+	}
+	AdmissionClient *entry = &clients[index];
+
+	// refill the bucket for the time since the last request
+	uint32_t elapsed = now - entry->lastRefill;
+	entry->lastRefill = now;
+	entry->milliTokens = min((uint64_t)entry->milliTokens + (uint64_t)elapsed * ADMISSION_COMMANDS_PER_SECOND,
+	                         (uint64_t)ADMISSION_BURST * 1000);
+	if (entry->milliTokens < (uint32_t)count * 1000) {
+		DYNAMOTE_LOG_WARNING("Warning, client %08lX is sending too fast", (unsigned long)key);
+		dynamoteMetrics.drop(DROP_RATE_LIMITED);
+		return SEND_RESULT_RATE_LIMITED;
+	}
+
+	// every client leaves some of the queue to the others, whether or not it already has commands waiting
+	uint8_t alreadyQueued = __atomic_load_n(&entry->queued, __ATOMIC_ACQUIRE);
+	if (count > freeSlots || alreadyQueued + count > COMMAND_QUEUE_LENGTH - ADMISSION_RESERVED_SLOTS) {
+		DYNAMOTE_LOG_WARNING("Warning, command queue is full, dropping %u commands", count);
+		dynamoteMetrics.drop(DROP_QUEUE_FULL);
+		return SEND_RESULT_QUEUE_FULL;
+	}
+
+	entry->milliTokens -= (uint32_t)count * 1000;
+	*client = index + 1;
+	return SEND_RESULT_OK;
+}
+
+/******************************************************************************************************************
+* queued
+******************************************************************************************************************/
+void DynamoteAdmission::queued(uint8_t client, uint8_t count)
+{
+	if (client != 0)
+		dynamoteAtomicAdd(&clients[client - 1].queued, count);
+}
+
+/******************************************************************************************************************
+* dequeued
+******************************************************************************************************************/
+void DynamoteAdmission::dequeued(uint8_t client)
+{
+	// called from irLoop(), which may run in the IR task
+	if (client != 0)
+		dynamoteAtomicSub(&clients[client - 1].queued, (uint8_t)1);
+}
+
+/******************************************************************************************************************
+* findClient
+******************************************************************************************************************/
+int8_t DynamoteAdmission::findClient(uint32_t key, unsigned long now)
+{
+	// the client itself, or else the least recently seen one without queued commands
+	int8_t oldest = -1;
+	for (uint8_t x = 0; x < ADMISSION_MAX_CLIENTS; x++) {
+		if (clients[x].key == key) {
+			clients[x].lastSeen = now;
+			return x;
+		}
+		if (__atomic_load_n(&clients[x].queued, __ATOMIC_ACQUIRE) == 0 &&
+		    (oldest < 0 || now - clients[x].lastSeen > now - clients[oldest].lastSeen))
+			oldest = x;
+	}
+	if (oldest < 0)
+		return -1;
+
+	// a new client starts with a full bucket
+	clients[oldest].key = key;
+	clients[oldest].milliTokens = (uint32_t)ADMISSION_BURST * 1000;
+	clients[oldest].lastRefill = now;
+	clients[oldest].lastSeen = now;
+	return oldest;
+}
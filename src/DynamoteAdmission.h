@@ -0,0 +1,71 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEADMISSION_H
+#define DYNAMOTEADMISSION_H
+
+#include "Arduino.h"
+
+// Commands each client may send per second on average, and in one burst. The burst is at least a full queue,
+// so a single batch is never refused by the rate limit alone.
+#define ADMISSION_COMMANDS_PER_SECOND   10
+#define ADMISSION_BURST                 10
+
+// Number of clients tracked at once, the one seen least recently makes room for a new one
+#define ADMISSION_MAX_CLIENTS           8
+
+// Queue slots a single client can never fill, however many of its own commands are waiting, so one busy client
+// can never lock everybody else out of the emitter. Also the largest batch a client can send is this much smaller
+// than the queue.
+#define ADMISSION_RESERVED_SLOTS        2
+
+// Commands from the sketch itself are never limited
+#define ADMISSION_LOCAL                 0
+
+enum DynamoteTransport {
+	TRANSPORT_HTTP,
+	TRANSPORT_MQTT,
+	TRANSPORT_BLE,
+	TRANSPORT_UDP,
+	TRANSPORT_WEBSOCKET
+};
+
+typedef struct
+{
+	uint32_t key;
+	uint32_t milliTokens;               // a thousandth of a command, so refills of a few ms are not lost
+	unsigned long lastRefill;
+	unsigned long lastSeen;
+	uint8_t queued;                     // commands of this client in the command queue that have not been sent
+} AdmissionClient;
+
+// Token bucket rate limiting and queue quotas per client
+class DynamoteAdmission
+{
+	public:
+		DynamoteAdmission(void);
+		static uint32_t clientKey(DynamoteTransport transport, uint32_t address, uint16_t port);
+		// returns a SEND_RESULT_*, and on SEND_RESULT_OK the client number to store with the queued commands
+		uint8_t admit(uint32_t key, uint8_t count, uint8_t freeSlots, uint8_t *client);
+		void queued(uint8_t client, uint8_t count);
+		void dequeued(uint8_t client);
+
+	private:
+		AdmissionClient clients[ADMISSION_MAX_CLIENTS];
+		int8_t findClient(uint32_t key, unsigned long now);
+};
+
+#endif
@@ -0,0 +1,98 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+// Dynamote.h first, it holds the DYNAMOTE_LOG_LEVEL option
+#include "Dynamote.h"
+#include "DynamoteArena.h"
+
+alignas(DYNAMOTE_ARENA_ALIGNMENT) static uint8_t arenaBuffer[DYNAMOTE_ARENA_SIZE];
+DynamoteArena dynamoteArena(arenaBuffer, DYNAMOTE_ARENA_SIZE);
+
+#if defined(ESP32)
+static TaskHandle_t taskArenaOwner = NULL;
+static DynamoteArena *taskArena = NULL;
+#endif
+
+/******************************************************************************************************************
+* DynamoteArena constructor
+******************************************************************************************************************/
+DynamoteArena::DynamoteArena(uint8_t *_buffer, size_t _size) : buffer(_buffer), size(_size) {}
+
+/******************************************************************************************************************
+* current
+******************************************************************************************************************/
+DynamoteArena &DynamoteArena::current(void)
+{
+#if defined(ESP32)
+	if (taskArena != NULL && xTaskGetCurrentTaskHandle() == taskArenaOwner)
+		return *taskArena;
+#endif
+	return dynamoteArena;
+}
+
+#if defined(ESP32)
+/******************************************************************************************************************
+* useForTask
+******************************************************************************************************************/
+void DynamoteArena::useForTask(TaskHandle_t task)
+{
+	taskArenaOwner = task;
+	taskArena = this;
+}
+#endif
+
+/******************************************************************************************************************
+* allocate
+******************************************************************************************************************/
+void *DynamoteArena::allocate(size_t allocationSize)
+{
+	size_t start = (used + DYNAMOTE_ARENA_ALIGNMENT - 1) & ~(size_t)(DYNAMOTE_ARENA_ALIGNMENT - 1);
+	if (start > size || allocationSize > size - start) {
+		failures++;
+		DYNAMOTE_LOG_WARNING("Warning, arena is full, could not allocate %u bytes", (unsigned int)allocationSize);
+		return NULL;
+	}
+	used = start + allocationSize;
+	if (used > peak)
+		peak = used;
+	return &buffer[start];
+}
+
+/******************************************************************************************************************
+* mark
+******************************************************************************************************************/
+size_t DynamoteArena::mark(void)
+{
+	return used;
+}
+
+/******************************************************************************************************************
+* release
+******************************************************************************************************************/
+void DynamoteArena::release(size_t mark)
+{
+	used = mark;
+}
+
+/******************************************************************************************************************
+* addToJson
+******************************************************************************************************************/
+void DynamoteArena::addToJson(JsonObject arenaObject)
+{
+	arenaObject["size"] = size;
+	arenaObject["peak"] = peak;
+	arenaObject["failures"] = failures;
+}
@@ -0,0 +1,92 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEARENA_H
+#define DYNAMOTEARENA_H
+
+#include "Arduino.h"
+#include <ArduinoJson.h>              // https://arduinojson.org/
+
+// Memory reserved for handling one request: the request body, the JSON documents and a copy of the command being
+// parsed. The largest user is the metrics document.
+#ifndef DYNAMOTE_ARENA_SIZE
+#if defined(ESP32)
+#define DYNAMOTE_ARENA_SIZE           8192
+#else
+#define DYNAMOTE_ARENA_SIZE           4096
+#endif
+#endif
+
+// Every allocation starts on a multiple of this
+#define DYNAMOTE_ARENA_ALIGNMENT      8
+
+// A bump allocator over a static buffer. Allocations are never freed one by one, a DynamoteArenaScope gives back
+// everything allocated since it was opened at once. Nothing is ever taken from the heap, so handling requests can
+// not fragment it, and the most a request can use is known at compile time.
+// An arena is not shared between tasks. dynamoteArena belongs to the loop task, another task that parses or builds
+// JSON (the IR task, when a custom command handler sends a command) registers an arena of its own with useForTask().
+class DynamoteArena
+{
+	public:
+		// the buffer has to be aligned to DYNAMOTE_ARENA_ALIGNMENT
+		DynamoteArena(uint8_t *_buffer, size_t _size);
+		// returns NULL if the arena is full
+		void *allocate(size_t allocationSize);
+		size_t mark(void);
+		void release(size_t mark);
+		void addToJson(JsonObject arenaObject);
+		// the arena of the calling task
+		static DynamoteArena &current(void);
+#if defined(ESP32)
+		// from now on this is the arena of the task, only one task can have its own
+		void useForTask(TaskHandle_t task);
+#endif
+
+	private:
+		uint8_t *buffer;
+		size_t size;
+		size_t used = 0;
+		size_t peak = 0;
+		uint32_t failures = 0;
+};
+
+extern DynamoteArena dynamoteArena;
+
+// Releases everything allocated from the arena during its lifetime. Scopes can be nested, the inner one has to end
+// first, which is always the case for scopes on the stack.
+class DynamoteArenaScope
+{
+	public:
+		DynamoteArenaScope(void) : arena(DynamoteArena::current()), start(arena.mark()) {}
+		~DynamoteArenaScope(void) { arena.release(start); }
+
+	private:
+		DynamoteArena &arena;
+		size_t start;
+};
+
+// ArduinoJson allocator backed by the arena, the memory is given back when the enclosing scope ends
+struct DynamoteArenaAllocator
+{
+	void *allocate(size_t size) { return DynamoteArena::current().allocate(size); }
+	void deallocate(void *pointer) {}
+	// only used by shrinkToFit(), a block that gets smaller can stay where it is
+	void *reallocate(void *pointer, size_t size) { return pointer; }
+};
+
+typedef BasicJsonDocument<DynamoteArenaAllocator> DynamoteJsonDocument;
+
+#endif
@@ -23,7 +23,10 @@
 /******************************************************************************************************************
 * constructor
 ******************************************************************************************************************/
-DynamoteBLE::DynamoteBLE(void) {}
+DynamoteBLE::DynamoteBLE(void) : remoteSendTimer(&DynamoteBLE::onRemoteSendTimeout, this)
+{
+	idleMaxSleepMs = BLE_IDLE_MAX_SLEEP_MS;
+}
 
 /******************************************************************************************************************
 * begin
@@ -31,6 +34,9 @@ DynamoteBLE::DynamoteBLE(void) {}
 void DynamoteBLE::begin(void (*fxn)(byte*, uint8_t))
 {
 	sendDataToRemoteRecordCharacteristicFxn = fxn;
+	dynamoteStatus.setBuilder(&DynamoteBLE::buildStatus, this);
+	beginZones();
+	beginIrTask();
 }
 
 /******************************************************************************************************************
@@ -42,29 +48,84 @@ void DynamoteBLE::loop(void)
 		static bool errorShown = false;
 		if (!errorShown) {
 				errorShown = true;
-				Serial.println("Warning, no sendDataToRemoteRecordCharacteristic function was provided");
+				DYNAMOTE_LOG_WARNING("Warning, no sendDataToRemoteRecordCharacteristic function was provided");
 		}
 	}
 
-	if (sendRemoteCommandFlag) {
-		sendRemoteCommandFlag = false;
-		// the command has been sent as a json string
-		uint8_t result = sendJsonRemoteCommand(remoteCommandJsonString);
-		if (result == 0) {
-				remoteSendTime = 0;
-				remoteCommandJsonString = "";
+	if (dynamoteAtomicExchange(&sendRemoteCommandFlag, false)) {
+		DynamoteMemoryProbe memoryProbe(MEMORY_BLE);
+		// the command has been sent as a json string. Parse a copy, the callback may add the next chunk meanwhile
+		DynamoteArenaScope arenaScope;
+		char *command = (char*)dynamoteArena.allocate(BLE_MAX_COMMAND_LENGTH);
+		uint16_t commandLength = 0;
+		uint32_t reassemblyStartMicros;
+		{
+			DynamoteLockGuard guard(remoteCommandLock);
+			reassemblyStartMicros = remoteSendStartMicros;
+			if (command != NULL) {
+				commandLength = remoteCommandJsonLength;
+				memcpy(command, remoteCommandJson, commandLength);
+			}
+		}
+		dynamoteMetrics.record(METRIC_BLE_REASSEMBLY, micros() - reassemblyStartMicros);
+		dynamoteMetrics.beginRequest(reassemblyStartMicros);
+		uint8_t result = SEND_RESULT_NO_MEMORY;
+		if (command != NULL)
+			result = sendJsonRemoteCommand(command, commandLength, DynamoteAdmission::clientKey(TRANSPORT_BLE, 0, 0));
+		// a parse error usually means the rest of the command is still on its way.
+		// If we do not receive the next value within 1 second, we will stop and assume it failed
+		if (result != SEND_RESULT_PARSE_ERROR) {
+				dynamoteTimerWheel.cancel(&remoteSendTimer);
+				consumeRemoteCommand((command != NULL) ? commandLength : BLE_MAX_COMMAND_LENGTH);
+		}
+		else
+				dynamoteTimerWheel.schedule(&remoteSendTimer, BLE_REASSEMBLY_TIMEOUT_MS);
+		if (result == SEND_RESULT_RATE_LIMITED || result == SEND_RESULT_QUEUE_FULL || result == SEND_RESULT_NO_MEMORY) {
+				String resultJsonString = "{\"result\":" + String(result) + "}";
+				sendJsonStringOverBle(resultJsonString);
 		}
 	}
 
-  // If we do not receive the rest of the remote command over BLE within 1 second, we assume it failed
-  if (remoteSendTime != 0 && remoteSendTime + 1000 < millis()) {
-    remoteSendTime = 0;
-    remoteCommandJsonString = "";
-    Serial.println("remote command cleared");
+  if (sendMetricsFlag) {
+    sendMetricsFlag = false;
+    String metricsJsonString = "{\"type\":\"metrics\",\"metrics\":";
+    dynamoteMetrics.toJsonString(metricsJsonString);
+    metricsJsonString += "}";
+    sendJsonStringOverBle(metricsJsonString);
+  }
+
+  if (sendStatusFlag) {
+    sendStatusFlag = false;
+    // straight from the cached document, the envelope and uptime are put around it in place
+    uint16_t statusLength;
+    const char *statusJson = dynamoteStatus.toJson(&statusLength, "{\"type\":\"status\",\"status\":", "}");
+    sendJsonStringOverBle(statusJson, statusLength);
+  }
+
+  if (sendCapturesFlag) {
+    sendCapturesFlag = false;
+    String capturesJsonString = "{\"type\":\"captures\",\"captures\":";
+    dynamoteCaptureLog.toJsonString(capturesJsonString);
+    capturesJsonString += "}";
+    sendJsonStringOverBle(capturesJsonString);
+    dynamoteCaptureLog.acknowledge();
   }
 
-  RemoteCommand recordedCommand = dynamoteLoop();
-  if (recordedCommand.codeLength != 0)
+  // the record session is opened and closed here, the sessions belong to the loop task
+  if (recordEnableFlag) {
+    recordEnableFlag = false;
+    if (!recordEnable) {
+      closeRecordSession(DynamoteAdmission::clientKey(TRANSPORT_BLE, 0, 0));
+    }
+    else if (openRecordSession(DynamoteAdmission::clientKey(TRANSPORT_BLE, 0, 0), 0) == 0) {
+      String resultJsonString = "{\"result\":" + String(SEND_RESULT_RECORD_BUSY) + "}";
+      sendJsonStringOverBle(resultJsonString);
+    }
+  }
+
+  dynamoteLoop();
+  RemoteCommand recordedCommand = RemoteCommand();
+  if (takeRecordedCommand(DynamoteAdmission::clientKey(TRANSPORT_BLE, 0, 0), recordedCommand))
     sendRecordedCommandOverBle(recordedCommand);
 }
 
@@ -74,6 +135,20 @@ void DynamoteBLE::loop(void)
 void DynamoteBLE::setMtu(uint16_t _mtu)
 {
 	mtu = _mtu;
+	dynamoteStatus.invalidate();
+}
+
+/******************************************************************************************************************
+* buildStatus
+******************************************************************************************************************/
+void DynamoteBLE::buildStatus(JsonObject status, void *argument)
+{
+	DynamoteBLE *dynamote = (DynamoteBLE*)argument;
+	dynamote->addStatusToJson(status);
+
+	status["transport"] = "ble";
+	status["mtu"] = dynamote->mtu;
+	status["maxCommandLength"] = BLE_MAX_COMMAND_LENGTH;
 }
 
 /******************************************************************************************************************
@@ -81,7 +156,9 @@ void DynamoteBLE::setMtu(uint16_t _mtu)
 ******************************************************************************************************************/
 void DynamoteBLE::onBleDisconnected(void)
 {
-	setRemoteState(SEND);
+	recordEnable = false;
+	recordEnableFlag = true;
+	wakeLoop();
 }
 
 /******************************************************************************************************************
@@ -89,15 +166,48 @@ void DynamoteBLE::onBleDisconnected(void)
 ******************************************************************************************************************/
 void DynamoteBLE::onRemoteSendCharacteristic(uint8_t *data, uint16_t length)
 {
-	// If we do not receive the next value within 1 second, we will stop and assume it failed
-	remoteSendTime = millis();
+	uint32_t chunkMicros = micros();
+	dynamoteMetrics.count(COUNTER_BLE_CHUNKS);
 
-	for (uint16_t x = 0; x < length; x++) {
-		remoteCommandJsonString += (char)data[x];
+	bool tooLong;
+	{
+		DynamoteLockGuard guard(remoteCommandLock);
+		if (remoteCommandJsonLength == 0)
+			remoteSendStartMicros = chunkMicros;
+		tooLong = (length > BLE_MAX_COMMAND_LENGTH - remoteCommandJsonLength);
+		if (tooLong) {
+			remoteCommandJsonLength = 0;
+		}
+		else {
+			memcpy(&remoteCommandJson[remoteCommandJsonLength], data, length);
+			remoteCommandJsonLength += length;
+		}
+	}
+	if (tooLong) {
+		DYNAMOTE_LOG_WARNING("Warning, remote command is longer than %u bytes, dropping it", BLE_MAX_COMMAND_LENGTH);
+		dynamoteMetrics.drop(DROP_JSON_PARSE_ERROR);
+		return;
 	}
 
 	// Don't do the heavy lifting in the callback. Set a flag to do it in the loop.
-	sendRemoteCommandFlag = true;
+	__atomic_store_n(&sendRemoteCommandFlag, true, __ATOMIC_RELEASE);
+	wakeLoop();
+}
+
+/******************************************************************************************************************
+* consumeRemoteCommand
+******************************************************************************************************************/
+void DynamoteBLE::consumeRemoteCommand(uint16_t length)
+{
+	// drop the command that was handled, chunks of the next one that arrived meanwhile stay for the next round
+	DynamoteLockGuard guard(remoteCommandLock);
+	if (length >= remoteCommandJsonLength) {
+		remoteCommandJsonLength = 0;
+		return;
+	}
+	memmove(remoteCommandJson, &remoteCommandJson[length], remoteCommandJsonLength - length);
+	remoteCommandJsonLength -= length;
+	__atomic_store_n(&sendRemoteCommandFlag, true, __ATOMIC_RELEASE);
 }
 
 /******************************************************************************************************************
@@ -105,17 +215,56 @@ void DynamoteBLE::onRemoteSendCharacteristic(uint8_t *data, uint16_t length)
 ******************************************************************************************************************/
 void DynamoteBLE::onRemoteRecordEnableCharacteristic(uint8_t *data)
 {
-	if (data[0])
-		setRemoteState(RECORD);
-	else
-		setRemoteState(SEND);
+	onRemoteRecordEnableCharacteristic(data[0] != 0);
 }
 void DynamoteBLE::onRemoteRecordEnableCharacteristic(bool data)
 {
-	if (data)
-		setRemoteState(RECORD);
-	else
-		setRemoteState(SEND);
+	// Opening the record session is left to the loop, like sending commands
+	recordEnable = data;
+	recordEnableFlag = true;
+	wakeLoop();
+}
+
+/******************************************************************************************************************
+* onRemoteMetricsCharacteristic
+******************************************************************************************************************/
+void DynamoteBLE::onRemoteMetricsCharacteristic(void)
+{
+	// The metrics are sent back over the remoteRecordCharacteristic from the loop, as {"type":"metrics",...}
+	sendMetricsFlag = true;
+	wakeLoop();
+}
+
+/******************************************************************************************************************
+* onRemoteStatusCharacteristic
+******************************************************************************************************************/
+void DynamoteBLE::onRemoteStatusCharacteristic(void)
+{
+	// The status is sent back over the remoteRecordCharacteristic from the loop, as {"type":"status",...}
+	sendStatusFlag = true;
+	wakeLoop();
+}
+
+/******************************************************************************************************************
+* onRemoteCapturesCharacteristic
+******************************************************************************************************************/
+void DynamoteBLE::onRemoteCapturesCharacteristic(void)
+{
+	// The next capture records are sent back over the remoteRecordCharacteristic from the loop, as {"type":"captures",...}
+	sendCapturesFlag = true;
+	wakeLoop();
+}
+
+/******************************************************************************************************************
+* onRemoteSendTimeout
+******************************************************************************************************************/
+void DynamoteBLE::onRemoteSendTimeout(void *argument)
+{
+	// the rest of the remote command never arrived
+	DynamoteBLE *dynamote = (DynamoteBLE*)argument;
+	dynamote->consumeRemoteCommand(BLE_MAX_COMMAND_LENGTH);
+	DYNAMOTE_LOG_WARNING("remote command cleared");
+	dynamoteMetrics.drop(DROP_BLE_TIMEOUT);
 }
 
 /******************************************************************************************************************
@@ -123,24 +272,34 @@ void DynamoteBLE::onRemoteRecordEnableCharacteristic(bool data)
 ******************************************************************************************************************/
 void DynamoteBLE::sendRecordedCommandOverBle(RemoteCommand command) {
 
-  if (sendDataToRemoteRecordCharacteristicFxn == NULL)
-    return;
-
   //
   // serialize command to json string
   //
   String jsonString = "";
   serializeRemoteCommandToJsonString(command, jsonString);
+  sendJsonStringOverBle(jsonString);
+}
+
+/******************************************************************************************************************
+* sendJsonStringOverBle
+******************************************************************************************************************/
+void DynamoteBLE::sendJsonStringOverBle(String &jsonString) {
+  sendJsonStringOverBle(jsonString.c_str(), jsonString.length());
+}
+
+void DynamoteBLE::sendJsonStringOverBle(const char *json, uint16_t length) {
+
+  if (sendDataToRemoteRecordCharacteristicFxn == NULL)
+    return;
+  DynamoteMemoryProbe memoryProbe(MEMORY_BLE);
 
   uint16_t index = 0;
-  while(index < jsonString.length()) {
-
-    uint16_t charactreristicLength = min(mtu, (uint16_t)(jsonString.length()-index));
-    byte characteristicArray[charactreristicLength] = {0};
-    for (uint16_t x = 0; x < charactreristicLength; x++) 
-      characteristicArray[x] = jsonString.charAt(index++);
-    // write the array chunk over BLE
-    (*sendDataToRemoteRecordCharacteristicFxn)((byte*)&characteristicArray, charactreristicLength);
+  while(index < length) {
+
+    uint16_t charactreristicLength = min(mtu, (uint16_t)(length-index));
+    // write the chunk over BLE straight from the string
+    (*sendDataToRemoteRecordCharacteristicFxn)((byte*)&json[index], charactreristicLength);
+    index += charactreristicLength;
     delay(3);
   }
 }
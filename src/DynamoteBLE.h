@@ -25,9 +25,25 @@
 #define DYNAMOTE_REMOTE_SEND_CHARACTERISTIC_UUID            "5e4d2bf6-29ec-4a1b-8649-259568488e7b"
 #define DYNAMOTE_REMOTE_RECORD_CHARACTERISTIC_UUID          "608b70d9-5ee2-4380-a0f4-8a629578f19b"
 #define DYNAMOTE_REMOTE_RECORD_ENABLE_CHARACTERISTIC_UUID   "37141628-d6d9-45bd-af90-e297a92b6953"
+#define DYNAMOTE_REMOTE_METRICS_CHARACTERISTIC_UUID         "b3f1c2d4-6a1e-4c6f-9d2b-5f8e7a0c1d93"
+#define DYNAMOTE_REMOTE_CAPTURES_CHARACTERISTIC_UUID        "c6a0e5b2-3d7f-4e19-8b4a-2f9d1c7e5a60"
+#define DYNAMOTE_REMOTE_STATUS_CHARACTERISTIC_UUID          "e2b7c9d4-58a1-4f63-9c0e-7d3a6b1f4e82"
 
 #define DEFAULT_MTU     20
 
+// The rest of a chunked remote command must arrive within this time
+#define BLE_REASSEMBLY_TIMEOUT_MS     1000
+
+// Longest remote command that can be put back together from its chunks
+#define BLE_MAX_COMMAND_LENGTH        1024
+
+// The BLE callbacks wake the loop on the ESP32, so it only has to wake up for timers
+#if defined(ESP32)
+#define BLE_IDLE_MAX_SLEEP_MS         100
+#else
+#define BLE_IDLE_MAX_SLEEP_MS         IDLE_POLL_MS
+#endif
+
 class DynamoteBLE : public Dynamote {
 
 	public:
@@ -39,13 +55,30 @@ class DynamoteBLE : public Dynamote {
 		void onRemoteSendCharacteristic(uint8_t *data, uint16_t dataLength);
 		void onRemoteRecordEnableCharacteristic(uint8_t *data);
 		void onRemoteRecordEnableCharacteristic(bool data);
+		void onRemoteMetricsCharacteristic(void);
+		void onRemoteStatusCharacteristic(void);
+		void onRemoteCapturesCharacteristic(void);
 
 	private:
 		uint16_t mtu = DEFAULT_MTU;
-		unsigned long remoteSendTime = 0;
-		String remoteCommandJsonString = "";
+		DynamoteTimer remoteSendTimer;
+		static void onRemoteSendTimeout(void *argument);
+		static void buildStatus(JsonObject status, void *argument);
+		uint32_t remoteSendStartMicros = 0;
+		// the BLE callback appends chunks while the loop parses a copy, both under remoteCommandLock
+		DynamoteLock remoteCommandLock;
+		char remoteCommandJson[BLE_MAX_COMMAND_LENGTH];
+		uint16_t remoteCommandJsonLength = 0;
 		bool sendRemoteCommandFlag = false;
+		void consumeRemoteCommand(uint16_t length);
+		bool sendMetricsFlag = false;
+		bool sendStatusFlag = false;
+		bool sendCapturesFlag = false;
+		bool recordEnableFlag = false;
+		bool recordEnable = false;
 		void sendRecordedCommandOverBle(RemoteCommand command);
+		void sendJsonStringOverBle(String &jsonString);
+		void sendJsonStringOverBle(const char *json, uint16_t length);
 
 		void (*sendDataToRemoteRecordCharacteristicFxn)(byte*, uint8_t);
 };
@@ -0,0 +1,217 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "DynamoteCapture.h"
+
+#define FNV_PRIME_32      16777619
+#define FNV_BASIS_32      2166136261
+
+/******************************************************************************************************************
+* DynamoteCapture constructor
+******************************************************************************************************************/
+DynamoteCapture::DynamoteCapture(void) {}
+
+/******************************************************************************************************************
+* reset
+******************************************************************************************************************/
+void DynamoteCapture::reset(void)
+{
+	clusterCount = 0;
+	frameCount = 0;
+	lastFrameTime = 0;
+}
+
+/******************************************************************************************************************
+* addFrame
+******************************************************************************************************************/
+bool DynamoteCapture::addFrame(uint8_t codeProtocol, uint32_t codeValue, uint8_t codeLength, volatile uint16_t *raw, unsigned long now)
+{
+	lastFrameTime = now;
+	if (frameCount < 0xFF)
+		frameCount++;
+
+	uint32_t hash = (raw != NULL) ? hashRawFrame(raw, codeLength) : codeValue;
+
+	//
+	// find the cluster this frame belongs to
+	//
+	for (uint8_t x = 0; x < clusterCount; x++) {
+		CaptureCluster *cluster = &clusters[x];
+		if (cluster->hash != hash || cluster->codeProtocol != codeProtocol || cluster->codeLength != codeLength)
+			continue;
+		if (raw == NULL) {
+			if (cluster->codeValue != codeValue)
+				continue;
+		}
+		else {
+			// the hash only looks at the shape of the frame, make sure the timings are actually close
+			bool matches = true;
+			for (uint8_t y = 0; y < codeLength && matches; y++)
+				matches = isSameDuration(cluster->rawAverages[y], raw[y]);
+			if (!matches)
+				continue;
+		}
+		if (cluster->count < 0xFF)
+			cluster->count++;
+		if (raw != NULL) {
+			// move each average a 1/count step towards the new timing, rounded to the nearest us
+			for (uint8_t y = 0; y < codeLength; y++) {
+				int32_t difference = (int32_t)raw[y] - cluster->rawAverages[y];
+				int32_t half = (difference < 0) ? -(cluster->count / 2) : cluster->count / 2;
+				cluster->rawAverages[y] += (difference + half) / cluster->count;
+			}
+		}
+		return false;
+	}
+
+	//
+	// start a new cluster, if there is room
+	//
+	if (clusterCount >= CAPTURE_MAX_CLUSTERS)
+		return false;
+
+	CaptureCluster *cluster = &clusters[clusterCount++];
+	cluster->hash = hash;
+	cluster->codeProtocol = codeProtocol;
+	cluster->codeValue = codeValue;
+	cluster->codeLength = codeLength;
+	cluster->count = 1;
+	if (raw != NULL) {
+		for (uint8_t y = 0; y < codeLength; y++)
+			cluster->rawAverages[y] = raw[y];
+	}
+	return true;
+}
+
+/******************************************************************************************************************
+* isCapturing
+******************************************************************************************************************/
+bool DynamoteCapture::isCapturing(void)
+{
+	// frames of a press that getCommand() has not handed out yet
+	return clusterCount != 0;
+}
+
+/******************************************************************************************************************
+* addRepeatFrame
+******************************************************************************************************************/
+void DynamoteCapture::addRepeatFrame(unsigned long now)
+{
+	// a repeat frame carries no data, it only means the button is still held
+	if (frameCount != 0)
+		lastFrameTime = now;
+}
+
+/******************************************************************************************************************
+* getCommand
+******************************************************************************************************************/
+bool DynamoteCapture::getCommand(uint8_t *codeProtocol, uint32_t *codeValue, uint8_t *codeLength, uint16_t *raw, uint8_t *confidence, unsigned long now)
+{
+	// wait until the button press is over
+	if (clusterCount == 0 || now - lastFrameTime < CAPTURE_PRESS_GAP_MS)
+		return false;
+
+	// the most common frame wins
+	CaptureCluster *best = &clusters[0];
+	for (uint8_t x = 1; x < clusterCount; x++) {
+		if (clusters[x].count > best->count)
+			best = &clusters[x];
+	}
+
+	*codeProtocol = best->codeProtocol;
+	*codeValue = best->codeValue;
+	*codeLength = best->codeLength;
+	*confidence = (uint16_t)best->count * 100 / frameCount;
+
+	if (raw != NULL && best->codeProtocol == UNKNOWN) {
+		for (uint8_t y = 0; y < best->codeLength; y++)
+			raw[y] = best->rawAverages[y];
+		quantizeRawFrame(raw, best->codeLength);
+	}
+
+	reset();
+	return true;
+}
+
+/******************************************************************************************************************
+* hashRawFrame
+******************************************************************************************************************/
+uint32_t DynamoteCapture::hashRawFrame(volatile uint16_t *raw, uint8_t length)
+{
+	// Same idea as IRLib2's hash decoder: only record whether each mark (or space) is shorter, equal or
+	// longer than the previous one, so small jitter in the timings does not change the hash
+	uint32_t hash = FNV_BASIS_32;
+	for (uint8_t x = 0; x + 2 < length; x++) {
+		uint8_t compare;
+		if (raw[x + 2] * 10 < raw[x] * 8)
+			compare = 0;
+		else if (raw[x] * 10 < raw[x + 2] * 8)
+			compare = 2;
+		else
+			compare = 1;
+		hash = (hash * FNV_PRIME_32) ^ compare;
+	}
+	return hash;
+}
+
+/******************************************************************************************************************
+* isSameDuration
+******************************************************************************************************************/
+bool DynamoteCapture::isSameDuration(uint32_t a, uint32_t b)
+{
+	uint32_t difference = (a > b) ? a - b : b - a;
+	return difference <= CAPTURE_TOLERANCE_US || difference * 4 <= max(a, b);
+}
+
+/******************************************************************************************************************
+* quantizeRawFrame
+******************************************************************************************************************/
+void DynamoteCapture::quantizeRawFrame(uint16_t *raw, uint8_t length)
+{
+	// Group the marks and the spaces into a few canonical durations and replace every timing with the
+	// average of its group. Marks (even index) and spaces (odd index) are grouped separately because
+	// most receivers stretch marks and shorten spaces.
+	for (uint8_t parity = 0; parity < 2; parity++) {
+		uint32_t sums[CAPTURE_MAX_CANONICAL_DURATIONS];
+		uint8_t counts[CAPTURE_MAX_CANONICAL_DURATIONS];
+		uint8_t groups[RECV_BUF_LENGTH];
+		uint8_t groupCount = 0;
+
+		for (uint8_t x = parity; x < length; x += 2) {
+			uint8_t group = 0;
+			while (group < groupCount && !isSameDuration(sums[group] / counts[group], raw[x]))
+				group++;
+			if (group == groupCount) {
+				if (groupCount == CAPTURE_MAX_CANONICAL_DURATIONS) {
+					// too many distinct durations, leave this one as it is
+					groups[x] = 0xFF;
+					continue;
+				}
+				sums[group] = 0;
+				counts[group] = 0;
+				groupCount++;
+			}
+			sums[group] += raw[x];
+			counts[group]++;
+			groups[x] = group;
+		}
+
+		for (uint8_t x = parity; x < length; x += 2) {
+			if (groups[x] != 0xFF)
+				raw[x] = (sums[groups[x]] + counts[groups[x]] / 2) / counts[groups[x]];
+		}
+	}
+}
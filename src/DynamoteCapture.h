@@ -0,0 +1,69 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTECAPTURE_H
+#define DYNAMOTECAPTURE_H
+
+#include "Arduino.h"
+#include "IRLibGlobals.h"
+#include "IRLibProtocols.h"
+
+// A button press is considered over once no frame has been received for this long.
+// NEC repeats arrive every ~108ms and RC5/RC6/Sony resends are closer together than that.
+#define CAPTURE_PRESS_GAP_MS            250
+
+// Number of distinct frames tracked per button press. Frames that do not fit are counted as outliers.
+#define CAPTURE_MAX_CLUSTERS            3
+
+// Two raw timings are considered the same if they are within 25% of each other, or within this many us
+#define CAPTURE_TOLERANCE_US            150
+
+// Most distinct mark or space durations kept when quantizing a raw frame
+#define CAPTURE_MAX_CANONICAL_DURATIONS 16
+
+typedef struct
+{
+	uint32_t hash;                      // hash of the frame, see hashRawFrame()
+	uint8_t codeProtocol;
+	uint32_t codeValue;
+	uint8_t codeLength;
+	uint8_t count;                      // number of frames in this cluster
+	uint16_t rawAverages[RECV_BUF_LENGTH]; // running average of each raw timing, used to average jitter away
+} CaptureCluster;
+
+class DynamoteCapture
+{
+	public:
+		DynamoteCapture(void);
+		void reset(void);
+		// returns false if the frame was a duplicate of (or an outlier to) an earlier frame of this press
+		bool addFrame(uint8_t codeProtocol, uint32_t codeValue, uint8_t codeLength, volatile uint16_t *raw, unsigned long now);
+		void addRepeatFrame(unsigned long now);
+		bool isCapturing(void);
+		bool getCommand(uint8_t *codeProtocol, uint32_t *codeValue, uint8_t *codeLength, uint16_t *raw, uint8_t *confidence, unsigned long now);
+		// also used for plain raw codes sent by clients that have more distinct durations than the dictionary holds
+		static void quantizeRawFrame(uint16_t *raw, uint8_t length);
+
+	private:
+		CaptureCluster clusters[CAPTURE_MAX_CLUSTERS];
+		uint8_t clusterCount = 0;
+		uint8_t frameCount = 0;
+		unsigned long lastFrameTime = 0;
+		uint32_t hashRawFrame(volatile uint16_t *raw, uint8_t length);
+		static bool isSameDuration(uint32_t a, uint32_t b);
+};
+
+#endif
@@ -0,0 +1,205 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+// Dynamote.h first, it holds the DYNAMOTE_CAPTURE_LOG option
+#include "Dynamote.h"
+#include "DynamoteCaptureLog.h"
+
+DynamoteCaptureLog dynamoteCaptureLog;
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static void append(String &destination, const char *text) { destination += text; }
+static void append(Print &destination, const char *text) { destination.print(text); }
+
+/******************************************************************************************************************
+* DynamoteCaptureLog constructor
+******************************************************************************************************************/
+DynamoteCaptureLog::DynamoteCaptureLog(void) {}
+
+#if defined(DYNAMOTE_CAPTURE_LOG)
+
+/******************************************************************************************************************
+* write
+******************************************************************************************************************/
+void DynamoteCaptureLog::write(const CaptureFrame &frame, const CaptureProbe *probes, uint8_t probeCount, volatile uint16_t *edges, uint8_t edgeCount)
+{
+	uint16_t length = CAPTURE_RECORD_HEADER_LENGTH + probeCount * CAPTURE_PROBE_LENGTH + edgeCount * 2;
+	uint16_t currentHead = head;
+	uint16_t currentTail = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+	uint16_t freeSpace = (currentTail + CAPTURE_LOG_BUFFER_SIZE - currentHead - 1) % CAPTURE_LOG_BUFFER_SIZE;
+	if (length > freeSpace) {
+		droppedCount++;
+		return;
+	}
+
+	uint8_t header[CAPTURE_RECORD_HEADER_LENGTH] = {
+		CAPTURE_RECORD_MAGIC, frame.flags,
+		(uint8_t)frame.timestamp, (uint8_t)(frame.timestamp >> 8), (uint8_t)(frame.timestamp >> 16), (uint8_t)(frame.timestamp >> 24),
+		frame.protocol, frame.bits,
+		(uint8_t)frame.value, (uint8_t)(frame.value >> 8), (uint8_t)(frame.value >> 16), (uint8_t)(frame.value >> 24),
+		(uint8_t)frame.decodeMicros, (uint8_t)(frame.decodeMicros >> 8),
+		probeCount, edgeCount
+	};
+	put(currentHead, header, sizeof(header));
+	for (uint8_t x = 0; x < probeCount; x++) {
+		uint8_t probe[CAPTURE_PROBE_LENGTH] = { probes[x].protocol, (uint8_t)probes[x].micros, (uint8_t)(probes[x].micros >> 8) };
+		put(currentHead, probe, sizeof(probe));
+	}
+	for (uint8_t x = 0; x < edgeCount; x++) {
+		uint8_t edge[2] = { (uint8_t)edges[x], (uint8_t)(edges[x] >> 8) };
+		put(currentHead, edge, sizeof(edge));
+	}
+	__atomic_store_n(&head, currentHead, __ATOMIC_RELEASE);
+}
+
+/******************************************************************************************************************
+* read
+******************************************************************************************************************/
+uint16_t DynamoteCaptureLog::read(uint8_t *destination, uint16_t size)
+{
+	uint16_t position = tail;
+	uint16_t currentHead = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	uint16_t copied = 0;
+	while (position != currentHead) {
+		uint16_t length = recordLength(position);
+		if (copied + length > size)
+			break;
+		for (uint16_t x = 0; x < length; x++) {
+			destination[copied++] = buffer[position];
+			position = (position + 1) % CAPTURE_LOG_BUFFER_SIZE;
+		}
+	}
+	return copied;
+}
+
+/******************************************************************************************************************
+* remove
+******************************************************************************************************************/
+void DynamoteCaptureLog::remove(uint16_t length)
+{
+	__atomic_store_n(&tail, (uint16_t)((tail + length) % CAPTURE_LOG_BUFFER_SIZE), __ATOMIC_RELEASE);
+}
+
+/******************************************************************************************************************
+* hasMore
+******************************************************************************************************************/
+bool DynamoteCaptureLog::hasMore(uint16_t length)
+{
+	uint16_t currentHead = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	return (currentHead + CAPTURE_LOG_BUFFER_SIZE - tail) % CAPTURE_LOG_BUFFER_SIZE > length;
+}
+
+/******************************************************************************************************************
+* getDroppedCount
+******************************************************************************************************************/
+uint32_t DynamoteCaptureLog::getDroppedCount(void)
+{
+	return droppedCount;
+}
+
+/******************************************************************************************************************
+* put
+******************************************************************************************************************/
+void DynamoteCaptureLog::put(uint16_t &position, const void *data, uint16_t length)
+{
+	for (uint16_t x = 0; x < length; x++) {
+		buffer[position] = ((const uint8_t*)data)[x];
+		position = (position + 1) % CAPTURE_LOG_BUFFER_SIZE;
+	}
+}
+
+/******************************************************************************************************************
+* recordLength
+******************************************************************************************************************/
+uint16_t DynamoteCaptureLog::recordLength(uint16_t position)
+{
+	// the counts are the last two bytes of the header
+	uint8_t probeCount = buffer[(position + CAPTURE_RECORD_HEADER_LENGTH - 2) % CAPTURE_LOG_BUFFER_SIZE];
+	uint8_t edgeCount = buffer[(position + CAPTURE_RECORD_HEADER_LENGTH - 1) % CAPTURE_LOG_BUFFER_SIZE];
+	return CAPTURE_RECORD_HEADER_LENGTH + probeCount * CAPTURE_PROBE_LENGTH + edgeCount * 2;
+}
+
+#else
+
+void DynamoteCaptureLog::write(const CaptureFrame &frame, const CaptureProbe *probes, uint8_t probeCount, volatile uint16_t *edges, uint8_t edgeCount) {}
+uint16_t DynamoteCaptureLog::read(uint8_t *destination, uint16_t size) { return 0; }
+void DynamoteCaptureLog::remove(uint16_t length) {}
+bool DynamoteCaptureLog::hasMore(uint16_t length) { return false; }
+uint32_t DynamoteCaptureLog::getDroppedCount(void) { return 0; }
+
+#endif
+
+/******************************************************************************************************************
+* writeJson
+******************************************************************************************************************/
+template <typename Destination> void DynamoteCaptureLog::writeJson(Destination &destination)
+{
+	// hex, the same as the packed symbols of compressed raw codes. A single record can be larger than the export
+	// size, it is then handed out on its own.
+	DynamoteArenaScope arenaScope;
+	uint8_t *records = (uint8_t*)dynamoteArena.allocate(max(CAPTURE_LOG_EXPORT_SIZE, CAPTURE_RECORD_MAX_LENGTH));
+	uint16_t length = 0;
+	if (records != NULL) {
+		length = read(records, CAPTURE_LOG_EXPORT_SIZE);
+		if (length == 0)
+			length = read(records, CAPTURE_RECORD_MAX_LENGTH);
+	}
+	bool more = hasMore(length);
+	exportedLength = length;
+
+	// the hex goes out a few bytes at a time, there is no copy of the whole export
+	char text[33];
+	append(destination, "{\"captures\":\"");
+	for (uint16_t x = 0; x < length; x += 16) {
+		uint8_t count = min(length - x, 16);
+		for (uint8_t y = 0; y < count; y++) {
+			text[y*2] = hexDigits[records[x + y] >> 4];
+			text[y*2 + 1] = hexDigits[records[x + y] & 0x0F];
+		}
+		text[count*2] = 0;
+		append(destination, text);
+	}
+	snprintf(text, sizeof(text), "\",\"dropped\":%lu,\"more\":", (unsigned long)getDroppedCount());
+	append(destination, text);
+	append(destination, more ? "true}" : "false}");
+}
+
+/******************************************************************************************************************
+* toJsonString
+******************************************************************************************************************/
+void DynamoteCaptureLog::toJsonString(String &destinationBuffer)
+{
+	destinationBuffer.reserve(destinationBuffer.length() + CAPTURE_LOG_EXPORT_SIZE * 2 + 64);
+	writeJson(destinationBuffer);
+}
+
+/******************************************************************************************************************
+* toJson
+******************************************************************************************************************/
+void DynamoteCaptureLog::toJson(Print &output)
+{
+	writeJson(output);
+}
+
+/******************************************************************************************************************
+* acknowledge
+******************************************************************************************************************/
+void DynamoteCaptureLog::acknowledge(void)
+{
+	remove(exportedLength);
+	exportedLength = 0;
+}
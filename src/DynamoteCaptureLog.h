@@ -0,0 +1,111 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTECAPTURELOG_H
+#define DYNAMOTECAPTURELOG_H
+
+#include "Arduino.h"
+#include "IRLibGlobals.h"
+
+// Size of the RAM ring that holds capture records until a transport picks them up
+#ifndef CAPTURE_LOG_BUFFER_SIZE
+#define CAPTURE_LOG_BUFFER_SIZE         2048
+#endif
+
+// Most record bytes handed out per export, twice this in hex has to fit a response or a WebSocket message
+#define CAPTURE_LOG_EXPORT_SIZE         384
+
+// Most decoders tried on one frame, every IRLib2 protocol plus the hash decoder
+#define CAPTURE_MAX_PROBES              13
+
+/******************************************************************************************************************
+* Capture record, all values little endian
+*
+*   uint8_t  magic                  CAPTURE_RECORD_MAGIC
+*   uint8_t  flags                  CAPTURE_FLAG_REPLAY
+*   uint32_t timestamp              micros() when the receiver handed the frame over
+*   uint8_t  protocol               decode result, 0 (UNKNOWN) if only the hash decoder matched
+*   uint8_t  bits
+*   uint32_t value
+*   uint16_t decodeMicros           time spent in all decoders together
+*   uint8_t  probe count
+*   uint8_t  edge count
+*   per probe, in the order they were tried:
+*     uint8_t  protocol             0 for the hash decoder
+*     uint16_t micros
+*   per edge:
+*     uint16_t duration             us, marks and spaces alternate starting with a mark
+*
+* Records follow each other without padding, the length of each one follows from its counts.
+******************************************************************************************************************/
+#define CAPTURE_RECORD_MAGIC            0xCA
+#define CAPTURE_FLAG_REPLAY             0x01
+#define CAPTURE_RECORD_HEADER_LENGTH    16
+#define CAPTURE_PROBE_LENGTH            3
+#define CAPTURE_RECORD_MAX_LENGTH       (CAPTURE_RECORD_HEADER_LENGTH + CAPTURE_MAX_PROBES * CAPTURE_PROBE_LENGTH + RECV_BUF_LENGTH * 2)
+
+typedef struct
+{
+	uint8_t flags;
+	uint32_t timestamp;
+	uint8_t protocol;
+	uint8_t bits;
+	uint32_t value;
+	uint16_t decodeMicros;
+} CaptureFrame;
+
+typedef struct
+{
+	uint8_t protocol;
+	uint16_t micros;
+} CaptureProbe;
+
+class DynamoteCaptureLog
+{
+	public:
+		DynamoteCaptureLog(void);
+		// called by the decoder side, drops the record if the ring is full
+		void write(const CaptureFrame &frame, const CaptureProbe *probes, uint8_t probeCount, volatile uint16_t *edges, uint8_t edgeCount);
+		// copies out whole records, as many as fit, and leaves them in the ring
+		uint16_t read(uint8_t *destination, uint16_t size);
+		// removes the given number of bytes read before, from the front of the ring
+		void remove(uint16_t length);
+		// true if there is more in the ring than the given number of bytes
+		bool hasMore(uint16_t length);
+		// {"captures":"<records in hex>","dropped":n,"more":true}. The records stay in the ring until acknowledge()
+		// is called once the reply has gone out, so a reply that is lost hands out the same records again.
+		void toJsonString(String &destinationBuffer);
+		void toJson(Print &output);
+		void acknowledge(void);
+		uint32_t getDroppedCount(void);
+
+	private:
+		uint16_t exportedLength = 0;        // bytes handed out by the last export
+		template <typename Destination> void writeJson(Destination &destination);
+#if defined(DYNAMOTE_CAPTURE_LOG)
+		// single producer (the decoder), single consumer (the transports), like DynamoteLog
+		uint8_t buffer[CAPTURE_LOG_BUFFER_SIZE];
+		uint16_t head = 0;
+		uint16_t tail = 0;
+		uint32_t droppedCount = 0;
+		void put(uint16_t &position, const void *data, uint16_t length);
+		uint16_t recordLength(uint16_t position);
+#endif
+};
+
+extern DynamoteCaptureLog dynamoteCaptureLog;
+
+#endif
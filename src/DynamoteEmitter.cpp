@@ -0,0 +1,115 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+// Dynamote.h first, it holds the DYNAMOTE_LOG_LEVEL option
+#include "Dynamote.h"
+#include "DynamoteEmitter.h"
+#if defined(ESP32)
+
+/******************************************************************************************************************
+* DynamoteEmitter constructor
+******************************************************************************************************************/
+DynamoteEmitter::DynamoteEmitter(void) {}
+
+/******************************************************************************************************************
+* begin
+******************************************************************************************************************/
+void DynamoteEmitter::begin(uint8_t pin, uint8_t channel)
+{
+	rmtChannel = (rmt_channel_t)channel;
+
+	rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)pin, rmtChannel);
+	config.clk_div = 80;                                // 1us per tick
+	config.tx_config.carrier_en = true;
+	config.tx_config.carrier_freq_hz = 38000;
+	config.tx_config.carrier_duty_percent = 33;
+	config.tx_config.carrier_level = RMT_CARRIER_LEVEL_HIGH;
+	config.tx_config.idle_output_en = true;
+	config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+	if (rmt_config(&config) != ESP_OK || rmt_driver_install(rmtChannel, 0, 0) != ESP_OK) {
+		DYNAMOTE_LOG_ERROR("Error, could not set up the IR emitter on pin %u", pin);
+		return;
+	}
+	carrierKhz = 38;
+	started = true;
+}
+
+/******************************************************************************************************************
+* send
+******************************************************************************************************************/
+void DynamoteEmitter::send(const uint16_t *durations, uint16_t length, uint8_t khz)
+{
+	if (!started || length == 0)
+		return;
+
+	// the previous transmission still owns the items
+	rmt_wait_tx_done(rmtChannel, portMAX_DELAY);
+	setCarrier(khz);
+
+	// fill the items half by half, splitting anything longer than an item can hold
+	uint16_t half = 0;
+	for (uint16_t x = 0; x < length; x++) {
+		uint32_t remaining = durations[x];
+		uint8_t level = (x & 1) ? 0 : 1;
+		while (remaining > 0 && half < EMITTER_MAX_ITEMS * 2) {
+			uint16_t duration = min(remaining, (uint32_t)EMITTER_MAX_ITEM_DURATION);
+			rmt_item32_t *item = &items[half / 2];
+			if (half & 1) {
+				item->duration1 = duration;
+				item->level1 = level;
+			}
+			else {
+				item->duration0 = duration;
+				item->level0 = level;
+			}
+			remaining -= duration;
+			half++;
+		}
+	}
+	// pad the last item, a zero duration ends the transmission
+	if (half & 1) {
+		items[half / 2].duration1 = 0;
+		items[half / 2].level1 = 0;
+		half++;
+	}
+
+	rmt_write_items(rmtChannel, items, half / 2, false);
+}
+
+/******************************************************************************************************************
+* isBusy
+******************************************************************************************************************/
+bool DynamoteEmitter::isBusy(void)
+{
+	return started && rmt_wait_tx_done(rmtChannel, 0) == ESP_ERR_TIMEOUT;
+}
+
+/******************************************************************************************************************
+* setCarrier
+******************************************************************************************************************/
+void DynamoteEmitter::setCarrier(uint8_t khz)
+{
+	if (khz == carrierKhz)
+		return;
+	carrierKhz = khz;
+
+	// the carrier is counted in APB clock cycles, not in the divided ticks, with a 1/3 duty cycle
+	uint16_t period = APB_CLK_FREQ / ((uint32_t)khz * 1000);
+	uint16_t high = period / 3;
+	rmt_set_tx_carrier(rmtChannel, true, high, period - high, RMT_CARRIER_LEVEL_HIGH);
+}
+
+#endif
@@ -0,0 +1,52 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEEMITTER_H
+#define DYNAMOTEEMITTER_H
+
+#include "Arduino.h"
+#include "DynamoteEncoder.h"
+
+#if defined(ESP32)
+#include "driver/rmt.h"
+
+// One RMT item holds a mark and a space, plus one for splitting long spaces
+#define EMITTER_MAX_ITEMS           (ENCODER_MAX_DURATIONS / 2 + 8)
+
+// Longest duration a single RMT item half can hold, in us
+#define EMITTER_MAX_ITEM_DURATION   32767
+
+// An extra IR output driven by one RMT channel. The RMT hardware generates the carrier and walks through the
+// timings on its own, so send() returns right away and several emitters can transmit at the same time.
+class DynamoteEmitter
+{
+	public:
+		DynamoteEmitter(void);
+		void begin(uint8_t pin, uint8_t channel);
+		void send(const uint16_t *durations, uint16_t length, uint8_t khz);
+		bool isBusy(void);
+
+	private:
+		rmt_channel_t rmtChannel = RMT_CHANNEL_0;
+		bool started = false;
+		uint8_t carrierKhz = 0;
+		// read by the RMT driver while the transmission is running, so it belongs to the emitter
+		rmt_item32_t items[EMITTER_MAX_ITEMS];
+		void setCarrier(uint8_t khz);
+};
+
+#endif
+#endif
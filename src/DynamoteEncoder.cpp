@@ -0,0 +1,213 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <Dynamote.h>
+#include "DynamoteEncoder.h"
+
+typedef void (DynamoteEncoder::*ProtocolEncoder)(uint32_t codeValue, uint8_t codeLength);
+
+// Protocols left out of DYNAMOTE_PROTOCOLS, or only sent by IRLib2, have no encoder. The entry folds to NULL at
+// compile time, so the linker drops their encodeProtocol<> again.
+#define PROTOCOL_ENCODER(protocol) \
+	((DYNAMOTE_HAS_PROTOCOL(protocol) && protocolDescriptors[protocol].coding != PROTOCOL_CODING_IRLIB) ? \
+		&DynamoteEncoder::encodeProtocol<protocol> : NULL)
+
+/******************************************************************************************************************
+* DynamoteEncoder constructor
+******************************************************************************************************************/
+DynamoteEncoder::DynamoteEncoder(void) {}
+
+/******************************************************************************************************************
+* encode
+******************************************************************************************************************/
+uint16_t DynamoteEncoder::encode(uint8_t codeProtocol, uint32_t codeValue, uint8_t codeLength, uint16_t *durations, uint8_t *khz)
+{
+	static const ProtocolEncoder encoders[] = {
+		NULL,
+		PROTOCOL_ENCODER(NEC),
+		PROTOCOL_ENCODER(SONY),
+		PROTOCOL_ENCODER(RC5),
+		PROTOCOL_ENCODER(RC6),
+		PROTOCOL_ENCODER(PANASONIC_OLD),
+		PROTOCOL_ENCODER(JVC),
+		PROTOCOL_ENCODER(NECX),
+		NULL,                               // SAMSUNG36
+		PROTOCOL_ENCODER(GICABLE),
+		NULL,                               // DIRECTV
+		PROTOCOL_ENCODER(RCMM),
+		NULL                                // CYKM
+	};
+	static_assert(sizeof(encoders) / sizeof(encoders[0]) == PROTOCOL_DESCRIPTOR_COUNT, "one encoder per protocol descriptor");
+
+	if (codeProtocol >= PROTOCOL_DESCRIPTOR_COUNT || encoders[codeProtocol] == NULL)
+		return 0;
+
+	output = durations;
+	length = 0;
+	overflow = false;
+	*khz = protocolDescriptors[codeProtocol].khz;
+	(this->*encoders[codeProtocol])(codeValue, codeLength);
+	return overflow ? 0 : length;
+}
+
+/******************************************************************************************************************
+* encodeProtocol
+******************************************************************************************************************/
+template <uint8_t protocol> void DynamoteEncoder::encodeProtocol(uint32_t codeValue, uint8_t codeLength)
+{
+	constexpr const DynamoteProtocolDescriptor &descriptor = protocolDescriptors[protocol];
+
+	// the separate repeat frame of NEC and GICable
+	if (descriptor.repeat == PROTOCOL_REPEAT_CODE && codeValue == REPEAT_CODE) {
+		mark(descriptor.headMark);
+		space(descriptor.headSpace / 2);
+		mark(descriptor.markOne);
+		return;
+	}
+
+	// like IRLib2, a codeLength of 0 picks the usual length, except for JVC where it means a repeat frame
+	uint8_t bits = (descriptor.fixedBits || codeLength == 0) ? descriptor.defaultBits : codeLength;
+	bool header = !(descriptor.repeat == PROTOCOL_REPEAT_NO_HEADER && codeLength == 0);
+
+	uint32_t frameExtentUs = protocolFrameExtentUs(protocol, bits);
+	for (uint8_t frame = 0; frame < descriptor.frames; frame++) {
+		uint16_t start = length;
+		encodeFrame<protocol>(codeValue, bits, header);
+		if (frameExtentUs != 0 && frame + 1 < descriptor.frames)
+			space(frameExtentUs - min(frameDuration(start), frameExtentUs));
+	}
+}
+
+/******************************************************************************************************************
+* encodeFrame
+******************************************************************************************************************/
+template <uint8_t protocol> void DynamoteEncoder::encodeFrame(uint32_t codeValue, uint8_t bits, bool header)
+{
+	constexpr const DynamoteProtocolDescriptor &descriptor = protocolDescriptors[protocol];
+
+	// the coding is a constant here, so only one of these branches is compiled into each encoder
+	if (descriptor.coding == PROTOCOL_CODING_DISTANCE) {
+		// most significant bit first
+		if (header && descriptor.headMark)
+			mark(descriptor.headMark);
+		if (header && descriptor.headSpace)
+			space(descriptor.headSpace);
+		for (int8_t bit = bits - 1; bit >= 0; bit--) {
+			if (codeValue & ((uint32_t)1 << bit)) {
+				mark(descriptor.markOne);
+				space(descriptor.spaceOne);
+			}
+			else {
+				mark(descriptor.markZero);
+				space(descriptor.spaceZero);
+			}
+		}
+		if (descriptor.stopBit)
+			mark(descriptor.markOne);
+	}
+
+	else if (descriptor.coding == PROTOCOL_CODING_RC5) {
+		// a one is a space then a mark. The first start bit is implied.
+		mark(descriptor.markOne);
+		for (int8_t bit = bits - 1; bit >= 0; bit--) {
+			if (codeValue & ((uint32_t)1 << bit)) {
+				space(descriptor.markOne);
+				mark(descriptor.markOne);
+			}
+			else {
+				mark(descriptor.markOne);
+				space(descriptor.markOne);
+			}
+		}
+	}
+
+	else if (descriptor.coding == PROTOCOL_CODING_RC6) {
+		mark(descriptor.headMark);
+		space(descriptor.headSpace);
+		// start bit, then the data where the toggle bit is twice as long
+		mark(descriptor.markOne);
+		space(descriptor.markOne);
+		for (int8_t bit = bits - 1; bit >= 0; bit--) {
+			uint16_t time = (bit == bits - descriptor.toggleBit) ? descriptor.markOne * 2 : descriptor.markOne;
+			if (codeValue & ((uint32_t)1 << bit)) {
+				mark(time);
+				space(time);
+			}
+			else {
+				space(time);
+				mark(time);
+			}
+		}
+	}
+
+	else if (descriptor.coding == PROTOCOL_CODING_RCMM) {
+		// two bits per symbol, the symbol is in the length of the space
+		mark(descriptor.headMark);
+		space(descriptor.headSpace);
+		for (int8_t bit = bits - 2; bit >= 0; bit -= 2) {
+			mark(descriptor.markOne);
+			space(descriptor.spaceZero + descriptor.spaceOne * ((codeValue >> bit) & 3));
+		}
+		mark(descriptor.markOne);
+	}
+}
+
+/******************************************************************************************************************
+* mark
+******************************************************************************************************************/
+void DynamoteEncoder::mark(uint16_t usec)
+{
+	add(true, usec);
+}
+
+/******************************************************************************************************************
+* space
+******************************************************************************************************************/
+void DynamoteEncoder::space(uint16_t usec)
+{
+	add(false, usec);
+}
+
+/******************************************************************************************************************
+* add
+******************************************************************************************************************/
+void DynamoteEncoder::add(bool isMark, uint16_t usec)
+{
+	// marks are at even indexes, two marks (or spaces) in a row are merged into one
+	bool lastIsMark = (length & 1) == 1;
+	if (length != 0 && lastIsMark == isMark) {
+		output[length - 1] += usec;
+		return;
+	}
+	if (length == 0 && !isMark)
+		return;
+	if (length == ENCODER_MAX_DURATIONS) {
+		overflow = true;
+		return;
+	}
+	output[length++] = usec;
+}
+
+/******************************************************************************************************************
+* frameDuration
+******************************************************************************************************************/
+uint32_t DynamoteEncoder::frameDuration(uint16_t start)
+{
+	uint32_t total = 0;
+	for (uint16_t x = start; x < length; x++)
+		total += output[x];
+	return total;
+}
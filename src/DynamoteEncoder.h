@@ -0,0 +1,50 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEENCODER_H
+#define DYNAMOTEENCODER_H
+
+#include "Arduino.h"
+#include "IRLibProtocols.h"
+#include "DynamoteProtocols.h"
+
+// Most mark/space durations produced for a single command (Sony sends its frame three times)
+#define ENCODER_MAX_DURATIONS       160
+
+// Turns a protocol value into the same mark/space timings IRLib2 would send, without touching any pin.
+// The durations start with a mark and alternate mark, space, mark, ...
+// Each protocol gets its own encoder, generated from its constexpr descriptor in DynamoteProtocols.h, so the
+// timings and coding are constants in the generated code and picking the encoder is a single table lookup.
+class DynamoteEncoder
+{
+	public:
+		DynamoteEncoder(void);
+		// returns the number of durations, or 0 if the protocol is not supported
+		uint16_t encode(uint8_t codeProtocol, uint32_t codeValue, uint8_t codeLength, uint16_t *durations, uint8_t *khz);
+
+	private:
+		uint16_t *output = NULL;
+		uint16_t length = 0;
+		bool overflow = false;
+		void mark(uint16_t usec);
+		void space(uint16_t usec);
+		void add(bool isMark, uint16_t usec);
+		template <uint8_t protocol> void encodeProtocol(uint32_t codeValue, uint8_t codeLength);
+		template <uint8_t protocol> void encodeFrame(uint32_t codeValue, uint8_t bits, bool header);
+		uint32_t frameDuration(uint16_t start);
+};
+
+#endif
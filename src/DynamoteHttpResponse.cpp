@@ -0,0 +1,132 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "DynamoteHttpResponse.h"
+#include "DynamoteArena.h"
+
+/******************************************************************************************************************
+* DynamoteHttpResponse constructor
+******************************************************************************************************************/
+DynamoteHttpResponse::DynamoteHttpResponse(Client &_client) : client(_client)
+{
+	buffer = (uint8_t*)dynamoteArena.allocate(HTTP_RESPONSE_HEADER_RESERVE + HTTP_RESPONSE_BODY_SIZE + HTTP_RESPONSE_TRAILER_RESERVE);
+}
+
+/******************************************************************************************************************
+* setStatus
+******************************************************************************************************************/
+void DynamoteHttpResponse::setStatus(uint16_t code, const char *reason)
+{
+	statusCode = code;
+	statusReason = reason;
+}
+
+/******************************************************************************************************************
+* write
+******************************************************************************************************************/
+size_t DynamoteHttpResponse::write(uint8_t data)
+{
+	return write(&data, 1);
+}
+
+size_t DynamoteHttpResponse::write(const uint8_t *data, size_t length)
+{
+	if (buffer == NULL) {
+		failed = true;
+		return 0;
+	}
+	for (size_t written = 0; written < length; ) {
+		// only a full buffer with more to come goes out as a chunk, so a body of exactly the buffer size is not chunked
+		if (bodyLength == HTTP_RESPONSE_BODY_SIZE)
+			writeChunk(false);
+		size_t part = min(length - written, (size_t)(HTTP_RESPONSE_BODY_SIZE - bodyLength));
+		memcpy(&buffer[HTTP_RESPONSE_HEADER_RESERVE + bodyLength], &data[written], part);
+		bodyLength += part;
+		written += part;
+	}
+	return length;
+}
+
+/******************************************************************************************************************
+* writeChunk
+******************************************************************************************************************/
+void DynamoteHttpResponse::writeChunk(bool last)
+{
+	// the headers (first chunk only) and the chunk size go right in front of the data, the end of the chunk and the
+	// last, empty chunk right behind it, so every chunk is a single write
+	char prefix[HTTP_RESPONSE_HEADER_RESERVE];
+	int prefixLength = 0;
+	if (!chunked) {
+		prefixLength = snprintf(prefix, sizeof(prefix),
+			"HTTP/1.1 %u %s\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n",
+			statusCode, statusReason);
+		chunked = true;
+	}
+	if (bodyLength != 0 && prefixLength >= 0 && prefixLength < (int)sizeof(prefix))
+		prefixLength += snprintf(&prefix[prefixLength], sizeof(prefix) - prefixLength, "%X\r\n", (unsigned int)bodyLength);
+	if (prefixLength <= 0 || prefixLength >= (int)sizeof(prefix)) {
+		failed = true;
+		bodyLength = 0;
+		return;
+	}
+
+	uint8_t *start = &buffer[HTTP_RESPONSE_HEADER_RESERVE - prefixLength];
+	memcpy(start, prefix, prefixLength);
+	uint8_t *end = &buffer[HTTP_RESPONSE_HEADER_RESERVE + bodyLength];
+	if (bodyLength != 0) {
+		memcpy(end, "\r\n", 2);
+		end += 2;
+	}
+	if (last) {
+		memcpy(end, "0\r\n\r\n", 5);
+		end += 5;
+	}
+	if (!failed && client.write(start, end - start) != (size_t)(end - start))
+		failed = true;
+	bodyLength = 0;
+}
+
+/******************************************************************************************************************
+* send
+******************************************************************************************************************/
+bool DynamoteHttpResponse::send(void)
+{
+	char header[HTTP_RESPONSE_HEADER_RESERVE];
+
+	// the arena was full, there is nowhere to put a body
+	if (buffer == NULL) {
+		int headerLength = snprintf(header, sizeof(header),
+			"HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+		client.write((const uint8_t*)header, headerLength);
+		return false;
+	}
+
+	if (chunked) {
+		writeChunk(true);
+		return !failed;
+	}
+
+	int headerLength = snprintf(header, sizeof(header),
+		"HTTP/1.1 %u %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+		statusCode, statusReason, (unsigned int)bodyLength);
+	if (headerLength <= 0 || headerLength >= (int)sizeof(header))
+		return false;
+
+	// put the headers right in front of the body, then everything goes out in one write
+	uint8_t *response = &buffer[HTTP_RESPONSE_HEADER_RESERVE - headerLength];
+	memcpy(response, header, headerLength);
+	return client.write(response, headerLength + bodyLength) == headerLength + bodyLength && !failed;
+}
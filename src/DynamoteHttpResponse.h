@@ -0,0 +1,62 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEHTTPRESPONSE_H
+#define DYNAMOTEHTTPRESPONSE_H
+
+#include "Arduino.h"
+#include "Client.h"
+
+// Body bytes kept before anything is written. A body that fits goes out in one write together with the headers,
+// a larger one is sent with chunked transfer encoding, one chunk each time the buffer is full.
+#ifndef HTTP_RESPONSE_BODY_SIZE
+#if defined(ESP32)
+#define HTTP_RESPONSE_BODY_SIZE       2048
+#else
+#define HTTP_RESPONSE_BODY_SIZE       1024
+#endif
+#endif
+
+// Room in front of the body for the status line and headers (or a chunk size), and behind it for the chunk ends
+#define HTTP_RESPONSE_HEADER_RESERVE  128
+#define HTTP_RESPONSE_TRAILER_RESERVE 8
+
+// Writes an HTTP response with as few calls as possible, so it leaves in as few TCP segments as possible. The body
+// is printed straight into a buffer taken from the arena, after a gap where the headers are filled in once the
+// length is known. Create it inside the request's DynamoteArenaScope, before anything else that uses the arena.
+class DynamoteHttpResponse : public Print
+{
+	public:
+		DynamoteHttpResponse(Client &_client);
+		void setStatus(uint16_t code, const char *reason);
+		size_t write(uint8_t data);
+		size_t write(const uint8_t *data, size_t length);
+		using Print::write;
+		// false if any part of the response could not be written
+		bool send(void);
+
+	private:
+		Client &client;
+		uint8_t *buffer;
+		uint16_t statusCode = 200;
+		const char *statusReason = "OK";
+		size_t bodyLength = 0;              // bytes in the buffer that have not been written yet
+		bool chunked = false;
+		bool failed = false;
+		void writeChunk(bool last);
+};
+
+#endif
@@ -21,24 +21,30 @@ DynamoteLinkedList::DynamoteLinkedList() {}
 void DynamoteLinkedList::clear() 
 {
   index = 0;
-  linkedList[0] = 0;
+  dictionarySize = 0;
+  bitsPerSymbol = 1;
+  symbols[0] = 0;
 }
 
-void DynamoteLinkedList::add(uint16_t value) 
+bool DynamoteLinkedList::add(uint16_t value, bool quantize) 
 {
-  linkedList[index] = value;
+  if (index >= ARRAY_SIZE)
+    return false;
+  bool exact;
+  setSymbol(index, findOrAddDuration(value, quantize, &exact));
   index++;
+  return exact;
 }
 
 uint16_t DynamoteLinkedList::get(int indexValue) 
 {
-  return linkedList[indexValue];
+  return dictionary[getSymbol(indexValue)];
 }
 
 void DynamoteLinkedList::removeFirst() 
 {
   for (int x = 0; x < index-1; x++) {
-    linkedList[x] = linkedList[x+1];
+    setSymbol(x, getSymbol(x+1));
   }
   index--;
 }
@@ -48,10 +54,117 @@ int DynamoteLinkedList::size()
   return index;
 }
 
-uint16_t* DynamoteLinkedList::toArray() 
+void DynamoteLinkedList::toArray(uint16_t *destinationArray) 
 {
-  uint16_t linkedListArray[index];
   for (int x = 0; x < index; x++) {
-    linkedListArray[x] = linkedList[x];
+    destinationArray[x] = get(x);
   }
 }
+
+uint8_t DynamoteLinkedList::getDictionarySize()
+{
+  return dictionarySize;
+}
+
+uint16_t DynamoteLinkedList::getDictionaryValue(uint8_t dictionaryIndex)
+{
+  return dictionary[dictionaryIndex];
+}
+
+uint8_t DynamoteLinkedList::getBitsPerSymbol()
+{
+  return bitsPerSymbol;
+}
+
+const uint8_t* DynamoteLinkedList::getPackedSymbols()
+{
+  return symbols;
+}
+
+unsigned int DynamoteLinkedList::getPackedSymbolsLength()
+{
+  return (index * bitsPerSymbol + 7) / 8;
+}
+
+bool DynamoteLinkedList::setCompressed(const uint16_t *_dictionary, uint8_t _dictionarySize, const uint8_t *packedSymbols, unsigned int packedSymbolsLength, unsigned int length)
+{
+  if (_dictionarySize == 0 || _dictionarySize > DICTIONARY_SIZE || length > ARRAY_SIZE)
+    return false;
+
+  // exactly as many symbol bytes as the length needs, a short string would leave timings undefined
+  uint8_t _bitsPerSymbol = (_dictionarySize <= 2) ? 1 : (_dictionarySize <= 4) ? 2 : 4;
+  if (packedSymbolsLength != (length * _bitsPerSymbol + 7) / 8)
+    return false;
+
+  memcpy(dictionary, _dictionary, _dictionarySize * sizeof(uint16_t));
+  dictionarySize = _dictionarySize;
+  bitsPerSymbol = _bitsPerSymbol;
+  index = length;
+  memcpy(symbols, packedSymbols, getPackedSymbolsLength());
+
+  // make sure every symbol points into the dictionary
+  for (int x = 0; x < index; x++) {
+    if (getSymbol(x) >= dictionarySize) {
+      clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+uint8_t DynamoteLinkedList::getSymbol(int indexValue)
+{
+  unsigned int bitOffset = indexValue * bitsPerSymbol;
+  return (symbols[bitOffset / 8] >> (bitOffset % 8)) & ((1 << bitsPerSymbol) - 1);
+}
+
+void DynamoteLinkedList::setSymbol(int indexValue, uint8_t symbol)
+{
+  // symbol widths always divide 8, so a symbol never spans two bytes
+  unsigned int bitOffset = indexValue * bitsPerSymbol;
+  uint8_t mask = ((1 << bitsPerSymbol) - 1) << (bitOffset % 8);
+  symbols[bitOffset / 8] = (symbols[bitOffset / 8] & ~mask) | ((symbol << (bitOffset % 8)) & mask);
+}
+
+uint8_t DynamoteLinkedList::findOrAddDuration(uint16_t value, bool quantize, bool *exact)
+{
+  // reuse the same duration, or a close enough one when quantizing, keeping track of the closest one in case
+  // the dictionary is full
+  uint8_t closest = 0;
+  uint16_t closestDifference = 0xFFFF;
+  *exact = true;
+  for (uint8_t x = 0; x < dictionarySize; x++) {
+    uint16_t difference = (dictionary[x] > value) ? dictionary[x] - value : value - dictionary[x];
+    if (difference == 0 || (quantize && (difference <= RAW_TOLERANCE_US || (uint32_t)difference * 100 <= (uint32_t)value * RAW_TOLERANCE_PERCENT)))
+      return x;
+    if (difference < closestDifference) {
+      closestDifference = difference;
+      closest = x;
+    }
+  }
+
+  if (dictionarySize == DICTIONARY_SIZE) {
+    *exact = false;
+    return closest;
+  }
+
+  dictionary[dictionarySize++] = value;
+  if (dictionarySize == 3)
+    repack(2);
+  else if (dictionarySize == 5)
+    repack(4);
+  return dictionarySize - 1;
+}
+
+void DynamoteLinkedList::repack(uint8_t newBitsPerSymbol)
+{
+  // widen the symbols in place, starting from the end so nothing is overwritten before it is read
+  uint8_t oldBitsPerSymbol = bitsPerSymbol;
+  for (int x = index - 1; x >= 0; x--) {
+    bitsPerSymbol = oldBitsPerSymbol;
+    uint8_t symbol = getSymbol(x);
+    bitsPerSymbol = newBitsPerSymbol;
+    setSymbol(x, symbol);
+  }
+  bitsPerSymbol = newBitsPerSymbol;
+}
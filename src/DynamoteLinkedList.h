@@ -22,20 +22,46 @@
 
 #define ARRAY_SIZE  RECV_BUF_LENGTH
 
+// Raw codes only use a handful of distinct durations. Each distinct duration is stored once in a
+// dictionary and the timings are stored as 1, 2 or 4 bit indices into it, depending on its size.
+#define DICTIONARY_SIZE       16
+#define SYMBOL_BYTES          ((ARRAY_SIZE + 1) / 2)
+
+// Recorded timings this close to a duration already in the dictionary are stored as that duration. Timings sent by
+// a client are stored exactly.
+#define RAW_TOLERANCE_US      60
+#define RAW_TOLERANCE_PERCENT 10
+
 class DynamoteLinkedList 
 {
   private:
-    uint16_t linkedList[ARRAY_SIZE];
+    uint16_t dictionary[DICTIONARY_SIZE];
+    uint8_t dictionarySize = 0;
+    uint8_t bitsPerSymbol = 1;
+    uint8_t symbols[SYMBOL_BYTES];
     unsigned int index = 0;
+    uint8_t getSymbol(int indexValue);
+    void setSymbol(int indexValue, uint8_t symbol);
+    uint8_t findOrAddDuration(uint16_t value, bool quantize, bool *exact);
+    void repack(uint8_t newBitsPerSymbol);
 
   public:
     DynamoteLinkedList();
     void clear();
-    void add(uint16_t value);
+    // false if the value had to be replaced by the closest duration, because the dictionary is full
+    bool add(uint16_t value, bool quantize = false);
     uint16_t get(int indexValue);
     void removeFirst();
     int size();
-    uint16_t* toArray();
+    void toArray(uint16_t *destinationArray);
+
+    // compressed representation, used to store and transmit raw codes
+    uint8_t getDictionarySize();
+    uint16_t getDictionaryValue(uint8_t dictionaryIndex);
+    uint8_t getBitsPerSymbol();
+    const uint8_t* getPackedSymbols();
+    unsigned int getPackedSymbolsLength();
+    bool setCompressed(const uint16_t *_dictionary, uint8_t _dictionarySize, const uint8_t *packedSymbols, unsigned int packedSymbolsLength, unsigned int length);
 };
 
 #endif
@@ -0,0 +1,115 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTELOCK_H
+#define DYNAMOTELOCK_H
+
+#include "Arduino.h"
+
+// Short critical section for state that two tasks write, for example a BLE callback and the loop. On the ESP32
+// it is a spinlock that also keeps interrupts on this core off, so only hold it for a copy or a few updates.
+// The other boards run everything in one task, there it does nothing.
+class DynamoteLock
+{
+	public:
+#if defined(ESP32)
+		void lock(void) { portENTER_CRITICAL(&mux); }
+		void unlock(void) { portEXIT_CRITICAL(&mux); }
+
+	private:
+		portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+#else
+		void lock(void) {}
+		void unlock(void) {}
+#endif
+};
+
+// Read-modify-write on a value that two tasks update, for example a counter bumped by the loop and by the IR task.
+// The Cortex-M0+ of the SAMD21 has no exclusive load/store, so the __atomic builtins would not link there, but it
+// only ever runs one task.
+template <typename T>
+inline T dynamoteAtomicAdd(T *value, T amount)
+{
+#if defined(__ARM_ARCH_6M__)
+	return *value += amount;
+#else
+	return __atomic_add_fetch(value, amount, __ATOMIC_ACQ_REL);
+#endif
+}
+
+template <typename T>
+inline T dynamoteAtomicSub(T *value, T amount)
+{
+#if defined(__ARM_ARCH_6M__)
+	return *value -= amount;
+#else
+	return __atomic_sub_fetch(value, amount, __ATOMIC_ACQ_REL);
+#endif
+}
+
+template <typename T>
+inline T dynamoteAtomicExchange(T *value, T newValue)
+{
+#if defined(__ARM_ARCH_6M__)
+	T oldValue = *value;
+	*value = newValue;
+	return oldValue;
+#else
+	return __atomic_exchange_n(value, newValue, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// Replaces the value with desired if it still holds expected, otherwise loads the current value into expected
+template <typename T>
+inline bool dynamoteAtomicCompareExchange(T *value, T *expected, T desired)
+{
+#if defined(__ARM_ARCH_6M__)
+	if (*value != *expected) {
+		*expected = *value;
+		return false;
+	}
+	*value = desired;
+	return true;
+#else
+	return __atomic_compare_exchange_n(value, expected, desired, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Raises the value to at least candidate
+template <typename T>
+inline void dynamoteAtomicMax(T *value, T candidate)
+{
+#if defined(__ARM_ARCH_6M__)
+	if (candidate > *value)
+		*value = candidate;
+#else
+	T current = __atomic_load_n(value, __ATOMIC_RELAXED);
+	while (candidate > current && !__atomic_compare_exchange_n(value, &current, candidate, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+#endif
+}
+
+// Holds the lock until the end of the enclosing block
+class DynamoteLockGuard
+{
+	public:
+		DynamoteLockGuard(DynamoteLock &_lock) : lock(_lock) { lock.lock(); }
+		~DynamoteLockGuard(void) { lock.unlock(); }
+
+	private:
+		DynamoteLock &lock;
+};
+
+#endif
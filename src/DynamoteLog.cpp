@@ -0,0 +1,134 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "DynamoteLog.h"
+#include <stdarg.h>
+
+DynamoteLog dynamoteLog;
+
+static const char logLevelTags[] = { ' ', 'E', 'W', 'I', 'D' };
+
+/******************************************************************************************************************
+* DynamoteLog constructor
+******************************************************************************************************************/
+DynamoteLog::DynamoteLog(void) : output(&Serial)
+{
+	memset(buffer, 0, sizeof(buffer));
+}
+
+/******************************************************************************************************************
+* setOutput
+******************************************************************************************************************/
+void DynamoteLog::setOutput(Print *_output)
+{
+	output = _output;
+}
+
+/******************************************************************************************************************
+* write
+******************************************************************************************************************/
+void DynamoteLog::write(uint8_t level, const char *format, ...)
+{
+	// format the message on the stack, this never touches the serial port
+	char line[DYNAMOTE_LOG_LINE_LENGTH];
+	line[0] = logLevelTags[level];
+	line[1] = ':';
+	line[2] = ' ';
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(&line[3], sizeof(line) - 4, format, args);
+	va_end(args);
+	if (length < 0)
+		return;
+	length = min(length + 3, (int)sizeof(line) - 2);
+	line[length++] = '\n';
+
+	// claim room for the length byte and the message, or drop the whole message if it does not fit
+#if defined(ESP32)
+	uint8_t ring = xPortGetCoreID();
+#else
+	uint8_t ring = 0;
+#endif
+	uint16_t start = __atomic_load_n(&head[ring], __ATOMIC_ACQUIRE);
+	uint16_t end;
+	do {
+		uint16_t currentTail = __atomic_load_n(&tail[ring], __ATOMIC_ACQUIRE);
+		uint16_t freeSpace = (currentTail + DYNAMOTE_LOG_BUFFER_SIZE - start - 1) % DYNAMOTE_LOG_BUFFER_SIZE;
+		if (length + 1 > freeSpace) {
+			dynamoteAtomicAdd(&droppedCount, (uint32_t)1);
+			return;
+		}
+		end = (start + length + 1) % DYNAMOTE_LOG_BUFFER_SIZE;
+	} while (!dynamoteAtomicCompareExchange(&head[ring], &start, end));
+
+	// the message first, the length byte that hands it to drain() last
+	uint16_t position = start;
+	for (int x = 0; x < length; x++) {
+		position = (position + 1) % DYNAMOTE_LOG_BUFFER_SIZE;
+		buffer[ring][position] = line[x];
+	}
+	__atomic_store_n(&buffer[ring][start], (char)length, __ATOMIC_RELEASE);
+}
+
+/******************************************************************************************************************
+* drain
+******************************************************************************************************************/
+void DynamoteLog::drain(void)
+{
+	if (output == NULL)
+		return;
+
+	// only write what the output can take without blocking
+	int writable = min(output->availableForWrite(), DYNAMOTE_LOG_DRAIN_CHUNK);
+
+	for (uint8_t ring = 0; ring < DYNAMOTE_LOG_RINGS; ring++) {
+		uint16_t currentTail = tail[ring];
+		while (writable > 0) {
+			// the next message, unless its writer has not finished it yet
+			if (pending[ring] == 0) {
+				if (currentTail == __atomic_load_n(&head[ring], __ATOMIC_ACQUIRE))
+					break;
+				uint8_t length = __atomic_load_n(&buffer[ring][currentTail], __ATOMIC_ACQUIRE);
+				if (length == 0)
+					break;
+				buffer[ring][currentTail] = 0;
+				currentTail = (currentTail + 1) % DYNAMOTE_LOG_BUFFER_SIZE;
+				pending[ring] = length;
+			}
+
+			// write the contiguous part of the message in one go, and leave the room cleared for the writers
+			uint16_t chunk = min(min((int)pending[ring], DYNAMOTE_LOG_BUFFER_SIZE - currentTail), writable);
+			output->write((const uint8_t*)&buffer[ring][currentTail], chunk);
+			memset(&buffer[ring][currentTail], 0, chunk);
+			currentTail = (currentTail + chunk) % DYNAMOTE_LOG_BUFFER_SIZE;
+			pending[ring] -= chunk;
+			writable -= chunk;
+		}
+		__atomic_store_n(&tail[ring], currentTail, __ATOMIC_RELEASE);
+
+		// finish this line before starting on the next ring, so lines from different cores never interleave
+		if (pending[ring] != 0)
+			return;
+	}
+}
+
+/******************************************************************************************************************
+* getDroppedCount
+******************************************************************************************************************/
+uint32_t DynamoteLog::getDroppedCount(void)
+{
+	return droppedCount;
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTELOG_H
+#define DYNAMOTELOG_H
+
+#include "Arduino.h"
+#include "DynamoteLock.h"
+
+#define DYNAMOTE_LOG_LEVEL_NONE         0
+#define DYNAMOTE_LOG_LEVEL_ERROR        1
+#define DYNAMOTE_LOG_LEVEL_WARNING      2
+#define DYNAMOTE_LOG_LEVEL_INFO         3
+#define DYNAMOTE_LOG_LEVEL_DEBUG        4
+
+// Messages above this level are removed at compile time
+#ifndef DYNAMOTE_LOG_LEVEL
+#define DYNAMOTE_LOG_LEVEL              DYNAMOTE_LOG_LEVEL_INFO
+#endif
+
+// Size of the RAM ring buffer that holds formatted messages until they are drained
+#ifndef DYNAMOTE_LOG_BUFFER_SIZE
+#define DYNAMOTE_LOG_BUFFER_SIZE        1024
+#endif
+
+// One ring per core, so writers on different cores of the ESP32 never wait for each other
+#if defined(ESP32)
+#define DYNAMOTE_LOG_RINGS              portNUM_PROCESSORS
+#else
+#define DYNAMOTE_LOG_RINGS              1
+#endif
+
+// Longest single message, anything longer is truncated
+#define DYNAMOTE_LOG_LINE_LENGTH        96
+
+// Most bytes written to the output on each drain, so a single loop never blocks for long
+#define DYNAMOTE_LOG_DRAIN_CHUNK        64
+
+class DynamoteLog
+{
+	public:
+		DynamoteLog(void);
+		void setOutput(Print *_output);
+		void write(uint8_t level, const char *format, ...);
+		void drain(void);
+		uint32_t getDroppedCount(void);
+
+	private:
+		// every task on a core writes to that core's ring (the loop, the IR task, the BLE host task), and one may
+		// interrupt another halfway. A writer claims room by moving head with a compare-exchange, copies its message
+		// in behind a length byte, and sets that byte last. drain() stops at a length byte that is still 0, and
+		// clears what it has written, so free room is always 0. Nobody waits for anybody.
+		char buffer[DYNAMOTE_LOG_RINGS][DYNAMOTE_LOG_BUFFER_SIZE];
+		uint16_t head[DYNAMOTE_LOG_RINGS] = {0};
+		uint16_t tail[DYNAMOTE_LOG_RINGS] = {0};
+		uint8_t pending[DYNAMOTE_LOG_RINGS] = {0};       // bytes left of the message drain() is halfway through
+		uint32_t droppedCount = 0;
+		Print *output;
+};
+
+extern DynamoteLog dynamoteLog;
+
+#if DYNAMOTE_LOG_LEVEL >= DYNAMOTE_LOG_LEVEL_ERROR
+#define DYNAMOTE_LOG_ERROR(...)         dynamoteLog.write(DYNAMOTE_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define DYNAMOTE_LOG_ERROR(...)         do {} while (0)
+#endif
+
+#if DYNAMOTE_LOG_LEVEL >= DYNAMOTE_LOG_LEVEL_WARNING
+#define DYNAMOTE_LOG_WARNING(...)       dynamoteLog.write(DYNAMOTE_LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define DYNAMOTE_LOG_WARNING(...)       do {} while (0)
+#endif
+
+#if DYNAMOTE_LOG_LEVEL >= DYNAMOTE_LOG_LEVEL_INFO
+#define DYNAMOTE_LOG_INFO(...)          dynamoteLog.write(DYNAMOTE_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define DYNAMOTE_LOG_INFO(...)          do {} while (0)
+#endif
+
+#if DYNAMOTE_LOG_LEVEL >= DYNAMOTE_LOG_LEVEL_DEBUG
+#define DYNAMOTE_LOG_DEBUG(...)         dynamoteLog.write(DYNAMOTE_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define DYNAMOTE_LOG_DEBUG(...)         do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,227 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+// Dynamote.h first, it holds the DYNAMOTE_MEMORY_PROBES option
+#include "Dynamote.h"
+#include "DynamoteMemory.h"
+#include "DynamoteArena.h"
+#if defined(ESP32)
+#include "esp_heap_caps.h"
+#else
+#include <malloc.h>
+extern "C" char *sbrk(int increment);
+#endif
+
+DynamoteMemory dynamoteMemory;
+
+static const char *subsystemNames[MEMORY_SUBSYSTEM_COUNT] = {
+	"http",
+	"mqtt",
+	"ble",
+	"jsonParse",
+	"jsonSerialize",
+	"ir"
+};
+
+/******************************************************************************************************************
+* DynamoteMemory constructor
+******************************************************************************************************************/
+DynamoteMemory::DynamoteMemory(void) {}
+
+/******************************************************************************************************************
+* recordStack
+******************************************************************************************************************/
+void DynamoteMemory::recordStack(DynamoteSubsystem subsystem, uint32_t bytes)
+{
+	if (bytes > stackHighWaterMark[subsystem])
+		stackHighWaterMark[subsystem] = bytes;
+}
+
+/******************************************************************************************************************
+* recordHeapGrowth
+******************************************************************************************************************/
+void DynamoteMemory::recordHeapGrowth(DynamoteSubsystem subsystem, int32_t bytes)
+{
+	if (bytes > heapGrowth[subsystem])
+		heapGrowth[subsystem] = bytes;
+}
+
+/******************************************************************************************************************
+* getFreeHeap
+******************************************************************************************************************/
+uint32_t DynamoteMemory::getFreeHeap(void)
+{
+#if defined(ESP32)
+	uint32_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+#else
+	// free chunks inside the heap, plus the gap between the top of the heap and the stack
+	char stackTop;
+	uint32_t freeHeap = mallinfo().fordblks + (&stackTop - sbrk(0));
+#endif
+	if (freeHeap < minimumFreeHeap)
+		minimumFreeHeap = freeHeap;
+	return freeHeap;
+}
+
+/******************************************************************************************************************
+* getLargestFreeBlock
+******************************************************************************************************************/
+uint32_t DynamoteMemory::getLargestFreeBlock(void)
+{
+#if defined(ESP32)
+	return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+#else
+	// newlib does not expose its free list, so this is the gap between the heap and the stack (reported as
+	// sbrkGap), which is what a new large allocation gets once none of the free chunks fit
+	char stackTop;
+	return &stackTop - sbrk(0);
+#endif
+}
+
+/******************************************************************************************************************
+* getMinimumFreeHeap
+******************************************************************************************************************/
+uint32_t DynamoteMemory::getMinimumFreeHeap(void)
+{
+#if defined(ESP32)
+	return heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+#else
+	// only as good as how often the heap is sampled, every probe and every query samples it
+	getFreeHeap();
+	return minimumFreeHeap;
+#endif
+}
+
+/******************************************************************************************************************
+* addToJson
+******************************************************************************************************************/
+void DynamoteMemory::addToJson(JsonObject memoryObject)
+{
+	uint32_t freeHeap = getFreeHeap();
+	uint32_t largestFreeBlock = getLargestFreeBlock();
+	JsonObject heap = memoryObject.createNestedObject("heap");
+	heap["free"] = freeHeap;
+	heap["minimumFree"] = getMinimumFreeHeap();
+#if defined(ESP32)
+	heap["largestFreeBlock"] = largestFreeBlock;
+#else
+	// not the largest free chunk, see getLargestFreeBlock()
+	heap["sbrkGap"] = largestFreeBlock;
+#endif
+	// percentage of the free heap that is not part of the largest block
+	heap["fragmentation"] = (freeHeap == 0) ? 0 : 100 - (uint64_t)min(largestFreeBlock, freeHeap) * 100 / freeHeap;
+	dynamoteArena.addToJson(memoryObject.createNestedObject("arena"));
+
+#if defined(DYNAMOTE_MEMORY_PROBES)
+	JsonObject stack = memoryObject.createNestedObject("stack");
+	JsonObject growth = memoryObject.createNestedObject("heapGrowth");
+	for (uint8_t x = 0; x < MEMORY_SUBSYSTEM_COUNT; x++) {
+		stack[subsystemNames[x]] = stackHighWaterMark[x];
+		growth[subsystemNames[x]] = heapGrowth[x];
+	}
+#endif
+}
+
+#if defined(DYNAMOTE_MEMORY_PROBES)
+
+// the innermost probe on each core, nested probes hand their results up to it
+#if defined(ESP32)
+static DynamoteMemoryProbe *activeProbes[portNUM_PROCESSORS] = {NULL};
+#define ACTIVE_PROBE        activeProbes[xPortGetCoreID()]
+#else
+static DynamoteMemoryProbe *activeProbe = NULL;
+#define ACTIVE_PROBE        activeProbe
+#endif
+
+/******************************************************************************************************************
+* stackLimit
+******************************************************************************************************************/
+static uint8_t *stackLimit(void)
+{
+#if defined(ESP32)
+	// every task has its own stack
+	return (uint8_t*)pxTaskGetStackStart(NULL);
+#else
+	// the stack grows down towards the heap
+	return (uint8_t*)sbrk(0);
+#endif
+}
+
+/******************************************************************************************************************
+* lowestUsed
+******************************************************************************************************************/
+static uint8_t *lowestUsed(uint8_t *bottom, uint8_t *top)
+{
+	// the first byte that no longer holds the paint, or top if all of it is still there
+	while (bottom < top && *bottom == MEMORY_PROBE_PATTERN)
+		bottom++;
+	return bottom;
+}
+
+/******************************************************************************************************************
+* DynamoteMemoryProbe constructor
+******************************************************************************************************************/
+DynamoteMemoryProbe::DynamoteMemoryProbe(DynamoteSubsystem _subsystem) : subsystem(_subsystem)
+{
+	uint8_t marker;
+	top = &marker;
+	paintTop = top - MEMORY_PROBE_GUARD;
+	paintBottom = max(top - MEMORY_PROBE_DEPTH, stackLimit() + MEMORY_PROBE_GUARD);
+	if (paintBottom > paintTop)
+		paintBottom = paintTop;
+	deepest = paintTop;
+	heapBefore = dynamoteMemory.getFreeHeap();
+
+	// the paint below is about to be overwritten, tell the enclosing probe how deep it has been so far
+	parent = ACTIVE_PROBE;
+	if (parent != NULL) {
+		uint8_t *overlapBottom = max(paintBottom, parent->paintBottom);
+		uint8_t *overlapTop = min(paintTop, parent->paintTop);
+		if (overlapBottom < overlapTop)
+			parent->deepest = min(parent->deepest, lowestUsed(overlapBottom, overlapTop));
+	}
+	ACTIVE_PROBE = this;
+
+#if defined(ESP32)
+	memset(paintBottom, MEMORY_PROBE_PATTERN, paintTop - paintBottom);
+#else
+	// interrupts run on this same stack, right below the stack pointer, so at the top of the paint. Paint from
+	// the bottom up a chunk at a time: an interrupt between two chunks only touches the part still to be painted,
+	// and interrupts are never held off for longer than one chunk takes.
+	size_t paintLength = paintTop - paintBottom;
+	for (size_t offset = 0; offset < paintLength; offset += MEMORY_PROBE_PAINT_CHUNK) {
+		noInterrupts();
+		memset(paintBottom + offset, MEMORY_PROBE_PATTERN, min(paintLength - offset, (size_t)MEMORY_PROBE_PAINT_CHUNK));
+		interrupts();
+	}
+#endif
+}
+
+/******************************************************************************************************************
+* DynamoteMemoryProbe destructor
+******************************************************************************************************************/
+DynamoteMemoryProbe::~DynamoteMemoryProbe(void)
+{
+	deepest = min(deepest, lowestUsed(paintBottom, paintTop));
+	dynamoteMemory.recordStack(subsystem, top - deepest);
+	dynamoteMemory.recordHeapGrowth(subsystem, (int32_t)heapBefore - (int32_t)dynamoteMemory.getFreeHeap());
+
+	ACTIVE_PROBE = parent;
+	if (parent != NULL)
+		parent->deepest = min(parent->deepest, deepest);
+}
+
+#endif
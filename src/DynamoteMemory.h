@@ -0,0 +1,88 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEMEMORY_H
+#define DYNAMOTEMEMORY_H
+
+#include "Arduino.h"
+#include <ArduinoJson.h>              // https://arduinojson.org/
+
+// How far below the entry point the stack is painted, and the part right below it that is left alone
+// because the probe itself is using it
+#if defined(ESP32)
+#define MEMORY_PROBE_DEPTH          4096
+#else
+#define MEMORY_PROBE_DEPTH          2048
+#endif
+#define MEMORY_PROBE_GUARD          128
+// Without ESP32 interrupts are held off while the stack is painted, this many bytes at a time
+#define MEMORY_PROBE_PAINT_CHUNK    64
+
+#define MEMORY_PROBE_PATTERN        0xA5
+
+enum DynamoteSubsystem {
+	MEMORY_HTTP,                        // DynamoteWiFi request handling
+	MEMORY_MQTT,                        // MQTT message handling
+	MEMORY_BLE,                         // BLE command reassembly and replies
+	MEMORY_JSON_PARSE,                  // sendJsonRemoteCommand
+	MEMORY_JSON_SERIALIZE,              // serializeRemoteCommandToJsonString
+	MEMORY_IR,                          // irLoop, receive and transmit
+	MEMORY_SUBSYSTEM_COUNT
+};
+
+class DynamoteMemory
+{
+	public:
+		DynamoteMemory(void);
+		void recordStack(DynamoteSubsystem subsystem, uint32_t bytes);
+		void recordHeapGrowth(DynamoteSubsystem subsystem, int32_t bytes);
+		uint32_t getFreeHeap(void);
+		uint32_t getLargestFreeBlock(void);
+		uint32_t getMinimumFreeHeap(void);
+		void addToJson(JsonObject memoryObject);
+
+	private:
+		uint32_t stackHighWaterMark[MEMORY_SUBSYSTEM_COUNT] = {0};
+		int32_t heapGrowth[MEMORY_SUBSYSTEM_COUNT] = {0};
+		uint32_t minimumFreeHeap = 0xFFFFFFFF;
+};
+
+// Measures the stack used by a scope by painting the free stack below it and checking how much of the
+// paint is gone at the end. The heap is sampled at both ends as well. Probes can be nested.
+// Only active with DYNAMOTE_MEMORY_PROBES, otherwise it compiles to nothing.
+class DynamoteMemoryProbe
+{
+	public:
+#if defined(DYNAMOTE_MEMORY_PROBES)
+		DynamoteMemoryProbe(DynamoteSubsystem _subsystem);
+		~DynamoteMemoryProbe(void);
+
+	private:
+		DynamoteSubsystem subsystem;
+		uint8_t *top;                       // stack pointer at the start of the scope
+		uint8_t *paintBottom;
+		uint8_t *paintTop;
+		uint8_t *deepest;                   // deepest use reported by nested probes
+		uint32_t heapBefore;
+		DynamoteMemoryProbe *parent;
+#else
+		DynamoteMemoryProbe(DynamoteSubsystem _subsystem) {}
+#endif
+};
+
+extern DynamoteMemory dynamoteMemory;
+
+#endif
@@ -0,0 +1,231 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "DynamoteMetrics.h"
+#include "DynamoteMemory.h"
+#include "DynamoteArena.h"
+#include "DynamoteLock.h"
+#include <ArduinoJson.h>              // https://arduinojson.org/
+
+DynamoteMetrics dynamoteMetrics;
+
+static const char *latencyMetricNames[METRIC_COUNT] = {
+	"httpRequest",
+	"bleReassembly",
+	"mqttDispatch",
+	"jsonParse",
+	"firstMark",
+	"irSend",
+	"udpDispatch"
+};
+
+static const char *counterNames[COUNTER_COUNT] = {
+	"commandsReceived",
+	"commandsSent",
+	"customCommands",
+	"commandsRecorded",
+	"framesCaptured",
+	"httpRequests",
+	"mqttMessages",
+	"bleChunks",
+	"batchesReceived",
+	"udpDatagrams",
+	"webSocketMessages",
+	"statusRequests",
+	"statusBuilds"
+};
+
+static const char *dropReasonNames[DROP_REASON_COUNT] = {
+	"jsonParseError",
+	"noCustomHandler",
+	"bleTimeout",
+	"mqttWrongTopic",
+	"necRepeat",
+	"duplicateFrame",
+	"queueFull",
+	"captureQueueFull",
+	"udpDuplicate",
+	"udpMalformed",
+	"holdTimeout",
+	"rateLimited",
+	"arenaFull",
+	"recordOverrun"
+};
+
+/******************************************************************************************************************
+* DynamoteMetrics constructor
+******************************************************************************************************************/
+DynamoteMetrics::DynamoteMetrics(void)
+{
+	reset();
+}
+
+/******************************************************************************************************************
+* reset
+******************************************************************************************************************/
+void DynamoteMetrics::reset(void)
+{
+	memset(histograms, 0, sizeof(histograms));
+	memset(samples, 0, sizeof(samples));
+	memset(maxMicros, 0, sizeof(maxMicros));
+	memset(counters, 0, sizeof(counters));
+	memset(drops, 0, sizeof(drops));
+	requestPending = false;
+}
+
+/******************************************************************************************************************
+* record
+******************************************************************************************************************/
+void DynamoteMetrics::record(DynamoteLatencyMetric metric, uint32_t elapsedMicros)
+{
+	// floor(log2(elapsedMicros)), anything below 2us goes into the first bucket
+	uint8_t bucket = (elapsedMicros < 2) ? 0 : 31 - __builtin_clz(elapsedMicros);
+	if (bucket >= METRICS_HISTOGRAM_BUCKETS)
+		bucket = METRICS_HISTOGRAM_BUCKETS - 1;
+
+	// the loop, the IR task and the BLE callbacks all record, on both cores of the ESP32
+	dynamoteAtomicAdd(&histograms[metric][bucket], (uint32_t)1);
+	dynamoteAtomicAdd(&samples[metric], (uint32_t)1);
+	dynamoteAtomicMax(&maxMicros[metric], elapsedMicros);
+}
+
+/******************************************************************************************************************
+* count
+******************************************************************************************************************/
+void DynamoteMetrics::count(DynamoteCounter counter)
+{
+	dynamoteAtomicAdd(&counters[counter], (uint32_t)1);
+}
+
+/******************************************************************************************************************
+* drop
+******************************************************************************************************************/
+void DynamoteMetrics::drop(DynamoteDropReason reason)
+{
+	dynamoteAtomicAdd(&drops[reason], (uint32_t)1);
+}
+
+/******************************************************************************************************************
+* beginRequest
+******************************************************************************************************************/
+void DynamoteMetrics::beginRequest(uint32_t startMicros)
+{
+	// the transports call this as soon as the first byte of a request arrives,
+	// the time until the IR emitter starts is then recorded by firstMark()
+	requestStartMicros = startMicros;
+	__atomic_store_n(&requestPending, true, __ATOMIC_RELEASE);
+	count(COUNTER_COMMANDS_RECEIVED);
+}
+
+/******************************************************************************************************************
+* endRequest
+******************************************************************************************************************/
+void DynamoteMetrics::endRequest(void)
+{
+	// the request was refused, or was done without a frame (a custom command, a replay, a release), so the next
+	// frame sent does not belong to it
+	__atomic_store_n(&requestPending, false, __ATOMIC_RELEASE);
+}
+
+/******************************************************************************************************************
+* firstMark
+******************************************************************************************************************/
+void DynamoteMetrics::firstMark(void)
+{
+	if (!dynamoteAtomicExchange(&requestPending, false))
+		return;
+	record(METRIC_FIRST_MARK, micros() - requestStartMicros);
+}
+
+/******************************************************************************************************************
+* percentile
+******************************************************************************************************************/
+uint32_t DynamoteMetrics::percentile(DynamoteLatencyMetric metric, uint8_t percent)
+{
+	if (samples[metric] == 0)
+		return 0;
+
+	// rank of the requested sample, rounded up
+	uint32_t rank = ((uint64_t)samples[metric] * percent + 99) / 100;
+	if (rank == 0)
+		rank = 1;
+
+	uint32_t seen = 0;
+	for (uint8_t bucket = 0; bucket < METRICS_HISTOGRAM_BUCKETS; bucket++) {
+		seen += histograms[metric][bucket];
+		if (seen >= rank) {
+			// report the upper edge of the bucket, but never more than we have actually observed
+			uint32_t upperEdge = (bucket >= 31) ? 0xFFFFFFFF : ((uint32_t)2 << bucket) - 1;
+			return min(upperEdge, maxMicros[metric]);
+		}
+	}
+	return maxMicros[metric];
+}
+
+/******************************************************************************************************************
+* writeJson
+******************************************************************************************************************/
+template <typename Destination> void DynamoteMetrics::writeJson(Destination &destination)
+{
+	DynamoteArenaScope arenaScope;
+	DynamoteJsonDocument jsonDoc(2048);
+	jsonDoc["uptime"] = millis();
+
+	JsonObject latency = jsonDoc.createNestedObject("latency");
+	for (uint8_t x = 0; x < METRIC_COUNT; x++) {
+		JsonObject entry = latency.createNestedObject(latencyMetricNames[x]);
+		entry["count"] = samples[x];
+		entry["p50"] = percentile((DynamoteLatencyMetric)x, 50);
+		entry["p99"] = percentile((DynamoteLatencyMetric)x, 99);
+		entry["max"] = maxMicros[x];
+	}
+
+	JsonObject counterObject = jsonDoc.createNestedObject("counters");
+	for (uint8_t x = 0; x < COUNTER_COUNT; x++)
+		counterObject[counterNames[x]] = counters[x];
+
+	JsonObject dropObject = jsonDoc.createNestedObject("drops");
+	for (uint8_t x = 0; x < DROP_REASON_COUNT; x++)
+		dropObject[dropReasonNames[x]] = drops[x];
+
+	dynamoteMemory.addToJson(jsonDoc.createNestedObject("memory"));
+
+	serializeJson(jsonDoc, destination);
+}
+
+/******************************************************************************************************************
+* toJsonString
+******************************************************************************************************************/
+void DynamoteMetrics::toJsonString(String &destinationBuffer)
+{
+	writeJson(destinationBuffer);
+}
+
+/******************************************************************************************************************
+* toJson
+******************************************************************************************************************/
+void DynamoteMetrics::toJson(Print &output)
+{
+	writeJson(output);
+}
+
+/******************************************************************************************************************
+* DynamoteStageTimer destructor
+******************************************************************************************************************/
+DynamoteStageTimer::~DynamoteStageTimer(void)
+{
+	dynamoteMetrics.record(metric, micros() - startMicros);
+}
@@ -0,0 +1,112 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEMETRICS_H
+#define DYNAMOTEMETRICS_H
+
+#include "Arduino.h"
+
+// Each latency histogram uses power-of-two microsecond buckets.
+// Bucket n holds samples in [2^n, 2^(n+1)) us, the last bucket also holds everything larger.
+#define METRICS_HISTOGRAM_BUCKETS       24
+
+enum DynamoteLatencyMetric {
+	METRIC_HTTP_REQUEST,                // HTTP client accepted -> connection closed
+	METRIC_BLE_REASSEMBLY,              // first BLE chunk received -> command complete
+	METRIC_MQTT_DISPATCH,               // MQTT message received -> command dispatched
+	METRIC_JSON_PARSE,                  // JSON string -> RemoteCommand
+	METRIC_FIRST_MARK,                  // request received -> first IR mark
+	METRIC_IR_SEND,                     // duration of the IR transmission itself
+	METRIC_UDP_DISPATCH,                // UDP datagram received -> commands queued
+	METRIC_COUNT
+};
+
+enum DynamoteCounter {
+	COUNTER_COMMANDS_RECEIVED,
+	COUNTER_COMMANDS_SENT,
+	COUNTER_CUSTOM_COMMANDS,
+	COUNTER_COMMANDS_RECORDED,
+	COUNTER_FRAMES_CAPTURED,
+	COUNTER_HTTP_REQUESTS,
+	COUNTER_MQTT_MESSAGES,
+	COUNTER_BLE_CHUNKS,
+	COUNTER_BATCHES_RECEIVED,
+	COUNTER_UDP_DATAGRAMS,
+	COUNTER_WEBSOCKET_MESSAGES,
+	COUNTER_STATUS_REQUESTS,
+	COUNTER_STATUS_BUILDS,
+	COUNTER_COUNT
+};
+
+enum DynamoteDropReason {
+	DROP_JSON_PARSE_ERROR,
+	DROP_NO_CUSTOM_HANDLER,
+	DROP_BLE_TIMEOUT,
+	DROP_MQTT_WRONG_TOPIC,
+	DROP_NEC_REPEAT,
+	DROP_DUPLICATE_FRAME,
+	DROP_QUEUE_FULL,
+	DROP_CAPTURE_QUEUE_FULL,
+	DROP_UDP_DUPLICATE,
+	DROP_UDP_MALFORMED,
+	DROP_HOLD_TIMEOUT,
+	DROP_RATE_LIMITED,
+	DROP_ARENA_FULL,
+	DROP_RECORD_OVERRUN,
+	DROP_REASON_COUNT
+};
+
+class DynamoteMetrics
+{
+	public:
+		DynamoteMetrics(void);
+		void reset(void);
+		void record(DynamoteLatencyMetric metric, uint32_t elapsedMicros);
+		void count(DynamoteCounter counter);
+		void drop(DynamoteDropReason reason);
+		void beginRequest(uint32_t startMicros);
+		void endRequest(void);
+		void firstMark(void);
+		uint32_t percentile(DynamoteLatencyMetric metric, uint8_t percent);
+		void toJsonString(String &destinationBuffer);
+		void toJson(Print &output);
+
+	private:
+		uint32_t histograms[METRIC_COUNT][METRICS_HISTOGRAM_BUCKETS];
+		uint32_t samples[METRIC_COUNT];
+		uint32_t maxMicros[METRIC_COUNT];
+		uint32_t counters[COUNTER_COUNT];
+		uint32_t drops[DROP_REASON_COUNT];
+		uint32_t requestStartMicros = 0;
+		bool requestPending = false;
+		template <typename Destination> void writeJson(Destination &destination);
+};
+
+// Times a scope and records it into the given latency histogram
+class DynamoteStageTimer
+{
+	public:
+		DynamoteStageTimer(DynamoteLatencyMetric _metric) : metric(_metric), startMicros(micros()) {}
+		~DynamoteStageTimer(void);
+
+	private:
+		DynamoteLatencyMetric metric;
+		uint32_t startMicros;
+};
+
+extern DynamoteMetrics dynamoteMetrics;
+
+#endif
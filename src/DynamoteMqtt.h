@@ -111,21 +111,63 @@ FlashStorage(mqttConfig_flash_store, mqttConfig_t);
 
 DynamoteWiFi *dynamotePtr = nullptr;
 
+// reconnect attempts are driven by the timer wheel, with an exponential backoff between them
+void mqttReconnect(void *argument);
+DynamoteTimer mqttReconnectTimer(&mqttReconnect, NULL);
+int backoff_index = 0;
+uint32_t backoff_ms = 0;
+
 /******************************************************************************************************************
 * messageReceived
 ******************************************************************************************************************/
 void messageReceived(String &topic, String &payload) {
 
   // MQTT messages will be received here
+  uint32_t messageStartMicros = micros();
+  DynamoteMemoryProbe memoryProbe(MEMORY_MQTT);
+  dynamoteMetrics.count(COUNTER_MQTT_MESSAGES);
 
-  // only react to commands
   String device_id_string = String(&mqttConfig.device_id[0]);
-  if (topic != "/devices/" + device_id_string + "/commands")
+
+  // metrics are requested with the "metrics" command subfolder and published as telemetry
+  if (topic == "/devices/" + device_id_string + "/commands/metrics") {
+    String metricsJsonString;
+    dynamoteMetrics.toJsonString(metricsJsonString);
+    mqtt->publishTelemetry("/metrics", metricsJsonString);
+    return;
+  }
+
+  // the status document with the "status" subfolder
+  if (topic == "/devices/" + device_id_string + "/commands/status") {
+    uint16_t statusLength;
+    const char *statusJson = dynamoteStatus.toJson(&statusLength);
+    mqtt->publishTelemetry("/status", statusJson, statusLength);
+    return;
+  }
+
+  // and the capture log with the "captures" subfolder
+  if (topic == "/devices/" + device_id_string + "/commands/captures") {
+    String capturesJsonString;
+    dynamoteCaptureLog.toJsonString(capturesJsonString);
+    if (mqtt->publishTelemetry("/captures", capturesJsonString))
+      dynamoteCaptureLog.acknowledge();
+    return;
+  }
+
+  // only react to commands
+  if (topic != "/devices/" + device_id_string + "/commands") {
+    dynamoteMetrics.drop(DROP_MQTT_WRONG_TOPIC);
     return;
+  }
+
+  DYNAMOTE_LOG_INFO("Incoming MQTT command: - %s", payload.c_str());
+  dynamoteMetrics.beginRequest(messageStartMicros);
+  uint8_t result = dynamotePtr->sendJsonRemoteCommand(payload.c_str(), payload.length(), DynamoteAdmission::clientKey(TRANSPORT_MQTT, 0, 0));
+  dynamoteMetrics.record(METRIC_MQTT_DISPATCH, micros() - messageStartMicros);
 
-  String command = payload;
-  Serial.println("Incoming MQTT command: - " + payload);
-  dynamotePtr->sendJsonRemoteCommand(command);
+  // MQTT has no reply, so tell the sender its command was refused on the errors telemetry subfolder
+  if (result == SEND_RESULT_RATE_LIMITED || result == SEND_RESULT_QUEUE_FULL || result == SEND_RESULT_NO_MEMORY)
+    mqtt->publishTelemetry("/errors", "{\"result\":" + String(result) + "}");
 }
 
 /******************************************************************************************************************
@@ -137,7 +179,7 @@ String getJwt(void) {
 #elif defined(__DYNAMOTE_SAMD21__)
   iat = WiFi.getTime();
 #endif
-  Serial.println("Refreshing JWT credential");
+  DYNAMOTE_LOG_INFO("Refreshing JWT credential");
   jwt = iotDevice->createJWT(iat, jwt_exp_secs);
   return jwt;
 }
@@ -178,11 +220,11 @@ void setupMqtt(DynamoteWiFi *_dynamote) {
   // skip if MQTT has not been configured
   //
   if (mqttConfig.enabled == false) {
-    Serial.println("MQTT is not configured, skipping setup.");
+    DYNAMOTE_LOG_INFO("MQTT is not configured, skipping setup.");
     return;
   }
 
-  Serial.println("Waiting on time sync...");
+  DYNAMOTE_LOG_INFO("Waiting on time sync...");
 #if defined(__DYNAMOTE_ESP32__)
   configTime(0, 0, ntp_primary, ntp_secondary);
   while (time(nullptr) < 1510644967) {
@@ -210,6 +252,13 @@ void setupMqtt(DynamoteWiFi *_dynamote) {
   mqtt->startMQTT();
 }
 
+/******************************************************************************************************************
+* mqttConnected
+******************************************************************************************************************/
+bool mqttConnected(void) {
+  return mqttConfig.enabled && mqttClient != NULL && mqttClient->connected();
+}
+
 /******************************************************************************************************************
 * mqttloop
 ******************************************************************************************************************/
@@ -225,30 +274,24 @@ void mqttloop(void) {
   // Do nothing if already connected.
   if (mqttClient->connected()) {
 		mqtt->loop();
-		delay(10);
 		return;
   }
 
-  // Init the backoff index.
-  static int backoff_index = 0;
-  // Init the last connect time.
-  static unsigned long last_connect_t_ms = 0;
-  // Init backoff delay.
-  static uint32_t backoff_ms = 0;
+  // Make sure a reconnect attempt is pending, it runs once the backoff delay has expired.
+  if (!mqttReconnectTimer.isScheduled())
+    dynamoteTimerWheel.schedule(&mqttReconnectTimer, backoff_ms);
+}
 
-  // Return if delay has not expired.
-  if ((millis() - last_connect_t_ms) < backoff_ms) {
-    return;
-  }
+/******************************************************************************************************************
+* mqttReconnect
+******************************************************************************************************************/
+void mqttReconnect(void *argument) {
 
-  // return if wifi is not connected
+  // return if wifi is not connected, mqttloop() schedules another attempt
   if (WiFi.status() != WL_CONNECTED) {
     return;
   }
 
-  // Set the connect ping.
-  last_connect_t_ms = millis();
-
   // Attempt connect
   mqtt->mqttConnectAsync();
 
@@ -257,8 +300,6 @@ void mqttloop(void) {
 
     // Reset the backoff index.
     backoff_index = 0;
-    // Reset the last ping time.
-    last_connect_t_ms = 0;
     // Reset backoff delay.
     backoff_ms = 0;
 
@@ -267,25 +308,22 @@ void mqttloop(void) {
     backoff_ms = min(int(pow(2, backoff_index++)) * 1000 + int(random(1000)), CONNECT_MAX_BACKOFF_MS);
 
     // Log the delay.
-    Serial.print("Failed to connect. Trying again after ");
-    Serial.print(backoff_ms);
-    Serial.println("ms");
+    DYNAMOTE_LOG_WARNING("Failed to connect. Trying again after %lums", (unsigned long)backoff_ms);
   }
 }
 
 /******************************************************************************************************************
 * configureMqtt
 ******************************************************************************************************************/
-void configureMqtt(String configurationJson) {
-
-  char jsonStringCharArray[configurationJson.length()+1];
-  configurationJson.toCharArray(jsonStringCharArray, configurationJson.length()+1);
+void configureMqtt(char *configurationJson, size_t length) {
 
-  StaticJsonDocument<500> jsonDoc;                  // <- plenty of size for this
-  DeserializationError deserializeStatus = deserializeJson(jsonDoc, jsonStringCharArray);
+  // parsed in place, the body and the document are both in the arena of the HTTP request
+  DynamoteArenaScope arenaScope;
+  DynamoteJsonDocument jsonDoc(500);                // <- plenty of size for this
+  DeserializationError deserializeStatus = deserializeJson(jsonDoc, configurationJson, length);
 
   if (deserializeStatus) {
-    Serial.println("Error, could not parse new MQTT configuration settings");
+    DYNAMOTE_LOG_ERROR("Error, could not parse new MQTT configuration settings");
     return;
   }
 
@@ -323,7 +361,7 @@ void configureMqtt(String configurationJson) {
 
     mqttConfig.enabled = true;
     
-    Serial.println("Waiting on time sync...");
+    DYNAMOTE_LOG_INFO("Waiting on time sync...");
 #if defined(__DYNAMOTE_ESP32__)
     configTime(0, 0, ntp_primary, ntp_secondary);
     while (time(nullptr) < 1510644967) {
@@ -0,0 +1,106 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEPROTOCOLS_H
+#define DYNAMOTEPROTOCOLS_H
+
+#include "Arduino.h"
+#include "IRLibProtocols.h"
+
+// Every IRLib2 protocol, see DYNAMOTE_PROTOCOLS in Dynamote.h
+#define DYNAMOTE_ALL_PROTOCOLS      0x1FFE
+
+#ifndef DYNAMOTE_PROTOCOLS
+#define DYNAMOTE_PROTOCOLS          DYNAMOTE_ALL_PROTOCOLS
+#endif
+
+// Usable in #if, the protocol numbers are macros in IRLibProtocols.h
+#define DYNAMOTE_HAS_PROTOCOL(protocol)   ((DYNAMOTE_PROTOCOLS >> (protocol)) & 1)
+
+#if (DYNAMOTE_PROTOCOLS & DYNAMOTE_ALL_PROTOCOLS) == 0
+#error "Error, DYNAMOTE_PROTOCOLS must include at least one protocol"
+#endif
+
+// DynamoteProtocolDescriptor.coding
+#define PROTOCOL_CODING_IRLIB       0       // not described here, only IRLib2 can send it
+#define PROTOCOL_CODING_DISTANCE    1       // pulse distance, one mark and one space per bit
+#define PROTOCOL_CODING_RC5         2       // manchester, markOne is the half bit time
+#define PROTOCOL_CODING_RC6         3       // manchester with a leader, markOne is the half bit time
+#define PROTOCOL_CODING_RCMM        4       // two bits per symbol, the space is spaceZero + symbol * spaceOne
+
+// DynamoteProtocolDescriptor.repeat, what is sent while a button is held
+#define PROTOCOL_REPEAT_FRAME       0       // the whole frame again
+#define PROTOCOL_REPEAT_CODE        1       // a separate repeat frame (head mark, half the head space, a mark), sent for REPEAT_CODE
+#define PROTOCOL_REPEAT_NO_HEADER   2       // the frame without its header, sent for a codeLength of 0
+#define PROTOCOL_REPEAT_TOGGLE      3       // the same frame, the toggle bit only changes on a new press
+
+// Everything needed to turn a value into mark/space timings, the same ones the IRLib2 sender would produce.
+typedef struct
+{
+	uint8_t coding;
+	uint8_t khz;
+	uint8_t defaultBits;                // used when codeLength is 0, or always with fixedBits
+	bool fixedBits;
+	uint16_t headMark;
+	uint16_t headSpace;
+	uint16_t markOne;
+	uint16_t markZero;
+	uint16_t spaceOne;
+	uint16_t spaceZero;
+	bool stopBit;                       // a final markOne after the data
+	uint8_t frames;                     // frames per send
+	uint16_t frameExtentUs;             // each frame but the last is padded out to this, 0 for none
+	uint8_t repeat;
+	uint8_t toggleBit;                  // counted from the top, bit (bits - toggleBit) is the toggle bit
+	uint16_t holdPeriodMs;              // start to start time of the frames while a button is held
+} DynamoteProtocolDescriptor;
+
+// Indexed by protocol number. Raw codes (UNKNOWN) only use holdPeriodMs.
+constexpr DynamoteProtocolDescriptor protocolDescriptors[] = {
+	//  coding                     kHz bits fixed  head mark  head space  mark 1  mark 0  space 1  space 0  stop   frames extent  repeat                     toggle hold ms
+	{ PROTOCOL_CODING_IRLIB,    36, 0,  false, 0,         0,          0,      0,      0,       0,       false, 1,     0,      PROTOCOL_REPEAT_FRAME,     0,     110 },   // UNKNOWN
+	{ PROTOCOL_CODING_DISTANCE, 38, 32, true,  564*16,    564*8,      564,    564,    564*3,   564,     true,  1,     0,      PROTOCOL_REPEAT_CODE,      0,     108 },   // NEC
+	{ PROTOCOL_CODING_DISTANCE, 40, 12, false, 600*4,     600,        600*2,  600,    600,     600,     false, 3,     45000,  PROTOCOL_REPEAT_FRAME,     0,     135 },   // SONY
+	{ PROTOCOL_CODING_RC5,      36, 13, false, 0,         0,          889,    889,    889,     889,     false, 1,     0,      PROTOCOL_REPEAT_TOGGLE,    2,     114 },   // RC5
+	{ PROTOCOL_CODING_RC6,      36, 20, false, 444*6,     889,        444,    444,    444,     444,     false, 1,     0,      PROTOCOL_REPEAT_TOGGLE,    4,     107 },   // RC6
+	{ PROTOCOL_CODING_DISTANCE, 57, 22, true,  833*4,     833*4,      833,    833,    833*3,   833,     true,  1,     0,      PROTOCOL_REPEAT_FRAME,     0,     105 },   // PANASONIC_OLD
+	{ PROTOCOL_CODING_DISTANCE, 38, 16, true,  525*16,    525*8,      525,    525,    525*3,   525,     true,  1,     0,      PROTOCOL_REPEAT_NO_HEADER, 0,     60  },   // JVC
+	{ PROTOCOL_CODING_DISTANCE, 38, 32, true,  564*8,     564*8,      564,    564,    564*3,   564,     true,  1,     0,      PROTOCOL_REPEAT_FRAME,     0,     108 },   // NECX
+	{ PROTOCOL_CODING_IRLIB,    38, 36, true,  0,         0,          0,      0,      0,       0,       false, 1,     0,      PROTOCOL_REPEAT_FRAME,     0,     110 },   // SAMSUNG36
+	{ PROTOCOL_CODING_DISTANCE, 39, 16, true,  9000,      4400,       550,    550,    4400,    2200,    true,  1,     0,      PROTOCOL_REPEAT_CODE,      0,     110 },   // GICABLE
+	{ PROTOCOL_CODING_IRLIB,    38, 16, true,  0,         0,          0,      0,      0,       0,       false, 1,     0,      PROTOCOL_REPEAT_FRAME,     0,     110 },   // DIRECTV
+	{ PROTOCOL_CODING_RCMM,     36, 12, false, 416,       277,        166,    166,    167,     277,     false, 1,     0,      PROTOCOL_REPEAT_FRAME,     0,     110 },   // RCMM
+	{ PROTOCOL_CODING_IRLIB,    38, 32, true,  0,         0,          0,      0,      0,       0,       false, 1,     0,      PROTOCOL_REPEAT_FRAME,     0,     110 }    // CYKM
+};
+
+#define PROTOCOL_DESCRIPTOR_COUNT   (sizeof(protocolDescriptors) / sizeof(protocolDescriptors[0]))
+
+// Sony pads its 8 bit frames to 22ms instead of 45ms, like IRLib2
+#define SONY_SHORT_FRAME_BITS       8
+#define SONY_SHORT_FRAME_EXTENT_US  22000
+
+constexpr const DynamoteProtocolDescriptor &protocolDescriptor(uint8_t protocol)
+{
+	return protocolDescriptors[(protocol < PROTOCOL_DESCRIPTOR_COUNT) ? protocol : UNKNOWN];
+}
+
+// frameExtentUs for a frame of the given length
+constexpr uint16_t protocolFrameExtentUs(uint8_t protocol, uint8_t bits)
+{
+	return (protocol == SONY && bits == SONY_SHORT_FRAME_BITS) ? SONY_SHORT_FRAME_EXTENT_US : protocolDescriptor(protocol).frameExtentUs;
+}
+
+#endif
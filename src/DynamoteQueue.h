@@ -0,0 +1,98 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEQUEUE_H
+#define DYNAMOTEQUEUE_H
+
+#include "Arduino.h"
+
+// Bounded single-producer/single-consumer queue. Only the producer moves head and only the consumer
+// moves tail, so one side may push while the other pops without a lock.
+// Several items can be reserved and then published together with commit(), so a consumer never sees
+// half of a batch.
+template <typename T, uint8_t CAPACITY>
+class DynamoteQueue
+{
+	public:
+		uint8_t count(void)
+		{
+			uint8_t currentHead = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+			uint8_t currentTail = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+			return (currentHead + SLOTS - currentTail) % SLOTS;
+		}
+
+		uint8_t freeSlots(void)
+		{
+			return CAPACITY - count();
+		}
+
+		bool isEmpty(void)
+		{
+			return count() == 0;
+		}
+
+		// producer side, slot offset from the current head. Check freeSlots() first.
+		T* reserve(uint8_t offset)
+		{
+			return &items[(head + offset) % SLOTS];
+		}
+
+		void commit(uint8_t itemCount)
+		{
+			__atomic_store_n(&head, (uint8_t)((head + itemCount) % SLOTS), __ATOMIC_RELEASE);
+		}
+
+		bool push(const T &item)
+		{
+			if (freeSlots() == 0)
+				return false;
+			*reserve(0) = item;
+			commit(1);
+			return true;
+		}
+
+		// consumer side
+		T* peek(void)
+		{
+			if (tail == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+				return NULL;
+			return &items[tail];
+		}
+
+		// consumer side, the item offset places behind the oldest one, NULL past the newest one
+		T* peek(uint8_t offset)
+		{
+			uint8_t available = (__atomic_load_n(&head, __ATOMIC_ACQUIRE) + SLOTS - tail) % SLOTS;
+			if (offset >= available)
+				return NULL;
+			return &items[(tail + offset) % SLOTS];
+		}
+
+		void pop(void)
+		{
+			if (peek() != NULL)
+				__atomic_store_n(&tail, (uint8_t)((tail + 1) % SLOTS), __ATOMIC_RELEASE);
+		}
+
+	private:
+		// one slot is always left empty to tell a full queue from an empty one
+		static const uint8_t SLOTS = CAPACITY + 1;
+		T items[SLOTS];
+		uint8_t head = 0;
+		uint8_t tail = 0;
+};
+
+#endif
@@ -0,0 +1,46 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "DynamoteRawSender.h"
+
+/******************************************************************************************************************
+* send
+******************************************************************************************************************/
+void DynamoteRawSender::send(DynamoteLinkedList &raw, uint8_t length, uint8_t khz)
+{
+	length = min((int)length, raw.size());
+
+	enableIROut(khz);
+	for (uint8_t x = 0; x < length; x++) {
+		if (x & 1)
+			space(raw.get(x));
+		else
+			mark(raw.get(x));
+	}
+	space(0);
+}
+
+void DynamoteRawSender::send(const uint16_t *durations, uint16_t length, uint8_t khz)
+{
+	enableIROut(khz);
+	for (uint16_t x = 0; x < length; x++) {
+		if (x & 1)
+			space(durations[x]);
+		else
+			mark(durations[x]);
+	}
+	space(0);
+}
@@ -0,0 +1,32 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTERAWSENDER_H
+#define DYNAMOTERAWSENDER_H
+
+#include <IRLibSendBase.h>
+#include <DynamoteLinkedList.h>
+
+// Sends a raw code straight from its compressed form, without expanding it into a buffer first.
+// Also sends the timings made by DynamoteEncoder.
+class DynamoteRawSender : public virtual IRsendBase
+{
+	public:
+		void send(DynamoteLinkedList &raw, uint8_t length, uint8_t khz);
+		void send(const uint16_t *durations, uint16_t length, uint8_t khz);
+};
+
+#endif
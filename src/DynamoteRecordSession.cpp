@@ -0,0 +1,157 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <Dynamote.h>
+#include "DynamoteRecordSession.h"
+
+/******************************************************************************************************************
+* DynamoteRecordSessions constructor
+******************************************************************************************************************/
+DynamoteRecordSessions::DynamoteRecordSessions(void)
+{
+	memset(sessions, 0, sizeof(sessions));
+}
+
+/******************************************************************************************************************
+* open
+******************************************************************************************************************/
+uint8_t DynamoteRecordSessions::open(uint32_t owner, uint32_t timeoutMs, unsigned long now)
+{
+	RecordSession *session = find(owner);
+	if (session == NULL) {
+		for (uint8_t x = 0; x < RECORD_MAX_SESSIONS && session == NULL; x++) {
+			if (sessions[x].id == 0)
+				session = &sessions[x];
+		}
+		if (session == NULL) {
+			DYNAMOTE_LOG_WARNING("Warning, all %u record sessions are in use", RECORD_MAX_SESSIONS);
+			return 0;
+		}
+
+		// ids are only for the client to tell its sessions apart, 0 stays free
+		if (++lastId == 0)
+			lastId = 1;
+		session->id = lastId;
+		session->owner = owner;
+		// only commands recorded from now on
+		session->cursor = headSequence;
+		DYNAMOTE_LOG_INFO("Record session %u opened", session->id);
+	}
+
+	session->expires = (timeoutMs != 0);
+	session->deadline = now + timeoutMs;
+	return session->id;
+}
+
+/******************************************************************************************************************
+* close
+******************************************************************************************************************/
+bool DynamoteRecordSessions::close(uint32_t owner)
+{
+	RecordSession *session = find(owner);
+	if (session == NULL)
+		return false;
+	DYNAMOTE_LOG_INFO("Record session %u closed", session->id);
+	session->id = 0;
+	return true;
+}
+
+/******************************************************************************************************************
+* expire
+******************************************************************************************************************/
+uint32_t DynamoteRecordSessions::expire(unsigned long now)
+{
+	uint32_t untilNext = TIMER_NONE;
+	for (uint8_t x = 0; x < RECORD_MAX_SESSIONS; x++) {
+		if (sessions[x].id == 0 || !sessions[x].expires)
+			continue;
+		// wrap safe, the deadline is never far away
+		long remaining = (long)(sessions[x].deadline - now);
+		if (remaining <= 0) {
+			DYNAMOTE_LOG_INFO("Record session %u timed out", sessions[x].id);
+			sessions[x].id = 0;
+		}
+		else if ((uint32_t)remaining < untilNext) {
+			untilNext = remaining;
+		}
+	}
+	return untilNext;
+}
+
+/******************************************************************************************************************
+* isEmpty
+******************************************************************************************************************/
+bool DynamoteRecordSessions::isEmpty(void)
+{
+	for (uint8_t x = 0; x < RECORD_MAX_SESSIONS; x++) {
+		if (sessions[x].id != 0)
+			return false;
+	}
+	return true;
+}
+
+/******************************************************************************************************************
+* count
+******************************************************************************************************************/
+uint8_t DynamoteRecordSessions::count(void)
+{
+	uint8_t open = 0;
+	for (uint8_t x = 0; x < RECORD_MAX_SESSIONS; x++) {
+		if (sessions[x].id != 0)
+			open++;
+	}
+	return open;
+}
+
+/******************************************************************************************************************
+* publish
+******************************************************************************************************************/
+uint16_t DynamoteRecordSessions::publish(void)
+{
+	return headSequence++;
+}
+
+/******************************************************************************************************************
+* next
+******************************************************************************************************************/
+bool DynamoteRecordSessions::next(uint32_t owner, uint16_t *sequence)
+{
+	RecordSession *session = find(owner);
+	if (session == NULL || session->cursor == headSequence)
+		return false;
+
+	// the history has moved on past this session, skip to the oldest command still in it
+	uint16_t behind = headSequence - session->cursor;
+	if (behind > RECORD_HISTORY_LENGTH) {
+		DYNAMOTE_LOG_WARNING("Warning, record session %u missed %u commands", session->id, behind - RECORD_HISTORY_LENGTH);
+		dynamoteMetrics.drop(DROP_RECORD_OVERRUN);
+		session->cursor = headSequence - RECORD_HISTORY_LENGTH;
+	}
+	*sequence = session->cursor++;
+	return true;
+}
+
+/******************************************************************************************************************
+* find
+******************************************************************************************************************/
+RecordSession *DynamoteRecordSessions::find(uint32_t owner)
+{
+	for (uint8_t x = 0; x < RECORD_MAX_SESSIONS; x++) {
+		if (sessions[x].id != 0 && sessions[x].owner == owner)
+			return &sessions[x];
+	}
+	return NULL;
+}
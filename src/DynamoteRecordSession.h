@@ -0,0 +1,68 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTERECORDSESSION_H
+#define DYNAMOTERECORDSESSION_H
+
+#include "Arduino.h"
+
+// Clients that can record at the same time, the receiver stays on while any of them is recording
+#define RECORD_MAX_SESSIONS     4
+
+// Recorded commands kept for sessions that have not picked them up yet. A session that falls further behind
+// loses the oldest ones.
+#define RECORD_HISTORY_LENGTH   4
+
+typedef struct
+{
+	uint8_t id;                         // 0 for a free slot
+	uint32_t owner;                     // DynamoteAdmission::clientKey() of the client that opened it
+	bool expires;                       // false for connection based transports, they close it themselves
+	unsigned long deadline;             // millis() at which it closes by itself
+	uint16_t cursor;                    // sequence number of the next recorded command it gets
+} RecordSession;
+
+// The record sessions of all transports. Every recorded command gets a sequence number and is kept in the
+// history until it is overwritten, each session reads the history from where it was opened with its own cursor,
+// so one recorded command reaches every client that was recording when it came in and clients never take
+// commands from each other.
+// Only the loop task uses the sessions, the IR task hands recorded commands over through the capture queue.
+class DynamoteRecordSessions
+{
+	public:
+		DynamoteRecordSessions(void);
+		// opens a session for the owner, or extends the one it has. A timeoutMs of 0 keeps it open until it is
+		// closed. Returns the session id, 0 if all are taken.
+		uint8_t open(uint32_t owner, uint32_t timeoutMs, unsigned long now);
+		// returns false if the owner had no session
+		bool close(uint32_t owner);
+		// closes the sessions whose deadline has passed, returns the ms until the next one does, or TIMER_NONE
+		uint32_t expire(unsigned long now);
+		bool isEmpty(void);
+		uint8_t count(void);
+		// sequence number for the next recorded command, store it at sequence % RECORD_HISTORY_LENGTH
+		uint16_t publish(void);
+		// sequence number of the next recorded command for the owner, false if there is none
+		bool next(uint32_t owner, uint16_t *sequence);
+
+	private:
+		RecordSession sessions[RECORD_MAX_SESSIONS];
+		uint16_t headSequence = 0;
+		uint8_t lastId = 0;
+		RecordSession *find(uint32_t owner);
+};
+
+#endif
@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "DynamoteRouter.h"
+
+// A route whose hash matches is compared in full, so an unknown path that happens to share a hash is not taken for it.
+// Two routes with the same hash would be duplicate case labels, so the hashing is checked to be perfect at compile time.
+#define ROUTE(requestLine, route) \
+	case dynamoteHash(requestLine): \
+		return (length == sizeof(requestLine) - 1 && memcmp(line, requestLine, length) == 0) ? route : ROUTE_NONE;
+
+/******************************************************************************************************************
+* dynamoteHashBytes
+******************************************************************************************************************/
+uint32_t dynamoteHashBytes(const char *data, uint16_t length)
+{
+	uint32_t hash = ROUTER_FNV_BASIS_32;
+	for (uint16_t x = 0; x < length; x++)
+		hash = (hash ^ (uint8_t)data[x]) * ROUTER_FNV_PRIME_32;
+	return hash;
+}
+
+/******************************************************************************************************************
+* routeRequestLine
+******************************************************************************************************************/
+DynamoteRoute routeRequestLine(const char *line, uint16_t length)
+{
+	// only the method and path are routed, drop the query string and the protocol version
+	uint16_t methodEnd = 0;
+	while (methodEnd < length && line[methodEnd] != ' ')
+		methodEnd++;
+	uint16_t pathEnd = methodEnd + 1;
+	while (pathEnd < length && line[pathEnd] != ' ' && line[pathEnd] != '?')
+		pathEnd++;
+	if (pathEnd > length)
+		return ROUTE_NONE;
+	length = pathEnd;
+
+	switch (dynamoteHashBytes(line, length)) {
+		// the app has always been free to use either method
+		ROUTE("POST /sendRemoteCommand", ROUTE_SEND_REMOTE_COMMAND)
+		ROUTE("GET /sendRemoteCommand", ROUTE_SEND_REMOTE_COMMAND)
+		ROUTE("POST /configureMQTT", ROUTE_CONFIGURE_MQTT)
+		ROUTE("GET /configureMQTT", ROUTE_CONFIGURE_MQTT)
+		ROUTE("POST /getRecordedCommand", ROUTE_GET_RECORDED_COMMAND)
+		ROUTE("GET /getRecordedCommand", ROUTE_GET_RECORDED_COMMAND)
+		ROUTE("POST /getRecordedCommandDone", ROUTE_GET_RECORDED_COMMAND_DONE)
+		ROUTE("GET /getRecordedCommandDone", ROUTE_GET_RECORDED_COMMAND_DONE)
+		ROUTE("POST /metrics", ROUTE_METRICS)
+		ROUTE("GET /metrics", ROUTE_METRICS)
+		ROUTE("POST /captures", ROUTE_CAPTURES)
+		ROUTE("GET /captures", ROUTE_CAPTURES)
+		ROUTE("POST /status", ROUTE_STATUS)
+		ROUTE("GET /status", ROUTE_STATUS)
+		ROUTE("GET /ws", ROUTE_WEBSOCKET)
+		default:
+			return ROUTE_NONE;
+	}
+}
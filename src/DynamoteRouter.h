@@ -0,0 +1,49 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEROUTER_H
+#define DYNAMOTEROUTER_H
+
+#include "Arduino.h"
+
+#define ROUTER_FNV_PRIME_32     16777619UL
+#define ROUTER_FNV_BASIS_32     2166136261UL
+
+// FNV-1a of a zero terminated string, usable in case labels so the route table is hashed at compile time
+constexpr uint32_t dynamoteHash(const char *string, uint32_t hash = ROUTER_FNV_BASIS_32)
+{
+	return (*string == 0) ? hash : dynamoteHash(string + 1, (uint32_t)((hash ^ (uint8_t)*string) * ROUTER_FNV_PRIME_32));
+}
+
+// The same hash over a byte range, for request data that is not zero terminated
+uint32_t dynamoteHashBytes(const char *data, uint16_t length);
+
+enum DynamoteRoute {
+	ROUTE_NONE,
+	ROUTE_SEND_REMOTE_COMMAND,
+	ROUTE_CONFIGURE_MQTT,
+	ROUTE_GET_RECORDED_COMMAND,
+	ROUTE_GET_RECORDED_COMMAND_DONE,
+	ROUTE_METRICS,
+	ROUTE_CAPTURES,
+	ROUTE_STATUS,
+	ROUTE_WEBSOCKET
+};
+
+// Matches an HTTP request line ("POST /sendRemoteCommand HTTP/1.1") against the route table, without copying it
+DynamoteRoute routeRequestLine(const char *line, uint16_t length);
+
+#endif
@@ -0,0 +1,96 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <Dynamote.h>
+#include "DynamoteStatus.h"
+
+DynamoteStatus dynamoteStatus;
+
+/******************************************************************************************************************
+* DynamoteStatus constructor
+******************************************************************************************************************/
+DynamoteStatus::DynamoteStatus(void) {}
+
+/******************************************************************************************************************
+* setBuilder
+******************************************************************************************************************/
+void DynamoteStatus::setBuilder(DynamoteStatusBuilder _builder, void *_argument)
+{
+	builder = _builder;
+	argument = _argument;
+	invalidate();
+}
+
+/******************************************************************************************************************
+* invalidate
+******************************************************************************************************************/
+void DynamoteStatus::invalidate(void)
+{
+	dynamoteAtomicAdd(&generation, (uint32_t)1);
+}
+
+/******************************************************************************************************************
+* toJson
+******************************************************************************************************************/
+const char *DynamoteStatus::toJson(uint16_t *length, const char *prefix, const char *suffix)
+{
+	dynamoteMetrics.count(COUNTER_STATUS_REQUESTS);
+	// a change while the document is being built moves the generation on again, so it is not lost
+	uint32_t currentGeneration = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+	if (currentGeneration != cachedGeneration)
+		rebuild(currentGeneration);
+
+	// the envelope and the uptime go around the cached text, which stays where it is
+	size_t prefixLength = min(strlen(prefix), (size_t)STATUS_PREFIX_RESERVE);
+	char *start = &buffer[STATUS_PREFIX_RESERVE - prefixLength];
+	memcpy(start, prefix, prefixLength);
+	char *end = &buffer[STATUS_PREFIX_RESERVE + cachedLength];
+	int suffixLength = snprintf(end, STATUS_SUFFIX_RESERVE, "%s\"uptime\":%lu}%s", (cachedLength > 1) ? "," : "",
+	                            (unsigned long)millis(), suffix);
+	suffixLength = constrain(suffixLength, 0, STATUS_SUFFIX_RESERVE - 1);
+	*length = prefixLength + cachedLength + suffixLength;
+	return start;
+}
+
+size_t DynamoteStatus::toJson(Print &output)
+{
+	uint16_t length;
+	const char *json = toJson(&length);
+	return output.write((const uint8_t*)json, length);
+}
+
+/******************************************************************************************************************
+* rebuild
+******************************************************************************************************************/
+void DynamoteStatus::rebuild(uint32_t currentGeneration)
+{
+	dynamoteMetrics.count(COUNTER_STATUS_BUILDS);
+	DynamoteArenaScope arenaScope;
+	DynamoteJsonDocument jsonDoc(STATUS_JSON_CAPACITY);
+	JsonObject status = jsonDoc.to<JsonObject>();
+	if (builder != NULL)
+		builder(status, argument);
+
+	if (jsonDoc.overflowed() || measureJson(jsonDoc) >= STATUS_MAX_LENGTH) {
+		DYNAMOTE_LOG_WARNING("Warning, status does not fit in %u bytes", STATUS_MAX_LENGTH);
+		jsonDoc.clear();
+		jsonDoc.to<JsonObject>();
+	}
+	// keep it open, the uptime goes in last
+	cachedLength = serializeJson(jsonDoc, &buffer[STATUS_PREFIX_RESERVE], STATUS_MAX_LENGTH);
+	cachedLength--;
+	cachedGeneration = currentGeneration;
+}
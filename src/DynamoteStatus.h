@@ -0,0 +1,66 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTESTATUS_H
+#define DYNAMOTESTATUS_H
+
+#include "Arduino.h"
+#include <ArduinoJson.h>              // https://arduinojson.org/
+
+// Longest status document that can be cached, without the uptime
+#define STATUS_MAX_LENGTH       512
+
+// Memory for the JSON document while the status is built, from the arena
+#define STATUS_JSON_CAPACITY    1024
+
+// Room in front of the cached document for an envelope like {"type":"status","status":, and behind it for the
+// uptime and the end of the envelope
+#define STATUS_PREFIX_RESERVE   32
+#define STATUS_SUFFIX_RESERVE   32
+
+// Fills in the status document, called only when the cached one is out of date
+typedef void (*DynamoteStatusBuilder)(JsonObject status, void *argument);
+
+// The status and capability document: what the device supports and how it is set up. Clients poll it often and
+// it rarely changes, so it is serialized once and kept. Whatever changes something in it calls invalidate(), the
+// next request builds it again. Only the uptime is new in every answer, it is written behind the cached text, in
+// place, so the document is never copied.
+class DynamoteStatus
+{
+	public:
+		DynamoteStatus(void);
+		void setBuilder(DynamoteStatusBuilder _builder, void *_argument);
+		// safe to call from callbacks and other tasks
+		void invalidate(void);
+		// prefix{...,"uptime":ms}suffix, put together in place and valid until the next call. Loop task only.
+		const char *toJson(uint16_t *length, const char *prefix = "", const char *suffix = "");
+		// {...,"uptime":ms} in a single write
+		size_t toJson(Print &output);
+
+	private:
+		DynamoteStatusBuilder builder = NULL;
+		void *argument = NULL;
+		volatile uint32_t generation = 1;
+		uint32_t cachedGeneration = 0;
+		// the serialized document without its closing brace starts at STATUS_PREFIX_RESERVE
+		char buffer[STATUS_PREFIX_RESERVE + STATUS_MAX_LENGTH + STATUS_SUFFIX_RESERVE];
+		uint16_t cachedLength = 0;
+		void rebuild(uint32_t currentGeneration);
+};
+
+extern DynamoteStatus dynamoteStatus;
+
+#endif
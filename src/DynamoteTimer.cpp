@@ -0,0 +1,138 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "DynamoteTimer.h"
+
+DynamoteTimerWheel dynamoteTimerWheel;
+
+/******************************************************************************************************************
+* DynamoteTimer constructor
+******************************************************************************************************************/
+DynamoteTimer::DynamoteTimer(DynamoteTimerCallback _callback, void *_argument) : callback(_callback), argument(_argument) {}
+
+/******************************************************************************************************************
+* isScheduled
+******************************************************************************************************************/
+bool DynamoteTimer::isScheduled(void)
+{
+	return scheduled;
+}
+
+/******************************************************************************************************************
+* DynamoteTimerWheel constructor
+******************************************************************************************************************/
+DynamoteTimerWheel::DynamoteTimerWheel(void)
+{
+	for (uint8_t x = 0; x < TIMER_WHEEL_SLOTS; x++)
+		slots[x] = NULL;
+}
+
+/******************************************************************************************************************
+* schedule
+******************************************************************************************************************/
+void DynamoteTimerWheel::schedule(DynamoteTimer *timer, uint32_t delayMs)
+{
+	// rescheduling a pending timer moves it
+	cancel(timer);
+
+	// never due before the next millisecond, so a callback that reschedules itself cannot spin inside advance()
+	timer->expiry = millis() + max(delayMs, (uint32_t)1);
+	uint8_t slot = timer->expiry & (TIMER_WHEEL_SLOTS - 1);
+	timer->previous = NULL;
+	timer->next = slots[slot];
+	if (timer->next != NULL)
+		timer->next->previous = timer;
+	slots[slot] = timer;
+	timer->scheduled = true;
+}
+
+/******************************************************************************************************************
+* cancel
+******************************************************************************************************************/
+void DynamoteTimerWheel::cancel(DynamoteTimer *timer)
+{
+	if (!timer->scheduled)
+		return;
+
+	if (timer->previous != NULL)
+		timer->previous->next = timer->next;
+	else
+		slots[timer->expiry & (TIMER_WHEEL_SLOTS - 1)] = timer->next;
+	if (timer->next != NULL)
+		timer->next->previous = timer->previous;
+	timer->next = NULL;
+	timer->previous = NULL;
+	timer->scheduled = false;
+}
+
+/******************************************************************************************************************
+* advance
+******************************************************************************************************************/
+void DynamoteTimerWheel::advance(uint32_t now)
+{
+	if (!started) {
+		started = true;
+		lastAdvance = now - 1;
+	}
+
+	// visit every slot that has come due since the last call, or every slot once if a full turn has passed
+	uint32_t elapsed = now - lastAdvance;
+	if (elapsed == 0)
+		return;
+	if (elapsed > TIMER_WHEEL_SLOTS)
+		elapsed = TIMER_WHEEL_SLOTS;
+	for (uint32_t tick = now - elapsed + 1; tick != now + 1; tick++)
+		runSlot(tick & (TIMER_WHEEL_SLOTS - 1), now);
+	lastAdvance = now;
+}
+
+/******************************************************************************************************************
+* millisUntilNextTimer
+******************************************************************************************************************/
+uint32_t DynamoteTimerWheel::millisUntilNextTimer(uint32_t now)
+{
+	uint32_t soonest = TIMER_NONE;
+	for (uint8_t x = 0; x < TIMER_WHEEL_SLOTS; x++) {
+		for (DynamoteTimer *timer = slots[x]; timer != NULL; timer = timer->next) {
+			// signed difference, so this keeps working when millis() wraps around
+			int32_t remaining = (int32_t)(timer->expiry - now);
+			if (remaining <= 0)
+				return 0;
+			if ((uint32_t)remaining < soonest)
+				soonest = remaining;
+		}
+	}
+	return soonest;
+}
+
+/******************************************************************************************************************
+* runSlot
+******************************************************************************************************************/
+void DynamoteTimerWheel::runSlot(uint8_t slot, uint32_t now)
+{
+	DynamoteTimer *timer = slots[slot];
+	while (timer != NULL) {
+		// timers more than one turn away share the slot, only fire the ones that are due
+		if ((int32_t)(now - timer->expiry) < 0) {
+			timer = timer->next;
+			continue;
+		}
+		cancel(timer);
+		timer->callback(timer->argument);
+		// the callback may have scheduled or cancelled other timers, start over from the head of the slot
+		timer = slots[slot];
+	}
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTETIMER_H
+#define DYNAMOTETIMER_H
+
+#include "Arduino.h"
+
+// Number of slots in the timer wheel, must be a power of two. Each slot covers one millisecond,
+// timers further out than one turn of the wheel simply stay in their slot until they are due.
+#define TIMER_WHEEL_SLOTS       64
+
+#define TIMER_NONE              0xFFFFFFFF
+
+typedef void (*DynamoteTimerCallback)(void *argument);
+
+class DynamoteTimerWheel;
+
+// A timer owned by the subsystem that schedules it. The wheel only links it into a slot, so
+// scheduling and cancelling never allocate.
+class DynamoteTimer
+{
+	public:
+		DynamoteTimer(DynamoteTimerCallback _callback, void *_argument);
+		bool isScheduled(void);
+
+	private:
+		friend class DynamoteTimerWheel;
+		DynamoteTimerCallback callback;
+		void *argument;
+		uint32_t expiry = 0;
+		DynamoteTimer *next = NULL;
+		DynamoteTimer *previous = NULL;
+		bool scheduled = false;
+};
+
+class DynamoteTimerWheel
+{
+	public:
+		DynamoteTimerWheel(void);
+		void schedule(DynamoteTimer *timer, uint32_t delayMs);
+		void cancel(DynamoteTimer *timer);
+		void advance(uint32_t now);
+		uint32_t millisUntilNextTimer(uint32_t now);
+
+	private:
+		DynamoteTimer *slots[TIMER_WHEEL_SLOTS];
+		uint32_t lastAdvance = 0;
+		bool started = false;
+		void runSlot(uint8_t slot, uint32_t now);
+};
+
+extern DynamoteTimerWheel dynamoteTimerWheel;
+
+#endif
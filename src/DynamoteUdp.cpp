@@ -0,0 +1,467 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/******************************************************************************************************************
+* includes
+******************************************************************************************************************/
+#include <DynamoteUdp.h>
+#ifndef DYNAMOTE_BLE
+
+#define COAP_VERSION              1
+#define COAP_TYPE_CON             0
+#define COAP_TYPE_NON             1
+#define COAP_TYPE_ACK             2
+#define COAP_CODE_POST            0x02
+#define COAP_CODE_CHANGED         0x44      // 2.04
+#define COAP_CODE_BAD_REQUEST     0x80      // 4.00
+#define COAP_CODE_BAD_OPTION      0x82      // 4.02
+#define COAP_CODE_NOT_FOUND       0x84      // 4.04
+#define COAP_CODE_METHOD_NOT_ALLOWED 0x85   // 4.05
+#define COAP_CODE_TOO_MANY_REQUESTS 0x9D    // 4.29
+#define COAP_CODE_UNAVAILABLE     0xA3      // 5.03
+#define COAP_OPTION_URI_PATH      11
+#define COAP_PAYLOAD_MARKER       0xFF
+
+/******************************************************************************************************************
+* constructor
+******************************************************************************************************************/
+DynamoteUdp::DynamoteUdp(Dynamote *_dynamote) : dynamote(_dynamote) {}
+
+/******************************************************************************************************************
+* begin
+******************************************************************************************************************/
+void DynamoteUdp::begin(uint16_t port)
+{
+	udp.begin(port);
+	multicastUdp.beginMulticast(IPAddress(DYNAMOTE_MULTICAST_ADDRESS), DYNAMOTE_MULTICAST_PORT);
+}
+
+/******************************************************************************************************************
+* loop
+******************************************************************************************************************/
+void DynamoteUdp::loop(void)
+{
+	receive(udp, false);
+	receive(multicastUdp, true);
+}
+
+/******************************************************************************************************************
+* joinGroup
+******************************************************************************************************************/
+bool DynamoteUdp::joinGroup(const char *name)
+{
+	uint32_t group = dynamoteHashBytes(name, strlen(name));
+	if (isMember(group))
+		return true;
+	if (groupCount >= UDP_MAX_GROUPS) {
+		DYNAMOTE_LOG_WARNING("No room to join group %s", name);
+		return false;
+	}
+	groups[groupCount++] = group;
+	dynamoteStatus.invalidate();
+	return true;
+}
+
+/******************************************************************************************************************
+* getGroupCount
+******************************************************************************************************************/
+uint8_t DynamoteUdp::getGroupCount(void)
+{
+	return groupCount;
+}
+
+/******************************************************************************************************************
+* leaveGroup
+******************************************************************************************************************/
+void DynamoteUdp::leaveGroup(const char *name)
+{
+	uint32_t group = dynamoteHashBytes(name, strlen(name));
+	for (uint8_t x = 0; x < groupCount; x++) {
+		if (groups[x] == group) {
+			groups[x] = groups[--groupCount];
+			dynamoteStatus.invalidate();
+			return;
+		}
+	}
+}
+
+/******************************************************************************************************************
+* receive
+******************************************************************************************************************/
+void DynamoteUdp::receive(WiFiUDP &socket, bool multicast)
+{
+	int length = socket.parsePacket();
+	if (length <= 0)
+		return;
+
+	uint32_t datagramStartMicros = micros();
+	dynamoteMetrics.count(COUNTER_UDP_DATAGRAMS);
+	if (length > UDP_MAX_DATAGRAM) {
+		socket.flush();
+		dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+		return;
+	}
+	length = socket.read(datagram, length);
+	if (length <= 0)
+		return;
+	datagram[length] = 0;
+	currentStartMicros = datagramStartMicros;
+
+	// a datagram to the multicast address without a group of its own goes to every device
+	current = &socket;
+	currentGroup = multicast ? dynamoteHash(UDP_GROUP_ALL) : 0;
+
+	// the first byte tells the three formats apart: JSON starts with a bracket,
+	// CoAP has version 1 in the top two bits, binary has its own magic byte
+	if (datagram[0] == UDP_BINARY_MAGIC)
+		handleBinary(length);
+	else if (datagram[0] == '{' || datagram[0] == '[')
+		handleJson(length);
+	else if ((datagram[0] >> 6) == COAP_VERSION)
+		handleCoap(length);
+	else
+		dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+
+	dynamoteMetrics.record(METRIC_UDP_DISPATCH, micros() - datagramStartMicros);
+}
+
+/******************************************************************************************************************
+* handleBinary
+******************************************************************************************************************/
+void DynamoteUdp::handleBinary(uint16_t length)
+{
+	if (length < UDP_BINARY_HEADER_LENGTH) {
+		dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+		return;
+	}
+	uint8_t flags = datagram[1];
+	uint16_t sequence = datagram[2] | (datagram[3] << 8);
+	uint16_t index = UDP_BINARY_HEADER_LENGTH;
+
+	if (flags & UDP_FLAG_GROUP) {
+		if (length < UDP_BINARY_HEADER_LENGTH + UDP_BINARY_GROUP_LENGTH) {
+			dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+			return;
+		}
+		uint32_t group = (uint32_t)datagram[index] | ((uint32_t)datagram[index + 1] << 8) |
+		                 ((uint32_t)datagram[index + 2] << 16) | ((uint32_t)datagram[index + 3] << 24);
+		index += UDP_BINARY_GROUP_LENGTH;
+		if (!acceptGroup(group))
+			return;
+	}
+
+	uint8_t result;
+	UdpDedupEntry *duplicate = findDuplicate(UDP_FORMAT_BINARY, sequence);
+	if (duplicate != NULL) {
+		// a retransmission, the commands are already queued so only repeat the acknowledgment
+		dynamoteMetrics.drop(DROP_UDP_DUPLICATE);
+		result = duplicate->result;
+	}
+	else {
+		result = parseBinaryCommands(index, length);
+		rememberSequence(UDP_FORMAT_BINARY, sequence, result);
+	}
+
+	if (flags & UDP_FLAG_ACK_REQUESTED) {
+		uint8_t ack[] = { UDP_BINARY_MAGIC, UDP_FLAG_ACK, datagram[2], datagram[3], result };
+		reply(ack, sizeof(ack));
+	}
+}
+
+/******************************************************************************************************************
+* parseBinaryCommands
+******************************************************************************************************************/
+uint8_t DynamoteUdp::parseBinaryCommands(uint16_t index, uint16_t length)
+{
+	uint8_t flags = datagram[1];
+	uint8_t count = datagram[4];
+	bool release = (flags & UDP_FLAG_RELEASE) != 0;
+	if ((count == 0 && !release) || count > COMMAND_QUEUE_LENGTH) {
+		dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+		return SEND_RESULT_PARSE_ERROR;
+	}
+
+	// parsed straight into RemoteCommands, there is no JSON involved
+	QueuedCommand commands[COMMAND_QUEUE_LENGTH];
+	for (uint8_t x = 0; x < count; x++) {
+		if (index + UDP_BINARY_COMMAND_LENGTH > length) {
+			dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+			return SEND_RESULT_PARSE_ERROR;
+		}
+		RemoteCommand *command = &commands[x].command;
+		*command = RemoteCommand();
+		command->codeProtocol = datagram[index];
+		command->zones = datagram[index + 1];
+		commands[x].delayMs = datagram[index + 2] | (datagram[index + 3] << 8);
+		command->codeValue = (uint32_t)datagram[index + 4] | ((uint32_t)datagram[index + 5] << 8) |
+		                     ((uint32_t)datagram[index + 6] << 16) | ((uint32_t)datagram[index + 7] << 24);
+		command->codeLength = datagram[index + 8];
+		index += UDP_BINARY_COMMAND_LENGTH;
+
+		if (command->zones >> IR_ZONE_COUNT) {
+			DYNAMOTE_LOG_WARNING("Warning, unknown zones 0x%02X", command->zones);
+			dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+			return SEND_RESULT_PARSE_ERROR;
+		}
+
+		if (command->codeProtocol == UNKNOWN) {
+			if (command->codeLength > RECV_BUF_LENGTH || index + command->codeLength * 2 > length) {
+				dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+				return SEND_RESULT_PARSE_ERROR;
+			}
+			for (uint8_t y = 0; y < command->codeLength; y++, index += 2) {
+				if (!command->codeValueRaw.add(datagram[index] | (datagram[index + 1] << 8))) {
+					dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+					return SEND_RESULT_PARSE_ERROR;
+				}
+			}
+		}
+	}
+
+	// the release ends the button held before this datagram, right away and even if its commands are refused
+	if (release)
+		dynamote->releaseHold();
+	if (count == 0)
+		return SEND_RESULT_OK;
+	if (flags & UDP_FLAG_HOLD)
+		commands[count - 1].command.hold = HOLD_START;
+
+	dynamoteMetrics.beginRequest(currentStartMicros);
+	return dynamote->sendRemoteCommands(commands, count, clientKey());
+}
+
+/******************************************************************************************************************
+* handleJson
+******************************************************************************************************************/
+void DynamoteUdp::handleJson(uint16_t length)
+{
+	// only look at the sequence number, ack flag and group here, the commands are parsed as usual
+	StaticJsonDocument<48> filter;
+	filter["seq"] = true;
+	filter["ack"] = true;
+	filter["group"] = true;
+	StaticJsonDocument<96> header;
+	bool hasSequence = false;
+	uint16_t sequence = 0;
+	bool ackRequested = false;
+	if (datagram[0] == '{' && !deserializeJson(header, (const char*)datagram, length, DeserializationOption::Filter(filter))) {
+		hasSequence = !header["seq"].isNull();
+		sequence = header["seq"] | 0;
+		ackRequested = header["ack"] | false;
+		const char *group = header["group"];
+		if (group != NULL && !acceptGroup(dynamoteHashBytes(group, strlen(group))))
+			return;
+	}
+
+	uint8_t result;
+	UdpDedupEntry *duplicate = hasSequence ? findDuplicate(UDP_FORMAT_JSON, sequence) : NULL;
+	if (duplicate != NULL) {
+		dynamoteMetrics.drop(DROP_UDP_DUPLICATE);
+		result = duplicate->result;
+	}
+	else {
+		dynamoteMetrics.beginRequest(currentStartMicros);
+		result = dynamote->sendJsonRemoteCommand((const char*)datagram, length, clientKey());
+		if (hasSequence)
+			rememberSequence(UDP_FORMAT_JSON, sequence, result);
+	}
+
+	if (ackRequested) {
+		char ack[40];
+		int ackLength = snprintf(ack, sizeof(ack), "{\"seq\":%u,\"result\":%u}", sequence, result);
+		reply((const uint8_t*)ack, ackLength);
+	}
+}
+
+/******************************************************************************************************************
+* handleCoap
+******************************************************************************************************************/
+void DynamoteUdp::handleCoap(uint16_t length)
+{
+	uint8_t type = (datagram[0] >> 4) & 0x03;
+	uint8_t tokenLength = datagram[0] & 0x0F;
+	uint8_t code = datagram[1];
+	uint16_t messageId = (datagram[2] << 8) | datagram[3];
+	if (length < 4 + tokenLength || tokenLength > 8 || (type != COAP_TYPE_CON && type != COAP_TYPE_NON)) {
+		dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+		return;
+	}
+
+	//
+	// walk the options, only Uri-Path matters
+	//
+	uint16_t index = 4 + tokenLength;
+	uint16_t optionNumber = 0;
+	char path[32] = "";
+	uint8_t pathLength = 0;
+	bool malformed = false;
+	bool badOption = false;
+	while (index < length && datagram[index] != COAP_PAYLOAD_MARKER) {
+		uint32_t delta = datagram[index] >> 4;
+		uint32_t optionLength = datagram[index] & 0x0F;
+		index++;
+		// 13 and 14 mean the value follows in one or two extra bytes
+		uint8_t extendedLength = ((delta == 13) ? 1 : (delta == 14) ? 2 : 0) + ((optionLength == 13) ? 1 : (optionLength == 14) ? 2 : 0);
+		if (delta == 15 || optionLength == 15 || index + extendedLength > length) {
+			malformed = true;
+			break;
+		}
+		if (delta == 13) { delta = datagram[index] + 13; index++; }
+		else if (delta == 14) { delta = ((datagram[index] << 8) | datagram[index + 1]) + 269; index += 2; }
+		if (optionLength == 13) { optionLength = datagram[index] + 13; index++; }
+		else if (optionLength == 14) { optionLength = ((datagram[index] << 8) | datagram[index + 1]) + 269; index += 2; }
+		if (index + optionLength > length) {
+			malformed = true;
+			break;
+		}
+		optionNumber += delta;
+		if (optionNumber == COAP_OPTION_URI_PATH) {
+			// a path longer than any route can not be matched, it is refused rather than cut short
+			if (pathLength + (pathLength != 0) + optionLength + 1 > sizeof(path)) {
+				badOption = true;
+				break;
+			}
+			if (pathLength != 0)
+				path[pathLength++] = '/';
+			memcpy(&path[pathLength], &datagram[index], optionLength);
+			pathLength += optionLength;
+			path[pathLength] = 0;
+		}
+		index += optionLength;
+	}
+	if (malformed) {
+		dynamoteMetrics.drop(DROP_UDP_MALFORMED);
+		return;
+	}
+	uint16_t payloadIndex = (index < length) ? index + 1 : length;
+
+	uint8_t responseCode;
+	UdpDedupEntry *duplicate = findDuplicate(UDP_FORMAT_COAP, messageId);
+	if (badOption)
+		responseCode = COAP_CODE_BAD_OPTION;
+	else if (code != COAP_CODE_POST)
+		responseCode = COAP_CODE_METHOD_NOT_ALLOWED;
+	else if (strcmp(path, "sendRemoteCommand") != 0)
+		responseCode = COAP_CODE_NOT_FOUND;
+	else {
+		uint8_t result;
+		if (duplicate != NULL) {
+			dynamoteMetrics.drop(DROP_UDP_DUPLICATE);
+			result = duplicate->result;
+		}
+		else {
+			dynamoteMetrics.beginRequest(currentStartMicros);
+			result = dynamote->sendJsonRemoteCommand((const char*)&datagram[payloadIndex], length - payloadIndex, clientKey());
+			rememberSequence(UDP_FORMAT_COAP, messageId, result);
+		}
+		responseCode = (result == SEND_RESULT_OK) ? COAP_CODE_CHANGED :
+		               (result == SEND_RESULT_QUEUE_FULL || result == SEND_RESULT_NO_MEMORY) ? COAP_CODE_UNAVAILABLE :
+		               (result == SEND_RESULT_RATE_LIMITED) ? COAP_CODE_TOO_MANY_REQUESTS : COAP_CODE_BAD_REQUEST;
+	}
+
+	// confirmable messages get a piggybacked acknowledgment with the same message ID and token
+	if (type == COAP_TYPE_CON) {
+		uint8_t ack[4 + 8];
+		ack[0] = (COAP_VERSION << 6) | (COAP_TYPE_ACK << 4) | tokenLength;
+		ack[1] = responseCode;
+		ack[2] = datagram[2];
+		ack[3] = datagram[3];
+		memcpy(&ack[4], &datagram[4], tokenLength);
+		reply(ack, 4 + tokenLength);
+	}
+}
+
+/******************************************************************************************************************
+* findDuplicate
+******************************************************************************************************************/
+UdpDedupEntry *DynamoteUdp::findDuplicate(uint8_t format, uint16_t sequence)
+{
+	// sequence numbers are the sender's own, two hubs sending to the same group do not share them. Each format
+	// counts on its own, a CoAP message ID is not a JSON or binary sequence number.
+	IPAddress address = current->remoteIP();
+	uint16_t port = current->remotePort();
+	for (uint8_t x = 0; x < dedupCount; x++) {
+		UdpDedupEntry *entry = &dedupEntries[x];
+		if (entry->format == format && entry->sequence == sequence && entry->group == currentGroup &&
+		    entry->port == port && entry->address == address)
+			return entry;
+	}
+	return NULL;
+}
+
+/******************************************************************************************************************
+* rememberSequence
+******************************************************************************************************************/
+void DynamoteUdp::rememberSequence(uint8_t format, uint16_t sequence, uint8_t result)
+{
+	// only queued commands are remembered, a retransmission of a rejected one gets another chance
+	if (result != SEND_RESULT_OK)
+		return;
+
+	UdpDedupEntry *entry = &dedupEntries[dedupNext];
+	entry->address = current->remoteIP();
+	entry->port = current->remotePort();
+	entry->group = currentGroup;
+	entry->format = format;
+	entry->sequence = sequence;
+	entry->result = result;
+	dedupNext = (dedupNext + 1) % UDP_DEDUP_ENTRIES;
+	if (dedupCount < UDP_DEDUP_ENTRIES)
+		dedupCount++;
+}
+
+/******************************************************************************************************************
+* acceptGroup
+******************************************************************************************************************/
+bool DynamoteUdp::acceptGroup(uint32_t group)
+{
+	currentGroup = group;
+	return group == dynamoteHash(UDP_GROUP_ALL) || isMember(group);
+}
+
+/******************************************************************************************************************
+* isMember
+******************************************************************************************************************/
+bool DynamoteUdp::isMember(uint32_t group)
+{
+	for (uint8_t x = 0; x < groupCount; x++) {
+		if (groups[x] == group)
+			return true;
+	}
+	return false;
+}
+
+/******************************************************************************************************************
+* clientKey
+******************************************************************************************************************/
+uint32_t DynamoteUdp::clientKey(void)
+{
+	// the sender of the datagram being handled, each (address, port) pair gets its own rate limit
+	return DynamoteAdmission::clientKey(TRANSPORT_UDP, (uint32_t)current->remoteIP(), current->remotePort());
+}
+
+/******************************************************************************************************************
+* reply
+******************************************************************************************************************/
+void DynamoteUdp::reply(const uint8_t *data, uint16_t length)
+{
+	// always from the unicast socket, so acknowledgments to a group datagram come from each member's own address
+	udp.beginPacket(current->remoteIP(), current->remotePort());
+	udp.write(data, length);
+	udp.endPacket();
+}
+
+#endif
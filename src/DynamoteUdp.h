@@ -0,0 +1,148 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEUDP_H
+#define DYNAMOTEUDP_H
+
+#include <Dynamote.h>
+#ifndef DYNAMOTE_BLE
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+// The CoAP port, plain JSON and binary datagrams are accepted on it as well
+#ifndef DYNAMOTE_UDP_PORT
+#define DYNAMOTE_UDP_PORT         5683
+#endif
+
+// Group address and port every device listens on for group datagrams
+#ifndef DYNAMOTE_MULTICAST_ADDRESS
+#define DYNAMOTE_MULTICAST_ADDRESS    239, 255, 68, 77
+#endif
+#ifndef DYNAMOTE_MULTICAST_PORT
+#define DYNAMOTE_MULTICAST_PORT       5690
+#endif
+
+// Number of named groups a device can be in, besides UDP_GROUP_ALL
+#define UDP_MAX_GROUPS            4
+
+// Every device is a member of this group, a multicast datagram without a group goes to it
+#define UDP_GROUP_ALL             "all"
+
+// Largest datagram accepted, anything longer is dropped
+#define UDP_MAX_DATAGRAM          1024
+
+// Number of recent (address, port, sequence number) or (group, sequence number) entries remembered to suppress
+// retransmitted duplicates
+#define UDP_DEDUP_ENTRIES         8
+
+/******************************************************************************************************************
+* Binary datagram, all values little endian
+*
+*   uint8_t  magic                  UDP_BINARY_MAGIC
+*   uint8_t  flags                  UDP_FLAG_ACK_REQUESTED, UDP_FLAG_HOLD, UDP_FLAG_RELEASE, UDP_FLAG_GROUP
+*   uint16_t sequence number
+*   uint8_t  command count
+*   uint32_t group                  UDP_FLAG_GROUP only, dynamoteHash() of the group name
+*   per command:
+*     uint8_t  protocol
+*     uint8_t  zones                bit per emitter zone, 0 for zone 0
+*     uint16_t delay                ms after the previous command
+*     uint32_t codeValue
+*     uint8_t  codeLength           bits, or the number of timings for raw (protocol 0) commands
+*     uint16_t timings[codeLength]  raw commands only
+*
+* UDP_FLAG_HOLD keeps repeating the last command until a datagram with UDP_FLAG_RELEASE arrives. A release
+* may have a command count of 0. It ends the button held before the datagram at once, before its own commands.
+*
+* The acknowledgment is magic, UDP_FLAG_ACK, the sequence number and one result byte (SEND_RESULT_*).
+*
+* JSON datagrams hold the same JSON as the other transports. Adding "seq" (and "ack": true for an
+* acknowledgment) enables duplicate suppression, the acknowledgment is {"seq":n,"result":r}.
+*
+* CoAP datagrams are POSTs to /sendRemoteCommand with the JSON as payload. The message ID is the sequence
+* number, confirmable messages are answered with a piggybacked ACK. A client sending faster than its rate
+* limit gets 4.29.
+*
+* Group datagrams are sent to DYNAMOTE_MULTICAST_ADDRESS:DYNAMOTE_MULTICAST_PORT in the JSON or binary form, with
+* the group name as "group" or UDP_FLAG_GROUP. Devices that are not in the group ignore them, a datagram without a
+* group goes to UDP_GROUP_ALL. Duplicates are recognized by (sender address, port, group, sequence number), so two
+* senders using the same group and sequence numbers do not drop each other's commands. Each member sends its own acknowledgment back to the
+* sender from DYNAMOTE_UDP_PORT, the sender collects them into one result for the group.
+******************************************************************************************************************/
+#define UDP_BINARY_MAGIC          0xD7
+#define UDP_FLAG_ACK_REQUESTED    0x01
+#define UDP_FLAG_ACK              0x02
+#define UDP_FLAG_HOLD             0x04
+#define UDP_FLAG_RELEASE          0x08
+#define UDP_FLAG_GROUP            0x10
+#define UDP_BINARY_HEADER_LENGTH  5
+#define UDP_BINARY_GROUP_LENGTH   4
+#define UDP_BINARY_COMMAND_LENGTH 9
+
+// UdpDedupEntry.format
+#define UDP_FORMAT_BINARY         0
+#define UDP_FORMAT_JSON           1
+#define UDP_FORMAT_COAP           2
+
+typedef struct
+{
+	IPAddress address;
+	uint16_t port;
+	uint32_t group;                     // 0 for datagrams that were not sent to a group
+	uint8_t format;                     // UDP_FORMAT_*
+	uint16_t sequence;
+	uint8_t result;
+} UdpDedupEntry;
+
+class DynamoteUdp
+{
+	public:
+		DynamoteUdp(Dynamote *_dynamote);
+		void begin(uint16_t port);
+		void loop(void);
+		bool joinGroup(const char *name);
+		void leaveGroup(const char *name);
+		uint8_t getGroupCount(void);
+
+	private:
+		Dynamote *dynamote;
+		WiFiUDP udp;
+		WiFiUDP multicastUdp;
+		WiFiUDP *current = &udp;            // the socket the datagram being handled came in on
+		uint32_t groups[UDP_MAX_GROUPS];
+		uint8_t groupCount = 0;
+		uint32_t currentGroup = 0;          // the group the datagram being handled was sent to, 0 for none
+		uint32_t currentStartMicros = 0;    // when the datagram being handled arrived
+		// room for a terminating zero
+		uint8_t datagram[UDP_MAX_DATAGRAM + 1];
+		UdpDedupEntry dedupEntries[UDP_DEDUP_ENTRIES];
+		uint8_t dedupCount = 0;
+		uint8_t dedupNext = 0;
+		void receive(WiFiUDP &socket, bool multicast);
+		bool acceptGroup(uint32_t group);
+		bool isMember(uint32_t group);
+		void handleBinary(uint16_t length);
+		void handleJson(uint16_t length);
+		void handleCoap(uint16_t length);
+		uint8_t parseBinaryCommands(uint16_t index, uint16_t length);
+		UdpDedupEntry *findDuplicate(uint8_t format, uint16_t sequence);
+		void rememberSequence(uint8_t format, uint16_t sequence, uint8_t result);
+		uint32_t clientKey(void);
+		void reply(const uint8_t *data, uint16_t length);
+};
+
+#endif
+#endif
@@ -0,0 +1,297 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/******************************************************************************************************************
+* includes
+******************************************************************************************************************/
+#include <DynamoteWebSocket.h>
+#ifndef DYNAMOTE_BLE
+
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/******************************************************************************************************************
+* sha1
+******************************************************************************************************************/
+static void sha1(const uint8_t *data, uint16_t length, uint8_t digest[20])
+{
+	// only ever used on the short handshake key, so the whole message is padded in one buffer
+	uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	uint8_t message[128] = {0};
+	uint16_t paddedLength = ((length + 8) / 64 + 1) * 64;
+	memcpy(message, data, length);
+	message[length] = 0x80;
+	uint64_t bitLength = (uint64_t)length * 8;
+	for (uint8_t x = 0; x < 8; x++)
+		message[paddedLength - 1 - x] = bitLength >> (x * 8);
+
+	for (uint16_t block = 0; block < paddedLength; block += 64) {
+		uint32_t w[80];
+		for (uint8_t x = 0; x < 16; x++)
+			w[x] = ((uint32_t)message[block + x*4] << 24) | ((uint32_t)message[block + x*4 + 1] << 16) |
+			       ((uint32_t)message[block + x*4 + 2] << 8) | message[block + x*4 + 3];
+		for (uint8_t x = 16; x < 80; x++) {
+			uint32_t value = w[x-3] ^ w[x-8] ^ w[x-14] ^ w[x-16];
+			w[x] = (value << 1) | (value >> 31);
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (uint8_t x = 0; x < 80; x++) {
+			uint32_t f, k;
+			if (x < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+			else if (x < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+			else if (x < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+			else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+			uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[x];
+			e = d;
+			d = c;
+			c = (b << 30) | (b >> 2);
+			b = a;
+			a = temp;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+	}
+
+	for (uint8_t x = 0; x < 20; x++)
+		digest[x] = h[x / 4] >> (24 - (x % 4) * 8);
+}
+
+/******************************************************************************************************************
+* base64Encode
+******************************************************************************************************************/
+static void base64Encode(const uint8_t *data, uint8_t length, char *output)
+{
+	uint8_t outputIndex = 0;
+	for (uint8_t x = 0; x < length; x += 3) {
+		uint32_t group = (uint32_t)data[x] << 16;
+		if (x + 1 < length) group |= (uint32_t)data[x + 1] << 8;
+		if (x + 2 < length) group |= data[x + 2];
+		output[outputIndex++] = base64Alphabet[(group >> 18) & 0x3F];
+		output[outputIndex++] = base64Alphabet[(group >> 12) & 0x3F];
+		output[outputIndex++] = (x + 1 < length) ? base64Alphabet[(group >> 6) & 0x3F] : '=';
+		output[outputIndex++] = (x + 2 < length) ? base64Alphabet[group & 0x3F] : '=';
+	}
+	output[outputIndex] = 0;
+}
+
+/******************************************************************************************************************
+* constructor
+******************************************************************************************************************/
+DynamoteWebSocket::DynamoteWebSocket(void) {}
+
+/******************************************************************************************************************
+* accept
+******************************************************************************************************************/
+bool DynamoteWebSocket::accept(WiFiClient &_client, const char *key)
+{
+	// Sec-WebSocket-Accept is base64(sha1(key + GUID))
+	char keyAndGuid[64];
+	int keyLength = snprintf(keyAndGuid, sizeof(keyAndGuid), "%s%s", key, WEBSOCKET_GUID);
+	if (keyLength <= 0 || keyLength >= (int)sizeof(keyAndGuid))
+		return false;
+	uint8_t digest[20];
+	sha1((const uint8_t*)keyAndGuid, keyLength, digest);
+	char acceptKey[29];
+	base64Encode(digest, sizeof(digest), acceptKey);
+
+	char response[160];
+	int responseLength = snprintf(response, sizeof(response),
+		"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", acceptKey);
+	client = _client;
+	client.write((const uint8_t*)response, responseLength);
+
+	rxLength = 0;
+	consumeLength = 0;
+	connected = true;
+	return true;
+}
+
+/******************************************************************************************************************
+* isConnected
+******************************************************************************************************************/
+bool DynamoteWebSocket::isConnected(void)
+{
+	if (connected && !client.connected()) {
+		connected = false;
+		client.stop();
+	}
+	return connected;
+}
+
+/******************************************************************************************************************
+* owns
+******************************************************************************************************************/
+bool DynamoteWebSocket::owns(WiFiClient &other)
+{
+	return connected && client == other;
+}
+
+/******************************************************************************************************************
+* poll
+******************************************************************************************************************/
+bool DynamoteWebSocket::poll(char **message, uint16_t *length)
+{
+	// drop the frame handed out last time
+	if (consumeLength != 0) {
+		memmove(rxBuffer, &rxBuffer[consumeLength], rxLength - consumeLength);
+		rxLength -= consumeLength;
+		consumeLength = 0;
+	}
+
+	if (!isConnected())
+		return false;
+
+	// take whatever has arrived, without waiting for more
+	int available = client.available();
+	uint16_t space = sizeof(rxBuffer) - 1 - rxLength;
+	if (available > 0 && space > 0)
+		rxLength += client.read(&rxBuffer[rxLength], min((int)space, available));
+
+	while (rxLength >= 2) {
+		//
+		// frame header
+		//
+		bool fin = rxBuffer[0] & 0x80;
+		uint8_t opcode = rxBuffer[0] & 0x0F;
+		bool masked = rxBuffer[1] & 0x80;
+		uint32_t payloadLength = rxBuffer[1] & 0x7F;
+		uint16_t headerLength = 2;
+		if (payloadLength == 126) {
+			if (rxLength < 4)
+				return false;
+			payloadLength = (rxBuffer[2] << 8) | rxBuffer[3];
+			headerLength = 4;
+		}
+		else if (payloadLength == 127) {
+			// nothing this large is ever accepted
+			close(WEBSOCKET_CLOSE_TOO_BIG);
+			return false;
+		}
+		// client frames are always masked (RFC 6455 5.1)
+		if (!masked) {
+			close(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+			return false;
+		}
+		headerLength += 4;
+		if (payloadLength > WEBSOCKET_MAX_MESSAGE) {
+			close(WEBSOCKET_CLOSE_TOO_BIG);
+			return false;
+		}
+		if (rxLength < headerLength + payloadLength)
+			return false;
+
+		uint8_t *payload = &rxBuffer[headerLength];
+		uint8_t *mask = &rxBuffer[headerLength - 4];
+		for (uint16_t x = 0; x < payloadLength; x++)
+			payload[x] ^= mask[x & 3];
+		uint16_t frameLength = headerLength + payloadLength;
+
+		//
+		// control frames are handled here, data frames go to the caller
+		//
+		if (opcode == WEBSOCKET_OPCODE_TEXT || opcode == WEBSOCKET_OPCODE_BINARY) {
+			if (!fin) {
+				// fragmented messages are not supported, every command fits in one frame
+				close(WEBSOCKET_CLOSE_UNSUPPORTED);
+				return false;
+			}
+			// the byte after the payload is overwritten by the zero terminator, so keep the frame as it is
+			// until the next poll
+			uint8_t *end = &payload[payloadLength];
+			if (frameLength < rxLength) {
+				memmove(end + 1, end, rxLength - frameLength);
+				rxLength++;
+				frameLength++;
+			}
+			*end = 0;
+			consumeLength = frameLength;
+			*message = (char*)payload;
+			*length = payloadLength;
+			return true;
+		}
+		if (opcode == WEBSOCKET_OPCODE_PING)
+			sendFrame(WEBSOCKET_OPCODE_PONG, payload, payloadLength);
+		else if (opcode == WEBSOCKET_OPCODE_CLOSE) {
+			sendFrame(WEBSOCKET_OPCODE_CLOSE, payload, min(payloadLength, (uint32_t)2));
+			connected = false;
+			client.stop();
+			rxLength = 0;
+			return false;
+		}
+		else if (opcode == WEBSOCKET_OPCODE_CONTINUATION) {
+			close(WEBSOCKET_CLOSE_UNSUPPORTED);
+			return false;
+		}
+
+		memmove(rxBuffer, &rxBuffer[frameLength], rxLength - frameLength);
+		rxLength -= frameLength;
+	}
+	return false;
+}
+
+/******************************************************************************************************************
+* sendText
+******************************************************************************************************************/
+bool DynamoteWebSocket::sendText(const char *text, uint16_t length)
+{
+	return sendFrame(WEBSOCKET_OPCODE_TEXT, (const uint8_t*)text, length);
+}
+
+/******************************************************************************************************************
+* close
+******************************************************************************************************************/
+void DynamoteWebSocket::close(uint16_t code)
+{
+	if (!connected)
+		return;
+	uint8_t payload[2] = { (uint8_t)(code >> 8), (uint8_t)code };
+	sendFrame(WEBSOCKET_OPCODE_CLOSE, payload, sizeof(payload));
+	connected = false;
+	client.stop();
+	rxLength = 0;
+	consumeLength = 0;
+}
+
+/******************************************************************************************************************
+* sendFrame
+******************************************************************************************************************/
+bool DynamoteWebSocket::sendFrame(uint8_t opcode, const uint8_t *payload, uint16_t length)
+{
+	if (!connected)
+		return false;
+
+	// header and payload go out in one write, so the frame ends up in a single TCP segment. The frame is put
+	// together in the arena, so even the largest message (metrics) needs no buffer of its own.
+	DynamoteArenaScope arenaScope;
+	uint16_t headerLength = (length < 126) ? 2 : 4;
+	uint8_t *frame = (uint8_t*)dynamoteArena.allocate(headerLength + length);
+	if (frame == NULL)
+		return false;
+	frame[0] = 0x80 | opcode;
+	if (length < 126) {
+		frame[1] = length;
+	}
+	else {
+		frame[1] = 126;
+		frame[2] = length >> 8;
+		frame[3] = length;
+	}
+	memcpy(&frame[headerLength], payload, length);
+	return client.write(frame, headerLength + length) == headerLength + length;
+}
+
+#endif
@@ -0,0 +1,73 @@
+/******************************************************************************
+ * Copyright (C) 2021 Darcy Huisman
+ * This program is free software: you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for 
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DYNAMOTEWEBSOCKET_H
+#define DYNAMOTEWEBSOCKET_H
+
+#include <Dynamote.h>
+#ifndef DYNAMOTE_BLE
+#include <WiFi.h>
+
+// Number of WebSocket connections kept open at the same time
+#define WEBSOCKET_MAX_CLIENTS       2
+
+// Largest message accepted from a client. Each message has to fit in one frame.
+#define WEBSOCKET_MAX_MESSAGE       1024
+
+// Sec-WebSocket-Key is 16 random bytes in base64, anything longer is not a valid key
+#define WEBSOCKET_MAX_KEY_LENGTH    24
+
+// Largest frame header: 2 bytes, 8 bytes of extended length, 4 bytes of mask
+#define WEBSOCKET_MAX_HEADER        14
+
+#define WEBSOCKET_OPCODE_CONTINUATION 0x0
+#define WEBSOCKET_OPCODE_TEXT       0x1
+#define WEBSOCKET_OPCODE_BINARY     0x2
+#define WEBSOCKET_OPCODE_CLOSE      0x8
+#define WEBSOCKET_OPCODE_PING       0x9
+#define WEBSOCKET_OPCODE_PONG       0xA
+
+#define WEBSOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define WEBSOCKET_CLOSE_UNSUPPORTED 1003
+#define WEBSOCKET_CLOSE_TOO_BIG     1009
+
+// One server side WebSocket connection (RFC 6455). The HTTP server does the upgrade request parsing and
+// hands the client over with accept().
+class DynamoteWebSocket
+{
+	public:
+		DynamoteWebSocket(void);
+		bool accept(WiFiClient &_client, const char *key);
+		bool isConnected(void);
+		// true if the client is the socket of this connection, the HTTP server must not read from it
+		bool owns(WiFiClient &other);
+		// returns true with a zero terminated text message, which stays valid until the next poll()
+		bool poll(char **message, uint16_t *length);
+		// false if the frame could not be written
+		bool sendText(const char *text, uint16_t length);
+		void close(uint16_t code);
+
+	private:
+		WiFiClient client;
+		bool connected = false;
+		uint8_t rxBuffer[WEBSOCKET_MAX_HEADER + WEBSOCKET_MAX_MESSAGE + 1];
+		uint16_t rxLength = 0;
+		uint16_t consumeLength = 0;         // size of the frame handed out by the last poll()
+		bool sendFrame(uint8_t opcode, const uint8_t *payload, uint16_t length);
+};
+
+#endif
+#endif
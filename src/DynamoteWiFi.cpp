@@ -24,7 +24,7 @@
 /******************************************************************************************************************
 * constructor
 ******************************************************************************************************************/
-DynamoteWiFi::DynamoteWiFi(void) : _server(80) {}
+DynamoteWiFi::DynamoteWiFi(void) : _server(80), udpEndpoint(this) {}
 
 /******************************************************************************************************************
 * setup
@@ -32,7 +32,11 @@ DynamoteWiFi::DynamoteWiFi(void) : _server(80) {}
 void DynamoteWiFi::begin()
 {
 	_server.begin();
+	udpEndpoint.begin(DYNAMOTE_UDP_PORT);
 	setupMqtt(this);
+	dynamoteStatus.setBuilder(&DynamoteWiFi::buildStatus, this);
+	beginZones();
+	beginIrTask();
 }
 
 /******************************************************************************************************************
@@ -40,21 +44,38 @@ void DynamoteWiFi::begin()
 ******************************************************************************************************************/
 void DynamoteWiFi::loop(void)
 {
-	RemoteCommand command = dynamoteLoop();
-	static RemoteCommand recordedCommand = RemoteCommand();
-	if (command.codeLength != 0) {
-		recordedCommand = command;
-	}
+	// recorded commands are handed out per client from the record sessions
+	dynamoteLoop();
+	watchStatus();
 
 	if (WiFi.status() != WL_CONNECTED)
 		return;
 
+	// datagrams first, they are the cheap path
+	udpEndpoint.loop();
+
+	// then the open WebSockets
+	webSocketLoop();
+
 	WiFiClient client = _server.available();
 
+	// some cores (WiFiNINA) hand out every socket with data waiting, including the ones that have been upgraded.
+	// Those frames belong to webSocketLoop(), parsing them as HTTP would block and then close the WebSocket.
+	for (uint8_t x = 0; client && x < WEBSOCKET_MAX_CLIENTS; x++) {
+		if (webSockets[x].owns(client))
+			client = WiFiClient();
+	}
+
 	if (client) {                             // if you get a client,
-		String currentLine = "";                // make a String to hold incoming data from the client
-		String requestCommand = "";
-		String requestData = "";
+		DynamoteMemoryProbe memoryProbe(MEMORY_HTTP);
+		DynamoteArenaScope arenaScope;          // everything the request allocates is given back when it is done
+		uint32_t requestStartMicros = micros();
+		dynamoteMetrics.count(COUNTER_HTTP_REQUESTS);
+		char currentLine[HTTP_MAX_LINE_LENGTH];  // holds incoming data from the client, longer lines are cut short
+		uint16_t currentLineLength = 0;
+		bool firstLine = true;
+		DynamoteRoute route = ROUTE_NONE;
+		char webSocketKey[WEBSOCKET_MAX_KEY_LENGTH + 1] = "";
 		while (client.connected()) {            // loop while the client's connected
 			if (client.available()) {             // if there's bytes to read from the client,
 				char c = client.read();             // read a byte, then
@@ -62,28 +83,93 @@ void DynamoteWiFi::loop(void)
 
 					// if the current line is blank, you got two newline characters in a row.
 					// that's the end of the client HTTP request, so send a response:
-					if (currentLine.length() == 0) {
-
-						// header
-						// send an OK response to the client
-						client.println("HTTP/1.1 200 OK");
-						client.println("Content-type:text/html");
-						client.println();
-
-						// send the recorded command to the client.
-						if (recordedCommand.codeLength != 0) {
-							String recordedRemoteCommandJsonString;
-							serializeRemoteCommandToJsonString(recordedCommand, recordedRemoteCommandJsonString);
-							client.print(recordedRemoteCommandJsonString);
-							client.println("");
-							recordedCommand = RemoteCommand();
+					if (currentLineLength == 0) {
+
+						// a WebSocket upgrade keeps the connection open, it is served from webSocketLoop() from now on
+						if (route == ROUTE_WEBSOCKET && webSocketKey[0] != 0) {
+							if (acceptWebSocket(client, webSocketKey)) {
+								dynamoteMetrics.record(METRIC_HTTP_REQUEST, micros() - requestStartMicros);
+								mqttloop();
+								return;
+							}
+							DynamoteHttpResponse response(client);
+							response.setStatus(503, "Service Unavailable");
+							response.send();
+							break;
+						}
+
+						// the body is printed into the response, which writes it together with the headers
+						DynamoteHttpResponse response(client);
+						if (route == ROUTE_NONE) {
+							response.setStatus(404, "Not Found");
+							response.send();
+							break;
+						}
+
+						// get the data from the HTTP request, then handle it. Commands are only queued here, and sent
+						// once the response is on its way.
+						size_t requestDataLength = client.available();
+						char *requestData = (char*)dynamoteArena.allocate(requestDataLength + 1);
+						if (requestData == NULL) {
+							response.setStatus(413, "Payload Too Large");
+							response.send();
+							break;
+						}
+						int bytesRead = client.read((uint8_t*)requestData, requestDataLength);
+						requestDataLength = (bytesRead > 0) ? bytesRead : 0;
+						requestData[requestDataLength] = 0;
+						if (route == ROUTE_SEND_REMOTE_COMMAND)
+							dynamoteMetrics.beginRequest(requestStartMicros);
+						uint32_t clientKey = DynamoteAdmission::clientKey(TRANSPORT_HTTP, client.remoteIP(), 0);
+						uint8_t result = handleRoute(route, requestData, requestDataLength, clientKey);
+
+						// the client is sending faster than it is allowed to, or has used up its share of the queue
+						if (result == SEND_RESULT_RATE_LIMITED || result == SEND_RESULT_QUEUE_FULL) {
+							response.setStatus(429, "Too Many Requests");
+							response.send();
+							break;
+						}
+
+						// every record session is taken by other clients, or the request did not fit in the arena
+						if (result == SEND_RESULT_RECORD_BUSY || result == SEND_RESULT_NO_MEMORY) {
+							response.setStatus(503, "Service Unavailable");
+							response.send();
+							break;
+						}
+
+						// send the next command recorded for this client, if it is recording. The metrics, status and
+						// captures bodies are a single document of their own, the command waits for the next poll.
+						RemoteCommand recordedCommand = RemoteCommand();
+						bool documentRoute = (route == ROUTE_METRICS || route == ROUTE_STATUS || route == ROUTE_CAPTURES);
+						if (!documentRoute && takeRecordedCommand(clientKey, recordedCommand)) {
+							serializeRemoteCommandToJson(recordedCommand, response);
+							response.print("\r\n");
 						}
-						
-						// get the data from the HTTP request, then handle it
-						while(client.available()) {
-							requestData += (char)client.read();
+
+						// send the latency histograms and counters to the client
+						if (route == ROUTE_METRICS) {
+							dynamoteMetrics.toJson(response);
+							response.print("\r\n");
 						}
-						handleCommandFromClient(requestCommand, requestData);
+
+						// send the status document, straight from the cache unless something changed
+						if (route == ROUTE_STATUS) {
+							dynamoteStatus.toJson(response);
+							response.print("\r\n");
+						}
+
+						// hand out the next capture records, the client asks again while "more" is true
+						if (route == ROUTE_CAPTURES) {
+							dynamoteCaptureLog.toJson(response);
+							response.print("\r\n");
+						}
+
+						bool sent = response.send();
+						if (route == ROUTE_SEND_REMOTE_COMMAND && result == SEND_RESULT_OK)
+							kickCommandQueue();
+						// the capture records only leave the ring once they are on their way
+						if (route == ROUTE_CAPTURES && sent)
+							dynamoteCaptureLog.acknowledge();
 
 						// break out of the while loop
 						break;
@@ -92,73 +178,301 @@ void DynamoteWiFi::loop(void)
 					else {
 
 						//
-						// parse POST commands
+						// the request line picks the route, the method and path are matched by hash
 						//
-						if (currentLine.indexOf("POST /") != -1) {
-							// remove the "POST /"
-							requestCommand = currentLine.substring(currentLine.indexOf("POST /") + 6);
-							// remove anything after a space
-							requestCommand = requestCommand.substring(0, requestCommand.indexOf(' '));
-						} 
+						if (firstLine) {
+							route = routeRequestLine(currentLine, currentLineLength);
+							firstLine = false;
+						}
 
 						//
-						// Parse GET commands
+						// WebSocket upgrade key, header names are case insensitive
 						//
-						if (currentLine.indexOf("GET /") != -1) {
-							// remove the "GET /"
-							requestCommand = currentLine.substring(currentLine.indexOf("GET /") + 5);
-							// remove anything after a space
-							requestCommand = requestCommand.substring(0, requestCommand.indexOf(' '));
-						} 
-
-						currentLine = "";
+						else if (currentLineLength > 18 && strncasecmp(currentLine, "Sec-WebSocket-Key:", 18) == 0) {
+							uint16_t start = 18;
+							while (start < currentLineLength && currentLine[start] == ' ')
+								start++;
+							uint16_t keyLength = min(currentLineLength - start, WEBSOCKET_MAX_KEY_LENGTH);
+							memcpy(webSocketKey, &currentLine[start], keyLength);
+							webSocketKey[keyLength] = 0;
+						}
+
+						currentLineLength = 0;
 					}
 				} else if (c != '\r') {  // if you got anything else but a carriage return character,
-					currentLine += c;      // add it to the end of the currentLine
+					if (currentLineLength < sizeof(currentLine))
+						currentLine[currentLineLength++] = c;      // add it to the end of the currentLine
 				}
 			}
 		}
 		// close the connection
 		client.stop();
+		dynamoteMetrics.record(METRIC_HTTP_REQUEST, micros() - requestStartMicros);
 	}
 
 	mqttloop();
 }
 
 /******************************************************************************************************************
-* handleCommandFromClient
+* joinGroup
 ******************************************************************************************************************/
-void DynamoteWiFi::handleCommandFromClient(String command, String commandData) 
+bool DynamoteWiFi::joinGroup(const char *name)
 {
+	return udpEndpoint.joinGroup(name);
+}
+
+/******************************************************************************************************************
+* leaveGroup
+******************************************************************************************************************/
+void DynamoteWiFi::leaveGroup(const char *name)
+{
+	udpEndpoint.leaveGroup(name);
+}
+
+/******************************************************************************************************************
+* buildStatus
+******************************************************************************************************************/
+void DynamoteWiFi::buildStatus(JsonObject status, void *argument)
+{
+	DynamoteWiFi *dynamote = (DynamoteWiFi*)argument;
+	dynamote->addStatusToJson(status);
+
+	status["transport"] = "wifi";
+	IPAddress localIP = WiFi.localIP();
+	char address[16];
+	snprintf(address, sizeof(address), "%u.%u.%u.%u", localIP[0], localIP[1], localIP[2], localIP[3]);
+	status["ip"] = address;
+	status["connected"] = dynamote->lastWiFiConnected;
+	status["mqtt"] = dynamote->lastMqttConnected;
+	status["webSockets"] = dynamote->lastWebSocketCount;
+	status["maxWebSockets"] = WEBSOCKET_MAX_CLIENTS;
+	status["udpPort"] = DYNAMOTE_UDP_PORT;
+	status["groups"] = dynamote->udpEndpoint.getGroupCount();
+}
+
+/******************************************************************************************************************
+* watchStatus
+******************************************************************************************************************/
+void DynamoteWiFi::watchStatus(void)
+{
+	// the connections in the status come and go by themselves, so they are checked for changes here
+	bool wifiConnected = (WiFi.status() == WL_CONNECTED);
+	bool mqttIsConnected = mqttConnected();
+	uint8_t webSocketCount = 0;
+	for (uint8_t x = 0; x < WEBSOCKET_MAX_CLIENTS; x++) {
+		if (webSockets[x].isConnected())
+			webSocketCount++;
+	}
+
+	if (wifiConnected != lastWiFiConnected || mqttIsConnected != lastMqttConnected || webSocketCount != lastWebSocketCount) {
+		lastWiFiConnected = wifiConnected;
+		lastMqttConnected = mqttIsConnected;
+		lastWebSocketCount = webSocketCount;
+		dynamoteStatus.invalidate();
+	}
+}
+
+/******************************************************************************************************************
+* handleRoute
+******************************************************************************************************************/
+uint8_t DynamoteWiFi::handleRoute(DynamoteRoute route, char *commandData, size_t length, uint32_t clientKey) 
+{
+	switch (route) {
+		//
+		// Are we trying to send a remote command?
+		//
+		case ROUTE_SEND_REMOTE_COMMAND:
+			return enqueueJsonRemoteCommand(commandData, length, clientKey);
+
+		//
+		// Are we trying to configure MQTT?
+		//
+		case ROUTE_CONFIGURE_MQTT:
+			configureMqtt(commandData, length);
+			DYNAMOTE_LOG_INFO("Saved new MQTT config");
+			break;
+
+		//
+		// determine if a new recorded command is requested by the client
+		//
+		case ROUTE_GET_RECORDED_COMMAND:
+			// If we do not receive the next request within several seconds, the client's session is closed
+			if (openRecordSession(clientKey, RECORD_TIMEOUT_MS) == 0)
+				return SEND_RESULT_RECORD_BUSY;
+			break;
+
+		//
+		// determine if the client is done recording commands
+		//
+		case ROUTE_GET_RECORDED_COMMAND_DONE:
+			closeRecordSession(clientKey);
+			break;
+
+		default:
+			break;
+	}
+	return SEND_RESULT_OK;
+}
+
+/******************************************************************************************************************
+* acceptWebSocket
+******************************************************************************************************************/
+bool DynamoteWiFi::acceptWebSocket(WiFiClient &client, const char *key)
+{
+	for (uint8_t x = 0; x < WEBSOCKET_MAX_CLIENTS; x++) {
+		if (webSockets[x].isConnected())
+			continue;
+		// the connection that had this slot may have gone since webSocketLoop() last looked
+		if (webSocketRecording[x]) {
+			webSocketRecording[x] = false;
+			closeRecordSession(webSocketOwner(x));
+		}
+		if (!webSockets[x].accept(client, key))
+			return false;
+		DYNAMOTE_LOG_INFO("WebSocket %d connected", x);
+
+		// a new connection does not record until it asks to
+		sendWebSocketState(x, 0);
+		return true;
+	}
+	return false;
+}
+
+/******************************************************************************************************************
+* webSocketLoop
+******************************************************************************************************************/
+void DynamoteWiFi::webSocketLoop(void)
+{
+	for (uint8_t x = 0; x < WEBSOCKET_MAX_CLIENTS; x++) {
+		if (!webSockets[x].isConnected()) {
+			// nobody is left to stop a recording that was started from this socket
+			if (webSocketRecording[x]) {
+				webSocketRecording[x] = false;
+				closeRecordSession(webSocketOwner(x));
+			}
+			continue;
+		}
+
+		char *message;
+		uint16_t length;
+		while (webSockets[x].poll(&message, &length))
+			handleWebSocketMessage(x, message, length);
+
+		//
+		// push the commands recorded for this socket instead of waiting to be polled
+		//
+		RemoteCommand recordedCommand = RemoteCommand();
+		while (webSocketRecording[x] && takeRecordedCommand(webSocketOwner(x), recordedCommand)) {
+			String capturedEvent = "{\"type\":\"captured\",\"command\":";
+			serializeRemoteCommandToJsonString(recordedCommand, capturedEvent);
+			capturedEvent += "}";
+			webSockets[x].sendText(capturedEvent.c_str(), capturedEvent.length());
+		}
+	}
+}
+
+/******************************************************************************************************************
+* webSocketOwner
+******************************************************************************************************************/
+uint32_t DynamoteWiFi::webSocketOwner(uint8_t index)
+{
+	// the record session belongs to the connection, not to the address, so two apps on one phone each get their own
+	return DynamoteAdmission::clientKey(TRANSPORT_WEBSOCKET, 0, index);
+}
+
+/******************************************************************************************************************
+* sendWebSocketState
+******************************************************************************************************************/
+void DynamoteWiFi::sendWebSocketState(uint8_t index, uint8_t sessionId)
+{
+	String stateEvent = "{\"type\":\"state\",\"record\":";
+	if (sessionId != 0) {
+		stateEvent += "true,\"session\":";
+		stateEvent += sessionId;
+		stateEvent += "}";
+	}
+	else {
+		stateEvent += "false}";
+	}
+	webSockets[index].sendText(stateEvent.c_str(), stateEvent.length());
+}
+
+/******************************************************************************************************************
+* handleWebSocketMessage
+******************************************************************************************************************/
+void DynamoteWiFi::handleWebSocketMessage(uint8_t index, char *message, uint16_t length)
+{
+	DynamoteMemoryProbe memoryProbe(MEMORY_HTTP);
+	uint32_t requestStartMicros = micros();
+	dynamoteMetrics.count(COUNTER_WEBSOCKET_MESSAGES);
+
+	// only the message type and record flag are looked at here, commands are parsed as usual
+	StaticJsonDocument<32> filter;
+	filter["type"] = true;
+	filter["enable"] = true;
+	StaticJsonDocument<64> header;
+	if (deserializeJson(header, (const char*)message, length, DeserializationOption::Filter(filter))) {
+		dynamoteMetrics.drop(DROP_JSON_PARSE_ERROR);
+		return;
+	}
+	const char *type = header["type"] | "";
+
+	//
+	// send a command, or a batch of them
 	//
-	// Are we trying to send a remote command?
+	if (strcmp(type, "send") == 0) {
+		dynamoteMetrics.beginRequest(requestStartMicros);
+		uint8_t result = sendJsonRemoteCommand(message, length, webSocketOwner(index));
+		String resultEvent = String("{\"type\":\"result\",\"result\":") + result + "}";
+		webSockets[index].sendText(resultEvent.c_str(), resultEvent.length());
+	}
+
+	//
+	// start or stop recording, captured commands are pushed as they come in
 	//
-	if (command.equals("sendRemoteCommand")) {
-		sendJsonRemoteCommand(commandData);
+	else if (strcmp(type, "record") == 0) {
+		// the open connection takes the place of the HTTP polling timeout, the session has no deadline
+		uint8_t sessionId = 0;
+		if (header["enable"] | true)
+			sessionId = openRecordSession(webSocketOwner(index), 0);
+		else
+			closeRecordSession(webSocketOwner(index));
+		webSocketRecording[index] = (sessionId != 0);
+		sendWebSocketState(index, sessionId);
 	}
 
 	//
-	// Are we trying to configure MQTT?
+	// latency histograms and counters
 	//
-	if (command.equals("configureMQTT")) {
-		configureMqtt(commandData);
-		Serial.println("Saved new MQTT config");
+	else if (strcmp(type, "metrics") == 0) {
+		String metricsEvent = "{\"type\":\"metrics\",\"metrics\":";
+		dynamoteMetrics.toJsonString(metricsEvent);
+		metricsEvent += "}";
+		webSockets[index].sendText(metricsEvent.c_str(), metricsEvent.length());
 	}
 
 	//
-	// determine if a new recorded command is requested by the client
+	// what the device supports and how it is set up
 	//
-	if (command.equals("getRecordedCommand")) {
-		if (remoteState != RECORD)
-			setRemoteState(RECORD);
-		// If we do not receive the next command within several seconds, we will go back to SEND state
-		remoteRecordRequestTime = millis();
+	else if (strcmp(type, "status") == 0) {
+		uint16_t statusLength;
+		const char *statusEvent = dynamoteStatus.toJson(&statusLength, "{\"type\":\"status\",\"status\":", "}");
+		webSockets[index].sendText(statusEvent, statusLength);
 	}
+
 	//
-	// determine if the client is done recording commands
+	// the next capture records from the capture log
 	//
-	else if (command.equals("getRecordedCommandDone")) {
-		setRemoteState(SEND);
+	else if (strcmp(type, "captures") == 0) {
+		String capturesEvent = "{\"type\":\"captures\",\"captures\":";
+		dynamoteCaptureLog.toJsonString(capturesEvent);
+		capturesEvent += "}";
+		if (webSockets[index].sendText(capturesEvent.c_str(), capturesEvent.length()))
+			dynamoteCaptureLog.acknowledge();
+	}
+
+	else {
+		DYNAMOTE_LOG_WARNING("Unknown WebSocket message type: %s", type);
 	}
 }
 
@@ -20,6 +20,10 @@
 #include <Dynamote.h>
 #ifndef DYNAMOTE_BLE
 #include <WiFi.h>
+#include <DynamoteUdp.h>
+#include <DynamoteWebSocket.h>
+#include <DynamoteHttpResponse.h>
+#include <DynamoteRouter.h>
 
 #if defined(ESP32)
 #define __DYNAMOTE_ESP32__
@@ -29,16 +33,36 @@
 #error "error, unsupported/untested board type for DynamoteWiFi.h"
 #endif
 
+// Longest request or header line kept, only the request line and the WebSocket key are looked at
+#define HTTP_MAX_LINE_LENGTH        128
+
 class DynamoteWiFi : public Dynamote {
 
   public:
     DynamoteWiFi(void);
     void begin(void);
     void loop(void);
+    // named groups for UDP multicast commands, see DynamoteUdp.h
+    bool joinGroup(const char *name);
+    void leaveGroup(const char *name);
 
   private:
     WiFiServer _server;
-    void handleCommandFromClient(String command, String commandData);
+    DynamoteUdp udpEndpoint;
+    DynamoteWebSocket webSockets[WEBSOCKET_MAX_CLIENTS];
+    bool webSocketRecording[WEBSOCKET_MAX_CLIENTS] = {};   // the WebSockets that have a record session open
+    // connection state as last put in the status document
+    bool lastWiFiConnected = false;
+    bool lastMqttConnected = false;
+    uint8_t lastWebSocketCount = 0;
+    static void buildStatus(JsonObject status, void *argument);
+    void watchStatus(void);
+    uint8_t handleRoute(DynamoteRoute route, char *commandData, size_t length, uint32_t clientKey);
+    bool acceptWebSocket(WiFiClient &client, const char *key);
+    void webSocketLoop(void);
+    uint32_t webSocketOwner(uint8_t index);
+    void sendWebSocketState(uint8_t index, uint8_t sessionId);
+    void handleWebSocketMessage(uint8_t index, char *message, uint16_t length);
 };
 
 #endif		